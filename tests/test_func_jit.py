@@ -1,10 +1,25 @@
+import array
+import ctypes
+import inspect
 import math
+import mmap
+import os
+import random
+import struct
+import tempfile
+import threading
+import types
 import unittest
 
 import venom
 
+from venom._compiler import _JITCompiler, JITBailout
+from venom._cpu import host_features, target_features
+from venom._execmem import CodeArena
+from venom._type import Precision, TypeFloat32, TypeFloat64, types_from_function_signature
+
 class TestVenom(unittest.TestCase):
-    
+
     def test_jit(self):
         @venom.jit
         def add_numbers(a, b):
@@ -18,7 +33,7 @@ class TestVenom(unittest.TestCase):
                 total += arr[i]
 
             return total
-        
+
         @venom.jit
         def sine_maclaurin(x: float) -> float:
             return x - x ** 3 / 5.0 + x ** 5 / 120.0
@@ -27,14 +42,1155 @@ class TestVenom(unittest.TestCase):
         def hash_int(x) -> int:
             return 0 if x <= 0 else x ^ 0x123456789 & 0x987654321 | 0x2
 
-        # res = sine_maclaurin(12.0)
+        self.assertEqual(sine_maclaurin(12.0), sine_maclaurin.__wrapped__(12.0))
 
-        # res = add_numbers(5, 3)
-        # res = add_numbers(4.0, 3)
+        self.assertEqual(add_numbers(5, 3), 8)
+        self.assertEqual(add_numbers(4.0, 3), 7.0)
 
         res = sum_array([1.0, 2.0, 4.0, 6.0])
 
-        # res = hash_int(12)
+        self.assertEqual(res, 13.0)
+        self.assertEqual(sum_array([1, 2, 3]), 6)
+
+        self.assertEqual(hash_int(12), hash_int.__wrapped__(12))
+        self.assertEqual(hash_int(-12), 0)
+
+    def test_int_semantics(self):
+        @venom.jit
+        def floordiv_mod(a, b):
+            return a // b * 1000 + a % b
+
+        @venom.jit
+        def shifts(a, b):
+            return (a << b) ^ (a >> b)
+
+        @venom.jit
+        def power(a, b):
+            return a ** b
+
+        values = [-7, -3, -1, 1, 2, 7, 2 ** 62, -2 ** 63]
+
+        for a in values:
+            for b in values:
+                self.assertEqual(floordiv_mod(a, b), floordiv_mod.__wrapped__(a, b))
+
+        for a in values:
+            for b in [0, 1, 5, 63, 100]:
+                self.assertEqual(shifts(a, b), shifts.__wrapped__(a, b))
+
+            for b in [0, 1, 2, 10, 63]:
+                self.assertEqual(power(a, b), power.__wrapped__(a, b))
+
+        # Errors are raised by the interpreter
+        with self.assertRaises(ZeroDivisionError):
+            floordiv_mod(1, 0)
+
+        @venom.jit
+        def first(arr):
+            return arr[0]
+
+        # Ints wider than 64 bits are run by the interpreter instead of being wrapped
+        self.assertEqual(power(2 ** 63 + 5, 1), 2 ** 63 + 5)
+        self.assertEqual(power(2 ** 64 + 5, 1), 2 ** 64 + 5)
+        self.assertEqual(first([2 ** 64 + 7, 1]), 2 ** 64 + 7)
+        self.assertEqual(first([-2 ** 63, 1]), -2 ** 63)
+
+    def test_float_semantics(self):
+        @venom.jit
+        def floordiv(a, b):
+            return a // b
+
+        @venom.jit
+        def mod(a, b):
+            return a % b
+
+        @venom.jit
+        def select(a, b):
+            return a if a < b else b
+
+        values = [-7.5, -3.0, -0.0, 0.5, 3.25, 1e300, math.inf, math.nan]
+
+        for a in values:
+            for b in values:
+                for func in (floordiv, mod, select):
+                    try:
+                        expected = func.__wrapped__(a, b)
+                    except ZeroDivisionError:
+                        self.assertRaises(ZeroDivisionError, func, a, b)
+                        continue
+
+                    result = func(a, b)
+
+                    if math.isnan(expected):
+                        self.assertTrue(math.isnan(result))
+                    else:
+                        self.assertEqual(result, expected)
+                        self.assertEqual(math.copysign(1.0, result), math.copysign(1.0, expected))
+
+        def scale(x):
+            return x / 2.5 + x // 0.5 - x / 0.0
+
+        compiler = _JITCompiler()
+        _, machine_code, _ = compiler._compile(scale, inspect.getsource(scale), types_from_function_signature((1.0,)), None)
+
+        # Only the division by the literal zero checks its divisor
+        self.assertEqual(sum(line.startswith("je .bailout") for line in machine_code.listing), 1)
+
+        with self.assertRaises(JITBailout):
+            compiler.jit_func(scale, (1.0,))(1.0)
+
+    def test_dispatch(self):
+        @venom.jit
+        def scale(arr, x):
+            return arr[0] * x
+
+        self.assertEqual(scale([2.0], 3.0), 6.0)
+        self.assertEqual(scale([2.0, 1.0], 4.0), 8.0)
+        self.assertEqual(scale([2], 3), 6)
+        self.assertEqual(scale([2], 3.0), 6.0)
+
+        # Mixed lists cannot be compiled and are run by the interpreter
+        self.assertEqual(scale([2, 1.0], 3), 6)
+        self.assertEqual(scale([2.0, 1], 3), 6.0)
+
+        dispatch = scale.__venom_dispatch__
+
+        self.assertEqual(len(dispatch), 4)
+        self.assertIsNotNone(dispatch[((list, float), float)])
+        self.assertIsNone(dispatch[((list, None), int)])
+
+        @venom.jit
+        def halve(x):
+            return x / 2
+
+        def broken_compile(*args):
+            raise RuntimeError("compiler bug")
+
+        # Errors of the compiler are run by the interpreter as well, and not retried
+        venom._jit._compiler._compile = broken_compile
+
+        try:
+            self.assertEqual(halve(3), 1.5)
+            self.assertEqual(halve(5), 2.5)
+        finally:
+            del venom._jit._compiler._compile
+
+        self.assertIsNone(halve.__venom_specializations__["Int64"])
+
+    def test_eager_signatures(self):
+        @venom.jit(signatures=["f8(f8, f8)", "f8(i8, i8)"])
+        def mul(a, b):
+            return a * b
+
+        @venom.jit(signatures=["(f8[:])"])
+        def first(arr):
+            return arr[0]
+
+        @venom.jit
+        def sine_maclaurin(x: float) -> float:
+            return x - x ** 3 / 5.0 + x ** 5 / 120.0
+
+        # Specializations are compiled at decoration time
+        self.assertEqual(set(mul.__venom_specializations__), { "Float64_Float64", "Int64_Int64" })
+        self.assertEqual(set(first.__venom_specializations__), { "Array(Float64, dynamic)" })
+        self.assertEqual(set(sine_maclaurin.__venom_specializations__), { "Float64" })
+
+        self.assertEqual(mul(1.5, 2.0), 3.0)
+
+        # The return type of the signature is enforced
+        self.assertEqual(mul(3, 4), 12.0)
+        self.assertIs(type(mul(3, 4)), float)
+
+        self.assertEqual(first([2.0, 1.0]), 2.0)
+        self.assertEqual(first(array.array("d", [3.0])), 3.0)
+        self.assertEqual(sine_maclaurin(12.0), sine_maclaurin.__wrapped__(12.0))
+
+        self.assertEqual(len(mul.__venom_specializations__), 2)
+        self.assertEqual(len(first.__venom_specializations__), 1)
+
+        @venom.jit
+        def scaled(x: float) -> float:
+            return offset(x) * 2.0
+
+        @venom.jit(signatures=["f8(i8)"])
+        def doubled(n):
+            return offset(n) * 2
+
+        @venom.jit
+        def offset(x):
+            return x + 1
+
+        # Callers of functions defined after them are compiled on their first call, with their signature
+        self.assertEqual(scaled.__venom_specializations__, {})
+        self.assertEqual(doubled.__venom_specializations__, {})
+
+        self.assertEqual(scaled(1.5), 5.0)
+        self.assertEqual(doubled(3), 8.0)
+        self.assertIs(type(doubled(3)), float)
+        self.assertIsNotNone(scaled.__venom_specializations__["Float64"])
+        self.assertIsNotNone(doubled.__venom_specializations__["Int64"])
+
+    def test_buffers(self):
+        @venom.jit
+        def weighted_sum(arr, x):
+            total = 0.0
+
+            for i in range(len(arr)):
+                total += arr[i] * x
+
+            return total
+
+        @venom.jit
+        def last(arr):
+            return arr[-1]
+
+        buffers = [array.array("d", [1.5, -2.5]),
+                   array.array("f", [1.5, 0.1]),
+                   array.array("i", [-5, 7]),
+                   array.array("b", [-1, -128]),
+                   array.array("H", [65535, 1]),
+                   array.array("I", [4000000000, 1]),
+                   bytearray(b"\xff\x01"),
+                   memoryview(b"\xff\x02")]
+
+        for buffer in buffers:
+            self.assertEqual(weighted_sum(buffer, 0.5), weighted_sum.__wrapped__(buffer, 0.5))
+
+            result = last(buffer)
+            expected = last.__wrapped__(buffer)
+
+            self.assertEqual(result, expected)
+            self.assertIs(type(result), type(expected))
+
+        # Buffers are not copied, the jitted function sees later writes
+        data = array.array("d", [1.0, 2.0])
+        weighted_sum(data, 1.0)
+        data[0] = 4.0
+
+        self.assertEqual(weighted_sum(data, 1.0), 6.0)
+
+        # Read-only ones are passed in place as well, and released after the call
+        readonly = memoryview(data).toreadonly()
+
+        self.assertEqual(weighted_sum(readonly, 1.0), 6.0)
+        self.assertEqual(last(readonly), 2.0)
+
+        readonly.release()
+        data.append(8.0)
+
+        self.assertEqual(weighted_sum(memoryview(data).toreadonly(), 1.0), 14.0)
+
+    def test_vectorized_reductions(self):
+        @venom.jit
+        def dot(a, b, n):
+            total = 0.0
+
+            for i in range(n):
+                total += a[i] * b[i] - 0.5
+
+            return total
+
+        @venom.jit
+        def checksum(arr):
+            total = 0
+            bits = 0
+
+            for i in range(len(arr)):
+                total -= arr[i]
+                bits ^= arr[i]
+
+            return total + bits
+
+        # Lengths around the group size exercise the scalar remainder
+        for n in (0, 1, 7, 8, 9, 101):
+            a = array.array("d", [math.sin(i) * 1e3 for i in range(n)])
+            b = array.array("f", [math.cos(i) for i in range(n)])
+            ints = array.array("q", [(-1) ** i * i ** 5 for i in range(n)])
+
+            self.assertEqual(dot(a, b, n), dot.__wrapped__(a, b, n))
+            self.assertEqual(checksum(ints), checksum.__wrapped__(ints))
+
+        # Out of bounds accesses and overflows are left to the interpreter
+        with self.assertRaises(IndexError):
+            dot(a, b, n + 1)
+
+        huge = array.array("q", [-2 ** 62] * 16)
+
+        self.assertEqual(checksum(huge), checksum.__wrapped__(huge))
+
+    def test_bounds_checks(self):
+        @venom.jit
+        def window_sum(arr, start, stop):
+            total = 0
+
+            for i in range(start, stop):
+                total += arr[i] * arr[i]
+
+            return total
+
+        values = [3, -1, 4, 1, -5, 9]
+
+        for start, stop in ((0, 6), (2, 5), (4, 1), (-2, 3), (-9, -9)):
+            self.assertEqual(window_sum(values, start, stop), window_sum.__wrapped__(values, start, stop))
+
+        # The check hoisted ahead of the loop leaves the error to the interpreter
+        with self.assertRaises(IndexError):
+            window_sum(values, 0, 7)
+
+        with self.assertRaises(IndexError):
+            window_sum(values, -7, 0)
+
+    def test_loop_carried_values(self):
+        @venom.jit
+        def rotate(n, x, y, z):
+            for i in range(n):
+                t = x
+                x = y
+                y = z
+                z = t
+
+            return x * 100 + y * 10 + z
+
+        @venom.jit
+        def last_values(n):
+            total = 0.0
+            x = 0
+
+            for i in range(n):
+                x = i * 2
+
+                for j in range(i, n, 2):
+                    total += i * j + x
+
+            for k in range(n, 0, -1):
+                total -= k
+
+            return total + x
+
+        # The loop variable keeps its value over empty ranges and holds the last value produced after the loop
+        @venom.jit
+        def last_index(n):
+            i = -1
+
+            for i in range(n):
+                pass
+
+            return i
+
+        @venom.jit
+        def reassigned(n):
+            i = -1
+            total = 0
+
+            for i in range(n):
+                i = i * 3
+                total += i
+
+            return total * 100 + i
+
+        for n in (-1, 0, 1, 2, 3, 7):
+            self.assertEqual(rotate(n, 1, 2, 3), rotate.__wrapped__(n, 1, 2, 3))
+            self.assertEqual(last_values(n), last_values.__wrapped__(n))
+            self.assertEqual(last_index(n), last_index.__wrapped__(n))
+            self.assertEqual(reassigned(n), reassigned.__wrapped__(n))
+
+    def test_constant_folding(self):
+        @venom.jit
+        def folded(x):
+            k = 3
+            total = 0.0
+
+            for i in range(k - 3):
+                total += x
+
+            scale = -0.0 if k > 2 else 1.0
+            nan = (k * 1e308) * 10.0 - 1e308 * 10.0
+
+            return total + x * scale + (1.0 if nan == nan else 2.0) + (7 // (k - 1)) % -2
+
+        @venom.jit
+        def overflow(x):
+            big = 2 ** 62
+
+            return big * 4 + x
+
+        for x in (0.0, -0.0, 1.5, -3.0):
+            result = folded(x)
+            expected = folded.__wrapped__(x)
+
+            self.assertEqual(result, expected)
+            self.assertEqual(math.copysign(1.0, result), math.copysign(1.0, expected))
+
+        # Constants which do not fit in 64 bits are left to the interpreter
+        self.assertEqual(overflow(1), 2 ** 64 + 1)
+
+    def test_redundant_code(self):
+        @venom.jit
+        def clamped_sum(arr, x, n):
+            total = 0.0
+
+            for i in range(len(arr)):
+                total += arr[i] * x if arr[i] * x < n else n - arr[i] * 0.0
+
+            return total
+
+        @venom.jit
+        def unused(arr, d):
+            dead = arr[3] + 1 // d
+
+            return arr[0]
+
+        values = [1.5, -2.0, 4.0, 0.25]
+
+        for x in (0.5, 2.0, -1.0):
+            self.assertEqual(clamped_sum(values, x, 1), clamped_sum.__wrapped__(values, x, 1))
+
+        self.assertEqual(unused(values, 2), 1.5)
+
+        # Unused values are still computed when they raise
+        with self.assertRaises(ZeroDivisionError):
+            unused(values, 0)
+
+        with self.assertRaises(IndexError):
+            unused(values[:3], 2)
+
+    def test_loop_invariants(self):
+        @venom.jit
+        def scaled(arr, n, k, dx):
+            total = 0.0
+
+            for j in range(3):
+                for i in range(n):
+                    total += arr[i] * (k / dx) + float(j)
+
+            return total
+
+        @venom.jit
+        def quotients(n, a, b):
+            total = 0
+
+            for i in range(n):
+                total += a // b + i
+
+            return total
+
+        values = array.array("d", [1.0, 2.0, 3.0])
+
+        self.assertEqual(scaled(values, 3, 2.0, 4.0), scaled.__wrapped__(values, 3, 2.0, 4.0))
+        self.assertEqual(quotients(3, 7, 2), 12)
+
+        # Hoisted divisions only run when the loop is entered
+        self.assertEqual(scaled(values, 0, 2.0, 0.0), 0.0)
+        self.assertEqual(quotients(0, 7, 0), 0)
+
+        with self.assertRaises(ZeroDivisionError):
+            quotients(2, 7, 0)
+
+    def test_powers(self):
+        @venom.jit
+        def polynomial(x):
+            return x ** 0 + x ** 2 - x ** 3 + x ** 5 + x ** -2 + x ** 0.5
+
+        @venom.jit
+        def power(x, n):
+            return x ** n
+
+        for x in (4.0, 0.25, 1.5, 1e-3, 7.0):
+            self.assertAlmostEqual(polynomial(x), polynomial.__wrapped__(x))
+
+        self.assertEqual(polynomial(4.0), polynomial.__wrapped__(4.0))
+
+        for x in (-3, 0, 1, 2, 7):
+            for n in (0, 1, 5, 13, 62):
+                self.assertEqual(power(x, n), x ** n)
+
+        # Errors and results out of the native range are left to the interpreter
+        self.assertEqual(power(3, -2), 3 ** -2)
+        self.assertEqual(power(2, 64), 2 ** 64)
+
+        with self.assertRaises(ZeroDivisionError):
+            polynomial(0.0)
+
+        with self.assertRaises(OverflowError):
+            polynomial(1e100)
+
+        # The square of 1e-160 is subnormal, its reciprocal overflows
+        with self.assertRaises(OverflowError):
+            polynomial(1e-160)
+
+        self.assertIsInstance(polynomial(-4.0), complex)
+
+    def test_constant_divisors(self):
+        @venom.jit
+        def bucket(h):
+            return h % 10 + h // 7 * 3 + h % 16 - h // 4 + h // 1000003 + h % (2 ** 62 + 1)
+
+        @venom.jit
+        def divmod_sum(a, b):
+            return a // b + a % b
+
+        for h in (0, 1, -1, 9, -9, 123456789, -123456789, 2 ** 62, 2 ** 63 - 1, -2 ** 63):
+            self.assertEqual(bucket(h), bucket.__wrapped__(h))
+
+        for a in (7, -7, 0, 2 ** 63 - 1, -2 ** 63):
+            for b in (3, -3, 1, 2 ** 62):
+                self.assertEqual(divmod_sum(a, b), a // b + a % b)
+
+        # INT64_MIN // -1 does not fit
+        self.assertEqual(divmod_sum(-2 ** 63, -1), 2 ** 63)
+
+        with self.assertRaises(ZeroDivisionError):
+            divmod_sum(1, 0)
+
+    def test_selections(self):
+        @venom.jit
+        def clamp(v, lo, hi):
+            v = lo if v < lo else v
+
+            return hi if v >= hi else v
+
+        @venom.jit
+        def threshold(v, t):
+            return 1.0 if v == t else -0.0
+
+        @venom.jit
+        def pick(a, b, x, y):
+            return x if a != b else y
+
+        for v in (-2.0, 0.5, 3.0, -0.0, math.nan, math.inf):
+            self.assertEqual(repr(clamp(v, -1.0, 1.0)), repr(clamp.__wrapped__(v, -1.0, 1.0)))
+
+        for v, t in ((1, 1), (1, 2), (-5, -5)):
+            self.assertEqual(repr(threshold(v, t)), repr(threshold.__wrapped__(v, t)))
+
+        # NaN is different from everything, itself included
+        for a, b in ((math.nan, math.nan), (1.0, 1.0), (1.0, math.nan), (0.0, -0.0)):
+            self.assertEqual(pick(a, b, 3, 4), pick.__wrapped__(a, b, 3, 4))
+
+    def test_native_calls(self):
+        @venom.jit
+        def square(x):
+            return x * x
+
+        @venom.jit
+        def head_sum(arr, n):
+            total = 0.0
+
+            for i in range(n):
+                total += arr[i]
+
+            return total
+
+        @venom.jit
+        def positive(x):
+            return True if x > 0.0 else False
+
+        @venom.jit
+        def ratio(a, b):
+            return a // b
+
+        @venom.jit
+        def kernel(xs, k):
+            total = 0.0
+            count = 0
+
+            for i in range(len(xs)):
+                total += square(xs[i]) + head_sum(xs, 2)
+                count += ratio(k, i + 1) if positive(xs[i]) == True else 0
+
+            return total + count
+
+        xs = [1.0, -2.0, 3.0, 4.5]
+
+        self.assertEqual(kernel(xs, 7), kernel.__wrapped__(xs, 7))
+        self.assertIsNotNone(next(iter(kernel.__venom_specializations__.values())))
+
+        # The callees are compiled for the types they are called with
+        self.assertIn("Float64", square.__venom_specializations__)
+        self.assertIn("Int64_Int64", ratio.__venom_specializations__)
+
+        @venom.jit
+        def shifted_ratio(a, b):
+            return ratio(a, b) + 1
+
+        # Bailouts of the callee run the caller with the interpreter
+        self.assertEqual(shifted_ratio(7, 2), 4)
+
+        with self.assertRaises(ZeroDivisionError):
+            shifted_ratio(7, 0)
+
+    def test_inlining(self):
+        @venom.jit
+        def clamp(v, lo, hi):
+            v = lo if v < lo else v
+
+            return hi if v > hi else v
+
+        @venom.jit
+        def lerp(a, b, t):
+            return a + (b - a) * clamp(t, 0.0, 1.0)
+
+        @venom.jit
+        def head_sum(arr, n):
+            total = 0.0
+
+            for i in range(n):
+                total += arr[i]
+
+            return total
+
+        @venom.jit
+        def ratio(a, b):
+            return a // b
+
+        def kernel(xs, k, d):
+            total = 0.0
+
+            for i in range(len(xs)):
+                total += lerp(xs[i], k, 1.5) * ratio(i, d)
+
+            return total + head_sum(xs, 2)
+
+        xs = array.array("d", [1.0, -2.0, 3.0, 4.5] * 5)
+
+        compiler = _JITCompiler()
+        jit_func = compiler.jit_func(kernel, (xs, 7.0, 3))
+
+        self.assertEqual(jit_func(xs, 7.0, 3), kernel(xs, 7.0, 3))
+
+        # The callees are copied in the caller, which no longer calls them
+        _, machine_code, _ = compiler._compile(kernel, inspect.getsource(kernel), types_from_function_signature((xs, 7.0, 3)), None)
+
+        self.assertFalse(any(relocation.relative for relocation in machine_code.relocations))
+
+        # Errors of the inlined code still bail out
+        with self.assertRaises(JITBailout):
+            jit_func(xs, 7.0, 0)
+
+        @venom.jit
+        def plus(x):
+            return x + 1
+
+        @venom.jit
+        def times(x):
+            return x * 100
+
+        def make_caller(callee):
+            def caller(x):
+                return callee(x) + 2
+
+            return caller
+
+        # Callers sharing their source are compiled again when they call other functions
+        self.assertEqual(compiler.jit_func(make_caller(plus), (3,))(3), 6)
+        self.assertEqual(compiler.jit_func(make_caller(times), (3,))(3), 302)
+
+    def test_recursion(self):
+        @venom.jit
+        def fib(n):
+            return n if n < 2 else fib(n - 1) + fib(n - 2)
+
+        @venom.jit
+        def halves(x):
+            return x if x < 1.0 else halves(x / 2.0) + 1.0
+
+        @venom.jit
+        def even(n):
+            return True if n == 0 else (False if n == 1 else even(n - 2))
+
+        @venom.jit
+        def count(n, total):
+            return total if n == 0 else count(n - 1, total + 0.5)
+
+        @venom.jit
+        def depth(n):
+            return 0 if n == 0 else depth(n - 1) + 1
+
+        @venom.jit
+        def fact(n, total):
+            return total if n <= 1 else fact(n - 1, total * n)
+
+        @venom.jit
+        def ackermann(m, n):
+            return n + 1 if m == 0 else (ackermann(m - 1, 1) if n == 0 else ackermann(m - 1, ackermann(m, n - 1)))
+
+        self.assertEqual(fib(20), 6765)
+        self.assertEqual(halves(1000.0), halves.__wrapped__(1000.0))
+        self.assertIs(even(10), True)
+        self.assertIs(even(7), False)
+
+        # Tail calls are loops, far beyond the recursion limit of the interpreter
+        self.assertIs(even(100001), False)
+        self.assertEqual(count(10 ** 6, 0.0), 5e5)
+
+        # Both branches of the nested conditional expression are tail calls, nothing reaches its end
+        self.assertEqual(ackermann(2, 3), 9)
+        self.assertIsNotNone(ackermann.__venom_specializations__["Int64_Int64"])
+
+        # The interpreter reruns overflowing calls, passing back ints wider than 64 bits
+        self.assertEqual(fact(25, 1), math.factorial(25))
+
+        self.assertEqual(depth(500), 500)
+        self.assertIsNotNone(depth.__venom_specializations__["Int64"])
+
+        # Recursions too deep for the native stack are left to the interpreter
+        with self.assertRaises(RecursionError):
+            depth(10 ** 6)
+
+    def test_single_precision(self):
+        @venom.jit(float_type="f32")
+        def dot(a, b):
+            total = 0.0
+
+            for i in range(len(a)):
+                total += a[i] * b[i] + 0.1
+
+            return total
+
+        @venom.jit(int_type="i32")
+        def checksum(arr):
+            total = 0
+
+            for i in range(len(arr)):
+                total += arr[i] ^ 3
+
+            return total
+
+        def single(x):
+            return struct.unpack("f", struct.pack("f", x))[0]
+
+        # Every operation is rounded to single precision, in the order of the iterations
+        for n in (0, 1, 7, 8, 9, 101):
+            a = array.array("f", [math.sin(i) * 1e3 for i in range(n)])
+            b = array.array("f", [math.cos(i) for i in range(n)])
+            ints = array.array("i", [(-1) ** i * i ** 4 for i in range(n)])
+
+            expected = 0.0
+
+            for x, y in zip(a, b):
+                expected = single(expected + single(single(x * y) + single(0.1)))
+
+            self.assertEqual(dot(a, b), expected)
+            self.assertEqual(checksum(ints), checksum.__wrapped__(ints))
+
+        # Ints leaving the 32 bits range are left to the interpreter
+        huge = array.array("i", [2 ** 31 - 1] * 16)
+
+        self.assertEqual(checksum(huge), checksum.__wrapped__(huge))
+
+        @venom.jit(int_type="i32")
+        def mul(a, b):
+            return a * b
+
+        self.assertEqual(mul(46341, 46341), 46341 ** 2)
+        self.assertEqual(mul(2 ** 40, 3), 3 * 2 ** 40)
+        self.assertEqual(mul(2 ** 64 + 7, 1), 2 ** 64 + 7)
+        self.assertEqual(mul(2 ** 31, 1), 2 ** 31)
+        self.assertEqual(list(mul.__venom_specializations__), ["Int32_Int32"])
+
+    def test_fastmath(self):
+        def dot(a, b):
+            total = 0.0
+
+            for i in range(len(a)):
+                total -= a[i] * b[i]
+
+            return total
+
+        def horner(x):
+            return ((x * 0.5 - 1.5) * x + 2.0) * x - 3.0 / x
+
+        strict_dot = venom.jit(dot)
+        fast_dot = venom.jit(fastmath=True)(dot)
+        fast_horner = venom.jit(fastmath=True)(horner)
+
+        # Small integers are exact in any order
+        for n in (0, 1, 3, 8, 9, 101):
+            a = array.array("d", [float(i % 17 - 8) for i in range(n)])
+            b = array.array("d", [float(i % 5) for i in range(n)])
+
+            self.assertEqual(fast_dot(a, b), dot(a, b))
+
+        a = array.array("d", [math.sin(i) for i in range(1001)])
+        b = array.array("d", [math.cos(i) for i in range(1001)])
+
+        self.assertEqual(strict_dot(a, b), dot(a, b))
+        self.assertAlmostEqual(fast_dot(a, b), dot(a, b), delta=1e-12)
+
+        for x in (0.1, -2.5, 1e3):
+            self.assertAlmostEqual(fast_horner(x), horner(x), delta=abs(horner(x)) * 1e-15)
+
+        # Division by zero still bails out to the interpreter
+        with self.assertRaises(ZeroDivisionError):
+            fast_horner(0.0)
+
+    def test_cpu_features(self):
+        def checksum(a, b, k):
+            total = 0
+            mask = -1
+
+            for i in range(len(a)):
+                total += a[i] - b[i] + k
+                mask &= a[i] | b[i]
+
+            return total + mask
+
+        def shift(x, n):
+            return (x << n) + (x >> n)
+
+        self.assertEqual(target_features("native"), host_features())
+        self.assertEqual(target_features("sse2"), ("sse2",))
+        self.assertTrue(set(target_features("avx2")) <= set(host_features()))
+
+        a = array.array("q", [(-1) ** i * i * 977 for i in range(103)])
+        b = array.array("q", [i * 31 for i in range(103)])
+
+        # Every feature set computes the same results, the baseline one without any AVX instruction
+        for features in (host_features(), target_features("avx2"), target_features("sse2")):
+            with tempfile.TemporaryDirectory() as directory:
+                compiler = _JITCompiler(features)
+                compiler.set_cache_dir(directory)
+
+                for n in (0, 5, 64, 103):
+                    self.assertEqual(compiler.jit_func(checksum, (a[:n], b[:n], 3))(a[:n], b[:n], 3), checksum(a[:n], b[:n], 3))
+
+                for x, n in ((5, 3), (-77, 40), (-1, 62), (12345, 0)):
+                    self.assertEqual(compiler.jit_func(shift, (x, n))(x, n), shift(x, n))
+
+                with self.assertRaises(JITBailout):
+                    compiler.jit_func(checksum, (a, b, 3))(array.array("q", [2 ** 62] * 16), b[:16], 3)
+
+            types = types_from_function_signature((a, b, 3))
+            _, machine_code, _ = compiler._compile(checksum, inspect.getsource(checksum), types, None)
+
+            self.assertEqual(any("ymm" in line for line in machine_code.listing), "avx2" in features)
+
+            # Bailouts from the ymm loop clear the upper halves before returning to SSE code
+            bailout = next(i for i, line in enumerate(machine_code.listing) if line.startswith(".bailout"))
+            self.assertEqual(machine_code.listing[bailout + 1] == "vzeroupper", "avx2" in features)
+
+    def test_math_intrinsics(self):
+        def norm(x, y):
+            return math.sqrt(x * y) + math.fabs(x) + math.copysign(1.0, y)
+
+        def rounding(x):
+            return math.floor(x) * 1000 + math.ceil(x) + abs(x)
+
+        def clamp(x, low, high):
+            return min(max(x, low), high)
+
+        def bounded_sum(a):
+            total = 0.0
+
+            for i in range(len(a)):
+                total += math.sqrt(min(max(a[i], 0.0), 100.0)) + abs(a[i])
+
+            return total
+
+        def same(a, b):
+            return struct.pack("<d", a) == struct.pack("<d", b) if isinstance(a, float) else a == b
+
+        nan = float("nan")
+        a = array.array("d", [(i * 7.25) % 131.0 - 15.5 for i in range(103)])
+
+        for features in (host_features(), target_features("sse2")):
+            compiler = _JITCompiler(features)
+
+            for x, y in ((3.0, 4.0), (-0.0, 0.0), (-2.5, -0.0), (nan, 1.0), (1e300, 1e300)):
+                self.assertTrue(same(compiler.jit_func(norm, (x, y))(x, y), norm(x, y)))
+
+            for x in (2.5, -2.5, -0.0, 0.5, -0.5, 2.0 ** 52 + 0.5, -7, 5):
+                self.assertEqual(compiler.jit_func(rounding, (x,))(x), rounding(x))
+
+            # min and max keep their first argument unless another one is strictly smaller or greater
+            for x, low, high in ((0.5, 0.0, 1.0), (-0.0, 0.0, 1.0), (nan, 0.0, 1.0), (2.0, nan, 1.0), (7, -3, 5)):
+                self.assertTrue(same(compiler.jit_func(clamp, (x, low, high))(x, low, high), clamp(x, low, high)))
+
+            for n in (0, 3, 64, 103):
+                self.assertEqual(compiler.jit_func(bounded_sum, (a[:n],))(a[:n]), bounded_sum(a[:n]))
+
+            # floor and ceil raise on infinities and NaN, sqrt on negative values and abs overflows on ints
+            for func, args in ((rounding, (math.inf,)), (rounding, (nan,)), (norm, (3.0, -4.0)), (rounding, (-2 ** 63,))):
+                with self.assertRaises(JITBailout):
+                    compiler.jit_func(func, args)(*args)
+
+            _, machine_code, _ = compiler._compile(bounded_sum, inspect.getsource(bounded_sum), types_from_function_signature((a,)), None)
+            self.assertTrue(any("sqrtpd" in line for line in machine_code.listing))
+
+            _, machine_code, _ = compiler._compile(rounding, inspect.getsource(rounding), types_from_function_signature((0.5,)), None)
+            self.assertEqual(any("roundsd" in line for line in machine_code.listing), "sse4_1" in features)
+
+        def shadowing(abs, math):
+            def shadowed(x):
+                return abs(x) + math.sqrt(x)
+
+            return shadowed
+
+        # Names bound to other objects than the builtins and the math module are not intrinsics
+        shadowed = venom.jit(shadowing(lambda x: 100.0, types.SimpleNamespace(sqrt=lambda x: 1000.0)))
+        self.assertEqual(shadowed(4.0), 1100.0)
+
+        unshadowed = venom.jit(shadowing(abs, math))
+        self.assertEqual(unshadowed(4.0), 6.0)
+        self.assertIsNotNone(unshadowed.__venom_specializations__["Float64"])
+
+    def test_transcendentals(self):
+        def exp(x):
+            return math.exp(x)
+
+        def log(x):
+            return math.log(x)
+
+        def sin(x):
+            return math.sin(x)
+
+        def cos(x):
+            return math.cos(x)
+
+        def tanh(x):
+            return math.tanh(x)
+
+        def softmax_total(a):
+            total = 0.0
+
+            for i in range(len(a)):
+                total += math.exp(a[i] - 1.0) + math.log(a[i]) + math.sin(a[i]) * math.cos(a[i]) + math.tanh(a[i])
+
+            return total
+
+        def ulps(a, b):
+            a, b = (struct.unpack("<q", struct.pack("<d", x))[0] for x in (a, b))
+
+            return abs((a if a >= 0 else -2 ** 63 - a) - (b if b >= 0 else -2 ** 63 - b))
+
+        # Maximum errors of the kernels documented in venom/_kernels.py
+        functions = ((exp, -745.0, 709.0, 1), (log, 1e-310, 1e300, 1), (sin, -1e6, 1e6, 1), (cos, -1e6, 1e6, 1),
+                     (tanh, -25.0, 25.0, 3))
+
+        # Overflows, domain errors and the arguments too large to reduce bail out, tanh never does
+        bailouts = { exp: (1000.0,), log: (0.0, -1.0, math.inf), sin: (math.inf, 1e7), cos: (-math.inf, -1e7), tanh: () }
+
+        fast = Precision(fastmath=True)
+        single = Precision(float_type=TypeFloat32, fastmath=True)
+        rng = random.Random(25)
+
+        a = array.array("d", [rng.uniform(0.01, 20.0) for _ in range(103)])
+        a32 = array.array("f", a)
+
+        for features in (host_features(), target_features("sse2")):
+            compiler = _JITCompiler(features)
+
+            for func, low, high, bound in functions:
+                strict_func = compiler.jit_specialization(func, [TypeFloat64])
+                fast_func = compiler.jit_specialization(func, [TypeFloat64], None, fast)
+
+                for x in [rng.uniform(low, high) for _ in range(500)] + [0.5, -0.0, 1.0, 2.0 ** -1074]:
+                    if func is log and x <= 0.0:
+                        continue
+
+                    # Without fastmath the libm the interpreter calls gives the same bits
+                    self.assertEqual(struct.pack("<d", strict_func(x)), struct.pack("<d", func(x)))
+                    self.assertLessEqual(ulps(fast_func(x), func(x)), bound, (func.__name__, x))
+
+                for x in bailouts[func]:
+                    with self.assertRaises(JITBailout):
+                        fast_func(x)
+
+            for n in (0, 7, 64, 103):
+                fast_total = compiler.jit_specialization(softmax_total, types_from_function_signature((a,)), None, fast)
+                expected = softmax_total(a[:n])
+                self.assertAlmostEqual(fast_total(a[:n]), expected, delta=abs(expected) * 1e-14)
+
+                single_total = compiler.jit_specialization(softmax_total, types_from_function_signature((a32,)), None, single)
+                expected = softmax_total(a32[:n])
+                self.assertAlmostEqual(single_total(a32[:n]), expected, delta=abs(expected) * 1e-6)
+
+            with self.assertRaises(JITBailout):
+                fast_total(array.array("d", [1.0] * 15 + [-1.0]))
+
+            # The loop runs the kernels on packed lanes, without calling the libm
+            _, machine_code, _ = compiler._compile(softmax_total, inspect.getsource(softmax_total),
+                                                   types_from_function_signature((a,)), None, fast)
+            self.assertTrue(any("divpd" in line for line in machine_code.listing))
+            self.assertFalse(any(line.startswith("call") for line in machine_code.listing))
+
+    def test_background_compilation(self):
+        @venom.jit(background=True)
+        def dot(a, b):
+            total = 0.0
+
+            for i in range(len(a)):
+                total += a[i] * b[i]
+
+            return total
+
+        @venom.jit(signatures=["f8(f8)"], background=True)
+        def square(x):
+            return x * x
+
+        a = array.array("d", [1.0, 2.0, 3.0])
+        b = array.array("d", [4.0, 5.0, 6.0])
+
+        # The first call is run by the interpreter while the worker compiles
+        self.assertEqual(dot(a, b), 32.0)
+        self.assertEqual(square(1.5), 2.25)
+
+        venom.wait_for_compilation()
+
+        self.assertTrue(all(jit_func is not None for jit_func in dot.__venom_dispatch__.values()))
+        self.assertIsNotNone(square.__venom_specializations__["Float64"])
+        self.assertEqual(dot(a, b), 32.0)
+        self.assertEqual(square(3.0), 9.0)
+
+        @venom.jit
+        def cube(x):
+            return x * x * x
+
+        # A specialization compiled by a batch of another thread is not called before the batch is sealed
+        started = threading.Event()
+        release = threading.Event()
+        results = list()
+
+        def compile_in_batch():
+            with venom._jit._compiler.batch():
+                cube.__venom_specialize__([TypeFloat64])
+                started.set()
+                release.wait()
+
+        compiler_thread = threading.Thread(target=compile_in_batch)
+        compiler_thread.start()
+        started.wait()
+
+        caller_thread = threading.Thread(target=lambda: results.append(cube(2.0)))
+        caller_thread.start()
+        caller_thread.join(0.1)
+
+        self.assertEqual(results, [])
+
+        release.set()
+        compiler_thread.join()
+        caller_thread.join()
+
+        self.assertEqual(results, [8.0])
+
+    def test_code_arena(self):
+        arena = CodeArena()
+        prototype = ctypes.PYFUNCTYPE(ctypes.c_int64)
+
+        def constant_function(value, padding = 0):
+            # mov rax, imm32; ret
+            return b"\x48\xC7\xC0" + struct.pack("<i", value) + b"\xC3" + b"\xCC" * padding
+
+        addresses = [arena.write(constant_function(i)) for i in range(100)]
+        arena.seal()
+
+        self.assertTrue(all(address % CodeArena.FUNCTION_ALIGNMENT == 0 for address in addresses))
+        self.assertEqual(addresses[-1] - addresses[0], 99 * CodeArena.FUNCTION_ALIGNMENT)
+
+        # Writing after a seal starts on the next page, and large functions open new chunks
+        addresses.append(arena.write(constant_function(100)))
+        addresses.append(arena.write(constant_function(101, CodeArena.CHUNK_SIZE)))
+        addresses.append(arena.write(constant_function(102)))
+        arena.seal()
+
+        self.assertEqual(addresses[100] % mmap.PAGESIZE, 0)
+
+        for i, address in enumerate(addresses):
+            self.assertEqual(prototype(address)(), i)
+
+    def test_disk_cache(self):
+        def poly(x, n):
+            total = 0.0
+
+            for i in range(n):
+                total += x ** i
+
+            return total
+
+        with tempfile.TemporaryDirectory() as directory:
+            compiler = _JITCompiler()
+            compiler.set_cache_dir(directory)
+
+            self.assertEqual(compiler.jit_func(poly, (2.0, 3))(2.0, 3), 7.0)
+            self.assertEqual(len([f for f in os.listdir(directory) if f.endswith(".vjit")]), 1)
+
+            # A fresh compiler, as in another process, loads the code without compiling it
+            compiler = _JITCompiler()
+            compiler.set_cache_dir(directory)
+            compiler._compile = None
+
+            self.assertEqual(compiler.jit_func(poly, (2.0, 3))(2.0, 5), 31.0)
+
+        @venom.jit
+        def plus(x):
+            return x + 1
+
+        @venom.jit
+        def times(x):
+            return x * 100
+
+        def make_caller(callee):
+            def caller(x):
+                return callee(x) + 2
+
+            return caller
+
+        # Inlined callees are part of the key, editing them compiles the caller again
+        with tempfile.TemporaryDirectory() as directory:
+            for callee, expected in ((plus, 6), (times, 302)):
+                compiler = _JITCompiler()
+                compiler.set_cache_dir(directory)
+
+                self.assertEqual(compiler.jit_func(make_caller(callee), (3,))(3), expected)
+
+    def test_register_pressure(self):
+        @venom.jit
+        def pressure(a, b):
+            c0 = a + 1.0; c1 = a * 2.0; c2 = b - 3.0; c3 = b * b; c4 = a - b; c5 = a + b
+            c6 = c0 * c1; c7 = c2 * c3; c8 = c4 + c5; c9 = c0 - c3; c10 = c1 + c2; c11 = c6 * c7
+            c12 = c8 - c9; c13 = c10 * c11; c14 = c12 + c13; c15 = c0 + c14; c16 = c1 + c15
+            return c0 + c1 + c2 + c3 + c4 + c5 + c6 + c7 + c8 + c9 + c10 + c11 + c12 + c13 + c14 + c15 + c16
+
+        @venom.jit
+        def calls_in_loop(x, n):
+            acc = 0.0
+            k = 0
+
+            for i in range(n):
+                acc += (x * 0.5) ** 2.0 + x % 3.0 + k
+                k += i ** 2
+
+            return acc + k
+
+        self.assertEqual(pressure(1.5, 2.5), pressure.__wrapped__(1.5, 2.5))
+        self.assertEqual(pressure(3, 7), pressure.__wrapped__(3, 7))
+        self.assertEqual(calls_in_loop(1.25, 10), calls_in_loop.__wrapped__(1.25, 10))
+
+    def test_bailout(self):
+        @venom.jit
+        def get(arr, i):
+            return arr[i]
+
+        @venom.jit
+        def nested(n):
+            total = 0
+
+            for i in range(n):
+                for j in range(i, n, 2):
+                    total += i * j
+
+            for k in range(n, 0, -1):
+                total -= k
+
+            return total
+
+        self.assertEqual(get([1.0, 2.0, 3.0], -1), 3.0)
+
+        with self.assertRaises(IndexError):
+            get([1.0, 2.0, 3.0], 3)
+
+        for n in (-1, 0, 1, 10):
+            self.assertEqual(nested(n), nested.__wrapped__(n))
 
 if __name__ == "__main__":
-    unittest.main()
\ No newline at end of file
+    unittest.main()
@@ -1,3 +1,4 @@
-from ._jit import jit, compile_file
+from ._jit import jit, compile_file, set_cache_dir, wait_for_compilation
+from ._version import __version__
 
-__all__ = ["jit", "compile_file"]
\ No newline at end of file
+__all__ = ["jit", "compile_file", "set_cache_dir", "wait_for_compilation"]
@@ -0,0 +1,76 @@
+import queue
+import threading
+import traceback
+
+from typing import Callable, List, Optional, Tuple
+
+from ._compiler import _JITCompiler, _JITFunc
+from ._log import print_generic_error
+
+# Compiles a specialization, and hands its result to the wrapper once the code is executable
+CompileJob = Tuple[Callable[[], Optional[_JITFunc]], Callable[[Optional[_JITFunc]], None]]
+
+class BackgroundCompiler():
+    """
+    Daemon thread compiling specializations while the interpreter keeps running the original functions. The
+    thread is started on the first submitted job
+    """
+
+    def __init__(self, compiler: _JITCompiler) -> None:
+        self._compiler = compiler
+        self._queue: "queue.Queue[CompileJob]" = queue.Queue()
+        self._thread: Optional[threading.Thread] = None
+        self._thread_lock = threading.Lock()
+
+    def submit(self,
+               compile: Callable[[], Optional[_JITFunc]],
+               publish: Callable[[Optional[_JITFunc]], None]) -> None:
+        """
+        Queues compile to run on the compiler thread, publish is called with its result once the code can be run
+        """
+        with self._thread_lock:
+            if self._thread is None:
+                self._thread = threading.Thread(target=self._run, name="venom-compiler", daemon=True)
+                self._thread.start()
+
+        self._queue.put((compile, publish))
+
+    def wait(self) -> None:
+        """
+        Blocks until all the queued specializations have been compiled and published
+        """
+        self._queue.join()
+
+    def _run(self) -> None:
+        while True:
+            jobs = [self._queue.get()]
+
+            # Jobs queued meanwhile are compiled together so that their code shares the pages sealed at the end
+            while True:
+                try:
+                    jobs.append(self._queue.get_nowait())
+                except queue.Empty:
+                    break
+
+            results: List[Optional[_JITFunc]] = list()
+
+            try:
+                with self._compiler.batch():
+                    for compile, _ in jobs:
+                        results.append(self._compile(compile))
+
+                for (_, publish), result in zip(jobs, results):
+                    publish(result)
+            except Exception:
+                print_generic_error(f"background compilation failed\n{traceback.format_exc()}")
+            finally:
+                for _ in jobs:
+                    self._queue.task_done()
+
+    def _compile(self, compile: Callable[[], Optional[_JITFunc]]) -> Optional[_JITFunc]:
+        try:
+            return compile()
+        except Exception:
+            # Failures fall back to the interpreter, like in the foreground
+            print_generic_error(f"background compilation failed\n{traceback.format_exc()}")
+            return None
@@ -0,0 +1,154 @@
+from dataclasses import dataclass
+from typing import Dict, List, Optional
+
+from ._ir import *
+from ._op import *
+from ._type import *
+
+@dataclass
+class _CountedLoop():
+    """
+    Loop built by IRBuilder.visit_For over range() with a positive step: guard falls through blocks[header],
+    possibly through preheaders, blocks[header:latch + 1] is the body and the latch jumps back to the header
+    while index < stop
+    """
+
+    guard: IRBlock
+    header: int
+    latch: int
+    index: int
+    stop: int
+
+def _definitions(function: IRFunction) -> Dict[int, List[IRStatement]]:
+    definitions = dict()
+
+    for block in function.blocks:
+        for stmt in block.statements:
+            for version in stmt.defines():
+                definitions.setdefault(version, list()).append(stmt)
+
+    return definitions
+
+def _single_definition(definitions: Dict[int, List[IRStatement]], version: int) -> Optional[IRStatement]:
+    stmts = definitions.get(version, [])
+
+    return stmts[0] if len(stmts) == 1 else None
+
+def _find_counted_loops(function: IRFunction, definitions: Dict[int, List[IRStatement]]) -> List[_CountedLoop]:
+    loops = list()
+    blocks = function.blocks
+
+    for latch, block in enumerate(blocks):
+        terminator = block.terminator
+
+        if not isinstance(terminator, IRJump) or terminator.comp != CompareOpType.Lt or terminator.block not in blocks:
+            continue
+
+        header = blocks.index(terminator.block)
+
+        if header == 0 or header > latch or latch + 1 >= len(blocks):
+            continue
+
+        guard = function.loop_guard(blocks[header])
+
+        if not isinstance(guard.terminator, IRJump) or \
+           guard.terminator.block is not blocks[latch + 1] or \
+           guard.terminator.comp != CompareOpType.GtEq:
+            continue
+
+        if len(block.statements) < 2 or len(guard.statements) == 0:
+            continue
+
+        step, compare, guard_compare = block.statements[-2], block.statements[-1], guard.statements[-1]
+
+        if not isinstance(compare, IRCompareOp) or not isinstance(guard_compare, IRCompareOp):
+            continue
+
+        index = compare.left
+
+        if (guard_compare.left, guard_compare.right) != (index, compare.right) or compare.type != TypeInt64:
+            continue
+
+        if isinstance(step, IRIncOp):
+            if step.version != index or step.operand != index:
+                continue
+        elif isinstance(step, IRBinaryOp):
+            increment = _single_definition(definitions, step.right)
+
+            if step.version != index or step.left != index or step.op != BinaryOpType.Add:
+                continue
+
+            if not isinstance(increment, IRLiteral) or type(increment.value) is not int or increment.value <= 0:
+                continue
+        else:
+            continue
+
+        # The body only sees index between its start and stop if nothing else writes to it
+        writers = [stmt for b in blocks[header:latch + 1] for stmt in b.statements if index in stmt.defines()]
+
+        if writers != [step]:
+            continue
+
+        loops.append(_CountedLoop(guard, header, latch, index, compare.right))
+
+    return loops
+
+def _is_non_negative_start(loop: _CountedLoop, definitions: Dict[int, List[IRStatement]]) -> bool:
+    # The last write to the index before the guard compare sets the start of the range
+    for stmt in reversed(loop.guard.statements[:-1]):
+        if loop.index in stmt.defines():
+            start = _single_definition(definitions, stmt.operand) if isinstance(stmt, IRMoveOp) else stmt
+
+            return isinstance(start, IRLiteral) and type(start.value) is int and start.value >= 0
+
+    return False
+
+def _stop_within(loop: _CountedLoop, length: int, definitions: Dict[int, List[IRStatement]]) -> bool:
+    # Follows the copies of range(len(arr)) up to the length of the array
+    version = loop.stop
+
+    while version != length:
+        stmt = _single_definition(definitions, version)
+
+        if not isinstance(stmt, IRMoveOp):
+            return False
+
+        version = stmt.operand
+
+    return True
+
+def eliminate_bounds_checks(ir: IR, function: IRFunction) -> int:
+    """
+    Removes the bounds checks of the loads indexed by the variable of a range() loop with a positive step,
+    where start <= index < stop. They are proven when the range starts from a non-negative literal and stops at
+    len(arr), the other ones are replaced by a single IRBoundsCheck ahead of the loop
+
+    Returns:
+        int: number of bounds checks removed from the loops
+    """
+    definitions = _definitions(function)
+
+    count = 0
+
+    for loop in _find_counted_loops(function, definitions):
+        non_negative = _is_non_negative_start(loop, definitions)
+        hoisted = list()
+
+        for block in function.blocks[loop.header:loop.latch + 1]:
+            for stmt in block.statements:
+                if not isinstance(stmt, IrMemLoadOp) or stmt.offset != loop.index or stmt.length is None:
+                    continue
+
+                if not non_negative or not _stop_within(loop, stmt.length, definitions):
+                    if stmt.length not in hoisted:
+                        hoisted.append(stmt.length)
+
+                stmt.length = None
+                count += 1
+
+        # Runs before the guard compare, which has to stay right before its jump
+        if len(hoisted) > 0:
+            loop.guard.statements.insert(len(loop.guard.statements) - 1,
+                                         IRBoundsCheck(None, loop.index, loop.stop, hoisted))
+
+    return count
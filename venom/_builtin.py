@@ -1,4 +1,7 @@
-from typing import Dict, Optional
+import builtins
+import math
+
+from typing import Any, Dict, Optional
 
 from ._type import *
 from ._symbols import FunctionBuiltin
@@ -21,7 +24,7 @@ _builtins = {
                                                    TypeFloat64)),
     "int": FunctionBuiltin("int", FunctionType("int",
                                                { "x": Type },
-                                               TypeFloat64)),
+                                               TypeInt64)),
     "bool": FunctionBuiltin("bool", FunctionType("bool",
                                                  { "x": Type },
                                                  TypeBool)),
@@ -32,7 +35,9 @@ def get_builtin_functions() -> Dict[str, FunctionBuiltin]:
 
 # Handle each function carefully 
 
-def get_builtin_function_specialization(name: str, args: List[Type]) -> Optional[FunctionType]:
+def get_builtin_function_specialization(name: str,
+                                        args: List[Type],
+                                        precision: Precision = DEFAULT_PRECISION) -> Optional[FunctionType]:
     if not name in _builtins:
         return None
 
@@ -40,4 +45,76 @@ def get_builtin_function_specialization(name: str, args: List[Type]) -> Optional
 
     args_mapping = { argname: argtype for argname, argtype in zip(builtin.type.args.keys(), args) }
 
-    return FunctionType(name, args_mapping, builtin.type.return_type)
\ No newline at end of file
+    # Conversions produce the ints and floats of the specialization, lengths and ranges stay 64 bits wide
+    return_type = precision.scalar_type(builtin.type.return_type) if name in ("float", "int") else builtin.type.return_type
+
+    return FunctionType(name, args_mapping, return_type)
+
+# Builtins and functions of the math module lowered to instructions instead of calls, by name as written in
+# the call and number of arguments (None for any number from 2)
+_intrinsics = {
+    "abs": 1,
+    "min": None,
+    "max": None,
+    "math.sqrt": 1,
+    "math.floor": 1,
+    "math.ceil": 1,
+    "math.fabs": 1,
+    "math.copysign": 2,
+    "math.exp": 1,
+    "math.log": 1,
+    "math.sin": 1,
+    "math.cos": 1,
+    "math.tanh": 1,
+}
+
+def is_intrinsic(name: str) -> bool:
+    return name in _intrinsics
+
+def intrinsic_binding(name: str) -> Any:
+    """
+    Object the name called for the intrinsic must be bound to: the builtin function, or the math module
+    """
+    return math if name.startswith("math.") else getattr(builtins, name)
+
+def get_intrinsic_return_type(name: str,
+                              args: List[Type],
+                              precision: Precision = DEFAULT_PRECISION) -> Optional[Type]:
+    """
+    Type of the value of the intrinsic called on values of the given types, None if it is not supported:
+    min and max need arguments all ints or all floats as their result takes the type of one of them
+
+    Returns:
+        Optional[Type]: the return type, following the types Python gives to the results
+    """
+    if name not in _intrinsics:
+        return None
+
+    num_args = _intrinsics[name]
+
+    if len(args) < 2 if num_args is None else len(args) != num_args:
+        return None
+
+    if any(type_rank(arg) not in (1, 2, 3) for arg in args):
+        return None
+
+    # Bools are ints, except for min and max returning one of their arguments
+    def promoted(arg: Type) -> Type:
+        return precision.int_type if arg == TypeBool else arg
+
+    if name in ("min", "max"):
+        if any(arg == TypeBool for arg in args) or len(set(type_rank(arg) for arg in args)) != 1:
+            return None
+
+        return max(args, key=type_order)
+
+    if name == "abs":
+        return promoted(args[0])
+
+    if name in ("math.floor", "math.ceil"):
+        return precision.int_type if type_rank(args[0]) == 3 else promoted(args[0])
+
+    # The other functions of the math module convert their arguments to floats
+    float_args = [arg if type_rank(arg) == 3 else precision.float_type for arg in args]
+
+    return max(float_args, key=type_order)
@@ -0,0 +1,2044 @@
+import ctypes
+import math
+import os
+import struct
+
+from dataclasses import dataclass, field
+from typing import Callable, Dict, List, Optional, Set, Tuple, Union
+
+from ._ir import *
+from ._op import *
+from ._type import *
+from ._x86 import *
+from ._regalloc import *
+from ._kernels import KERNEL_REGISTERS, emit_kernel
+from ._cpu import target_features
+from ._log import print_generic_error
+
+@dataclass
+class MachineCode():
+    """
+    Machine code of a function, along with the absolute addresses to patch before running it
+    """
+
+    name: str
+    code: bytes
+    relocations: List[Relocation] = field(default_factory=list)
+    listing: List[str] = field(default_factory=list)
+
+    def print(self) -> None:
+        print(f"{self.name}:")
+
+        for line in self.listing:
+            print(line if line.endswith(":") else f"    {line}")
+
+BAILOUT_SYMBOL = "venom_bailout"
+RECURSION_DEPTH_SYMBOL = "venom_recursion_depth"
+
+# Stack the frames of recursive calls may use, deeper recursions bail out and the interpreter raises RecursionError
+RECURSION_STACK_SIZE = 1 << 20
+
+# Instruction set extensions the generated code may use, the ones of the host unless VENOM_CPU pins a lower level
+# to compare the code generated for older CPUs
+TARGET_FEATURES: Tuple[str, ...] = target_features(os.environ.get("VENOM_CPU"))
+
+# Helpers
+
+def element_size(t: Type) -> int:
+    return ctypes.sizeof(type_to_ctypes_type(t))
+
+_int_conditions = {
+    CompareOpType.Eq: Cond.E,
+    CompareOpType.NotEq: Cond.NE,
+    CompareOpType.Lt: Cond.L,
+    CompareOpType.LtEq: Cond.LE,
+    CompareOpType.Gt: Cond.G,
+    CompareOpType.GtEq: Cond.GE,
+}
+
+# cmpsd predicates and whether the operands are swapped, unordered operands only satisfy != as in Python
+_float_predicates = {
+    CompareOpType.Eq: (0, False),
+    CompareOpType.NotEq: (4, False),
+    CompareOpType.Lt: (1, False),
+    CompareOpType.LtEq: (2, False),
+    CompareOpType.Gt: (1, True),
+    CompareOpType.GtEq: (2, True),
+}
+
+_commutative_ops = (BinaryOpType.Add, BinaryOpType.Mul, BinaryOpType.BitAnd, BinaryOpType.BitOr, BinaryOpType.BitXor)
+
+# Number of 8 bytes temporaries reserved in frames of functions making calls
+_NUM_CALL_TEMPS = 4
+
+_SIGN_MASK = -0x8000000000000000
+_ABS_MASK = 0x7FFFFFFFFFFFFFFF
+
+# Values float accumulators kept in lanes start from, by reduction
+_lane_starts = {
+    BinaryOpType.Mul: 1.0,
+    BinaryOpType.Min: math.inf,
+    BinaryOpType.Max: -math.inf,
+}
+
+class FunctionCodegen():
+    """
+    Lowers an IRFunction to x86-64 machine code following the System V calling convention
+    """
+
+    def __init__(self, ir: IR, function: IRFunction, allocation: Allocation, features: Tuple[str, ...]) -> None:
+        self._ir = ir
+        self._function = function
+        self._allocation = allocation
+        self._features = features
+
+        self._asm = Assembler()
+        self._entry = self._asm.new_label("entry")
+        self._bailout = self._asm.new_label("bailout")
+
+        # Set once a vector loop runs on ymm registers, which bailouts can leave from
+        self._uses_ymm = False
+        self._block_labels = { block.name: self._asm.new_label(block.name) for block in function.blocks }
+
+        self._callee_saved = allocation.callee_saved()
+
+        # Values of the versions only defined by a literal
+        definitions: Dict[int, List[IRStatement]] = dict()
+
+        for block in function.blocks:
+            for stmt in block.statements:
+                for version in stmt.defines():
+                    definitions.setdefault(version, list()).append(stmt)
+
+        self._constants = { version: stmts[0].value for version, stmts in definitions.items()
+                            if len(stmts) == 1 and isinstance(stmts[0], IRLiteral) }
+
+        self._has_calls = any(needs_call(stmt) for block in function.blocks for stmt in block.statements)
+
+        num_saves = allocation.num_call_saves()
+        num_temps = _NUM_CALL_TEMPS if self._has_calls else 0
+
+        self._save_base = allocation.num_slots
+        self._temp_base = self._save_base + num_saves
+
+        frame_size = 8 * (self._temp_base + num_temps)
+
+        # rsp is 16 bytes aligned before the call to this function, the return address and pushes realign it
+        if self._has_calls or frame_size > 0:
+            if (8 + 8 * len(self._callee_saved) + frame_size) % 16 != 0:
+                frame_size += 8
+
+        self._frame_size = frame_size
+
+        # Registers saved around the current call sequence
+        self._saved: List[Union[GPR, XMM]] = list()
+
+    # Types and operands
+
+    def _type(self, version: int) -> Type:
+        return self._ir.get_version_type(version)
+
+    def _is_float(self, version: int) -> bool:
+        return is_float_type(self._type(version))
+
+    def _slot(self, index: int) -> Mem:
+        return Mem(RSP, disp=8 * index)
+
+    def _temp(self, index: int) -> Mem:
+        return self._slot(self._temp_base + index)
+
+    def _operand(self, version: int) -> Union[GPR, XMM, Mem]:
+        location = self._allocation.locations.get(version)
+
+        if location is None:
+            raise CodegenError(f"version %{version} has no location")
+
+        if isinstance(location, StackSlot):
+            return self._slot(location.index)
+
+        return location
+
+    # Moves
+
+    def _move(self, dst: Union[GPR, XMM, Mem], src: Union[GPR, XMM, Mem], is_float: bool) -> None:
+        if dst == src:
+            return
+
+        if is_float:
+            if isinstance(dst, Mem) and isinstance(src, Mem):
+                self._asm.movsd(XMM15, src)
+                src = XMM15
+
+            self._asm.movsd(dst, src)
+        else:
+            if isinstance(dst, Mem) and isinstance(src, Mem):
+                self._asm.mov(R11, src)
+                src = R11
+
+            self._asm.mov(dst, src)
+
+    def _parallel_move(self, moves: List[Tuple[Union[GPR, XMM, Mem], Union[GPR, XMM, Mem], bool]]) -> None:
+        """
+        Performs moves as if they all happened at the same time, breaking cycles with rax or xmm14
+        """
+        pending = [move for move in moves if move[0] != move[1]]
+
+        while len(pending) > 0:
+            for i, (dst, src, is_float) in enumerate(pending):
+                if not any(other_src == dst for j, (_, other_src, _) in enumerate(pending) if j != i):
+                    self._move(dst, src, is_float)
+                    pending.pop(i)
+                    break
+            else:
+                dst, src, is_float = pending[0]
+                tmp = XMM14 if is_float else RAX
+                self._move(tmp, src, is_float)
+                pending[0] = (dst, tmp, is_float)
+
+    # Frame
+
+    def _emit_prologue(self) -> None:
+        for reg in self._callee_saved:
+            self._asm.push(reg)
+
+        if self._frame_size > 0:
+            self._asm.sub(RSP, self._frame_size)
+
+        moves = list()
+
+        for version, reg in abi_arguments(self._function):
+            if version in self._allocation.locations:
+                moves.append((self._operand(version), reg, isinstance(reg, XMM)))
+
+        self._parallel_move(moves)
+
+        # 32 bits scalars are passed in whole registers, like the 64 bits ones
+        for name, type in self._function.parameters.items():
+            version = self._function.parameter_versions[name]
+
+            if version in self._allocation.locations:
+                self._narrow(self._operand(version), type)
+
+    def _emit_epilogue(self) -> None:
+        if self._frame_size > 0:
+            self._asm.add(RSP, self._frame_size)
+
+        for reg in reversed(self._callee_saved):
+            self._asm.pop(reg)
+
+        self._asm.ret()
+
+    def _emit_bailout(self) -> None:
+        """
+        Flags the bailout and returns, the caller then runs the function with the Python interpreter
+        """
+        self._asm.bind(self._bailout)
+
+        # The loops on ymm registers jump here before their vzeroupper
+        if self._uses_ymm:
+            self._asm.vzeroupper()
+
+        self._asm.mov_reloc(R11, BAILOUT_SYMBOL)
+        self._asm.mov(Mem(R11), 1)
+        self._asm.mov(RAX, 0)
+        self._emit_epilogue()
+
+    # External calls
+
+    def _save_caller_saved(self, stmt: IRStatement) -> None:
+        self._saved = self._allocation.live_across_call(stmt)
+
+        for i, reg in enumerate(self._saved):
+            self._move(self._slot(self._save_base + i), reg, isinstance(reg, XMM))
+
+    def _restore_caller_saved(self) -> None:
+        for i, reg in enumerate(self._saved):
+            self._move(reg, self._slot(self._save_base + i), isinstance(reg, XMM))
+
+        self._saved = list()
+
+    def _call(self, symbol: str) -> None:
+        self._asm.mov_reloc(R11, symbol)
+        self._asm.call(R11)
+
+    # Branches
+
+    def _jump_if(self, op: CompareOpType, is_float: bool, label: Label, negate: bool = False) -> None:
+        """
+        Jumps to label if the flags set by the compare satisfy op (or do not if negate). Float compares are
+        emitted so that unordered results (NaN) are never satisfied, as in Python
+        """
+        if not is_float:
+            cond = _int_conditions[op]
+            self._asm.jcc(cond.negate() if negate else cond, label)
+            return
+
+        if op in (CompareOpType.Eq, CompareOpType.NotEq):
+            if (op == CompareOpType.Eq) != negate:
+                skip = self._asm.new_label("unordered")
+                self._asm.jcc(Cond.P, skip)
+                self._asm.jcc(Cond.E, label)
+                self._asm.bind(skip)
+            else:
+                self._asm.jcc(Cond.P, label)
+                self._asm.jcc(Cond.NE, label)
+            return
+
+        # Lt and LtEq operands are swapped when emitting the compare
+        cond = Cond.A if op in (CompareOpType.Lt, CompareOpType.Gt) else Cond.AE
+        self._asm.jcc(cond.negate() if negate else cond, label)
+
+    def _nonzero_constant(self, version: int) -> bool:
+        """
+        Returns True if version only holds a literal other than zero, dividing by it cannot raise
+        """
+        value = self._constants.get(version)
+
+        return value is not None and value != 0
+
+    def _bailout_if_zero(self, operand: Union[GPR, XMM, Mem], is_float: bool) -> None:
+        if is_float:
+            self._asm.xorpd(XMM14, XMM14)
+            self._asm.ucomisd(XMM14, operand)
+            self._jump_if(CompareOpType.Eq, True, self._bailout)
+        else:
+            self._asm.cmp(operand, 0)
+            self._asm.jcc(Cond.E, self._bailout)
+
+    def _narrow(self, operand: Union[GPR, XMM, Mem], type: Type) -> None:
+        """
+        Brings a value computed on 64 bits to type: Float32 values are rounded to single precision, Int32 ones
+        not fitting 32 bits bail out. Both are then held by their 64 bits counterpart without loss
+        """
+        if type == TypeFloat32:
+            work = operand if isinstance(operand, XMM) else XMM15
+
+            self._move(work, operand, True)
+            self._asm.cvtsd2ss(work, work)
+            self._asm.cvtss2sd(work, work)
+            self._move(operand, work, True)
+        elif type == TypeInt32:
+            work = operand if isinstance(operand, GPR) else RAX
+
+            self._move(work, operand, False)
+            self._asm.movsxd(R11, work)
+            self._asm.cmp(R11, work)
+            self._asm.jcc(Cond.NE, self._bailout)
+
+    # Statements lowering
+
+    def _lower_literal(self, stmt: IRLiteral) -> None:
+        dst = self._operand(stmt.version)
+
+        if is_float_type(stmt.type):
+            value = float(stmt.value)
+
+            if isinstance(dst, Mem):
+                self._asm.movsd(XMM15, self._asm.constant_f64(value))
+                self._asm.movsd(dst, XMM15)
+            elif value == 0.0 and struct.pack("<d", value) == b"\x00" * 8:
+                self._asm.xorpd(dst, dst)
+            else:
+                self._asm.movsd(dst, self._asm.constant_f64(value))
+        else:
+            value = int(stmt.value)
+
+            if isinstance(dst, Mem) and not fits_imm32(value):
+                self._asm.mov(R11, value)
+                self._asm.mov(dst, R11)
+            else:
+                self._asm.mov(dst, value)
+
+    def _lower_move(self, stmt: IRMoveOp) -> None:
+        self._move(self._operand(stmt.version), self._operand(stmt.operand), self._is_float(stmt.version))
+
+    def _lower_cast(self, stmt: IRCastOp) -> None:
+        dst = self._operand(stmt.version)
+        src = self._operand(stmt.operand)
+
+        from_float = is_float_type(stmt.type_from)
+        to_float = is_float_type(stmt.type_to)
+
+        if from_float and to_float:
+            self._move(dst, src, True)
+
+            if stmt.type_from != TypeFloat32:
+                self._narrow(dst, stmt.type_to)
+        elif to_float:
+            work = dst if isinstance(dst, XMM) else XMM14
+
+            # Breaks the dependency of cvtsi2sd on the previous value of the register
+            self._asm.xorpd(work, work)
+
+            # Integers are rounded once to single precision, going through a double would round them twice
+            if stmt.type_to == TypeFloat32:
+                self._asm.cvtsi2ss(work, src)
+                self._asm.cvtss2sd(work, work)
+            else:
+                self._asm.cvtsi2sd(work, src)
+
+            self._move(dst, work, True)
+        elif stmt.type_to == TypeBool:
+            if from_float:
+                if not isinstance(src, XMM):
+                    self._asm.movsd(XMM15, src)
+                    src = XMM15
+
+                # NaN is truthy
+                self._asm.xorpd(XMM14, XMM14)
+                self._asm.ucomisd(src, XMM14)
+                self._asm.setcc(Cond.NE, RAX)
+                self._asm.setcc(Cond.P, RDX)
+                self._asm.movzx8(RAX, RAX)
+                self._asm.movzx8(RDX, RDX)
+                self._asm.or_(RAX, RDX)
+            else:
+                self._asm.cmp(src, 0)
+                self._asm.setcc(Cond.NE, RAX)
+                self._asm.movzx8(RAX, RAX)
+
+            self._move(dst, RAX, False)
+        elif from_float:
+            self._asm.cvttsd2si(RAX, src)
+
+            # 0x8000000000000000 is returned for NaN and out of range values, only this value overflows on rax - 1
+            self._asm.cmp(RAX, 1)
+            self._asm.jcc(Cond.O, self._bailout)
+            self._narrow(RAX, stmt.type_to)
+            self._move(dst, RAX, False)
+        else:
+            # Bools and integers share the same representation
+            self._move(dst, src, False)
+
+            if stmt.type_from == TypeInt64:
+                self._narrow(dst, stmt.type_to)
+
+    def _lower_unary(self, stmt: IRUnaryOp) -> None:
+        dst = self._operand(stmt.version)
+        src = self._operand(stmt.operand)
+
+        if stmt.op == UnaryOpType.Add:
+            self._move(dst, src, is_float_type(stmt.type))
+        elif stmt.op in TRANSCENDENTAL_OPS:
+            self._lower_math_function(stmt)
+        elif is_float_type(stmt.type):
+            work = dst if isinstance(dst, XMM) else XMM14
+
+            if stmt.op == UnaryOpType.Sub:
+                self._move(work, src, True)
+                self._asm.xorpd(work, self._asm.constant_i64(_SIGN_MASK))
+            elif stmt.op == UnaryOpType.Sqrt:
+                if not isinstance(src, XMM):
+                    self._asm.movsd(XMM15, src)
+                    src = XMM15
+
+                # Negative values raise in Python, -0.0 and NaN do not
+                self._asm.xorpd(XMM14, XMM14)
+                self._asm.ucomisd(XMM14, src)
+                self._asm.jcc(Cond.A, self._bailout)
+                self._asm.sqrtsd(work, src)
+                self._narrow(work, stmt.type)
+            elif stmt.op == UnaryOpType.Abs:
+                self._move(work, src, True)
+                self._asm.andpd(work, self._asm.constant_i64(_ABS_MASK))
+            elif stmt.op in (UnaryOpType.Floor, UnaryOpType.Ceil):
+                self._lower_float_round(stmt.op, work, src)
+            else:
+                raise CodegenError(f"unsupported unary op on float: {unop_to_string(stmt.op)}")
+
+            self._move(dst, work, True)
+        elif stmt.op == UnaryOpType.Abs:
+            # Only the smallest integer overflows when negated, negative results mean the value was positive
+            self._move(RAX, src, False)
+            self._asm.neg(RAX)
+            self._asm.jcc(Cond.O, self._bailout)
+            self._asm.cmov(Cond.S, RAX, src)
+            self._narrow(RAX, stmt.type)
+            self._move(dst, RAX, False)
+        else:
+            work = dst if isinstance(dst, GPR) else RAX
+            self._move(work, src, False)
+
+            if stmt.op == UnaryOpType.Sub:
+                self._asm.neg(work)
+                self._asm.jcc(Cond.O, self._bailout)
+                self._narrow(work, stmt.type)
+            elif stmt.op == UnaryOpType.Invert:
+                self._asm.not_(work)
+            else:
+                raise CodegenError(f"unsupported unary op: {unop_to_string(stmt.op)}")
+
+            self._move(dst, work, False)
+
+    def _lower_float_round(self, op: UnaryOpType, dst: XMM, src: Union[XMM, Mem]) -> None:
+        """
+        Rounds src towards -inf for Floor and +inf for Ceil with roundsd when SSE4.1 is there. Otherwise the
+        value truncated by cvttsd2si is moved by one when it is on the wrong side of src
+        """
+        if "sse4_1" in self._features:
+            self._asm.roundsd(dst, src, 9 if op == UnaryOpType.Floor else 10)
+            return
+
+        if not isinstance(src, XMM) or src == dst:
+            self._asm.movsd(XMM15, src)
+            src = XMM15
+
+        done = self._asm.new_label("rounded")
+
+        # Values out of the range of integers are already integral, or infinite and NaN
+        self._move(dst, src, True)
+        self._asm.cvttsd2si(RAX, src)
+        self._asm.cmp(RAX, 1)
+        self._asm.jcc(Cond.O, done)
+
+        self._asm.xorpd(dst, dst)
+        self._asm.cvtsi2sd(dst, RAX)
+        self._asm.ucomisd(dst, src)
+
+        if op == UnaryOpType.Floor:
+            self._asm.jcc(Cond.BE, done)
+            self._asm.subsd(dst, self._asm.constant_f64(1.0))
+        else:
+            self._asm.jcc(Cond.AE, done)
+            self._asm.addsd(dst, self._asm.constant_f64(1.0))
+
+        self._asm.bind(done)
+
+    def _lower_math_function(self, stmt: IRUnaryOp) -> None:
+        """
+        Calls the function of the libm the interpreter calls, whose symbol has the name of the op. With fastmath
+        its kernel runs on the low lane of xmm14 instead, the registers it takes being saved as for a call
+        """
+        dst = self._operand(stmt.version)
+
+        self._save_caller_saved(stmt)
+
+        if stmt.fastmath:
+            count = KERNEL_REGISTERS[stmt.op]
+            registers = [XMM14, XMM15] + ALLOCATABLE_XMMS[:count - 2]
+            overflow = ALLOCATABLE_XMMS[count - 2]
+
+            self._move(XMM14, self._operand(stmt.operand), True)
+            self._asm.xorpd(overflow, overflow)
+
+            emit_kernel(self._asm, stmt.op, registers, overflow)
+
+            # The high lane holds whatever the register held
+            self._asm.movmskpd(RAX, overflow)
+            self._asm.and_(RAX, 1)
+            self._asm.jcc(Cond.NE, self._bailout)
+        else:
+            self._move(XMM0, self._operand(stmt.operand), True)
+            self._call(unop_to_string(stmt.op))
+            self._bailout_unless_finite(XMM0)
+            self._asm.movsd(XMM14, XMM0)
+
+        self._narrow(XMM14, stmt.type)
+
+        self._restore_caller_saved()
+
+        self._move(dst, XMM14, True)
+
+    def _bailout_unless_finite(self, value: XMM) -> None:
+        self._asm.movq_from_xmm(RAX, value)
+        self._asm.shl(RAX, 1)
+        self._asm.shr(RAX, 53)
+        self._asm.cmp(RAX, 0x7FF)
+        self._asm.jcc(Cond.E, self._bailout)
+
+    def _lower_binary(self, stmt: IRBinaryOp) -> None:
+        if is_float_type(stmt.type):
+            if stmt.op in (BinaryOpType.Add, BinaryOpType.Sub, BinaryOpType.Mul, BinaryOpType.Div):
+                self._lower_float_arith(stmt)
+            elif stmt.op in (BinaryOpType.FloorDiv, BinaryOpType.Mod):
+                self._lower_float_floordiv_mod(stmt)
+            elif stmt.op == BinaryOpType.Pow:
+                self._lower_float_pow(stmt)
+            elif stmt.op in (BinaryOpType.Min, BinaryOpType.Max, BinaryOpType.CopySign):
+                self._lower_float_min_max(stmt)
+            else:
+                raise CodegenError(f"unsupported binary op on float: {binop_to_string(stmt.op)}")
+        else:
+            if stmt.op in (BinaryOpType.Add, BinaryOpType.Sub, BinaryOpType.Mul,
+                           BinaryOpType.BitAnd, BinaryOpType.BitOr, BinaryOpType.BitXor):
+                self._lower_int_arith(stmt)
+            elif stmt.op in (BinaryOpType.LShift, BinaryOpType.RShift):
+                self._lower_int_shift(stmt)
+            elif stmt.op in (BinaryOpType.FloorDiv, BinaryOpType.Mod):
+                self._lower_int_floordiv_mod(stmt)
+            elif stmt.op == BinaryOpType.Pow:
+                self._lower_int_pow(stmt)
+            elif stmt.op in (BinaryOpType.Min, BinaryOpType.Max):
+                self._lower_int_min_max(stmt)
+            else:
+                raise CodegenError(f"unsupported binary op on int: {binop_to_string(stmt.op)}")
+
+    def _lower_int_arith(self, stmt: IRBinaryOp) -> None:
+        dst = self._operand(stmt.version)
+        left = self._operand(stmt.left)
+        right = self._operand(stmt.right)
+
+        if dst == right and dst != left and stmt.op in _commutative_ops:
+            left, right = right, left
+
+        work = dst if isinstance(dst, GPR) and dst != right else RAX
+
+        self._move(work, left, False)
+
+        if stmt.op == BinaryOpType.Add:
+            self._asm.add(work, right)
+        elif stmt.op == BinaryOpType.Sub:
+            self._asm.sub(work, right)
+        elif stmt.op == BinaryOpType.Mul:
+            self._asm.imul(work, right)
+        elif stmt.op == BinaryOpType.BitAnd:
+            self._asm.and_(work, right)
+        elif stmt.op == BinaryOpType.BitOr:
+            self._asm.or_(work, right)
+        elif stmt.op == BinaryOpType.BitXor:
+            self._asm.xor(work, right)
+
+        # Python integers do not overflow, let the interpreter handle it
+        if stmt.op in (BinaryOpType.Add, BinaryOpType.Sub, BinaryOpType.Mul):
+            self._asm.jcc(Cond.O, self._bailout)
+            self._narrow(work, stmt.type)
+
+        self._move(dst, work, False)
+
+    def _lower_int_shift(self, stmt: IRBinaryOp) -> None:
+        dst = self._operand(stmt.version)
+
+        # BMI2 shifts take a single micro-op, shifts by cl three
+        bmi2 = "bmi2" in self._features
+
+        self._move(RCX, self._operand(stmt.right), False)
+        self._move(RAX, self._operand(stmt.left), False)
+
+        if stmt.op == BinaryOpType.RShift:
+            # Negative counts raise, counts past 63 give the sign of the value
+            self._asm.test(RCX, RCX)
+            self._asm.jcc(Cond.S, self._bailout)
+            self._asm.mov(R11, 63)
+            self._asm.cmp(RCX, R11)
+            self._asm.cmov(Cond.A, RCX, R11)
+
+            if bmi2:
+                self._asm.sarx(RAX, RAX, RCX)
+            else:
+                self._asm.sar(RAX)
+        else:
+            # Negative counts and shifted out bits are handled by the interpreter
+            self._asm.cmp(RCX, 63)
+            self._asm.jcc(Cond.A, self._bailout)
+
+            if bmi2:
+                self._asm.shlx(R11, RAX, RCX)
+                self._asm.sarx(RDX, R11, RCX)
+                self._asm.cmp(RDX, RAX)
+                self._asm.jcc(Cond.NE, self._bailout)
+                self._asm.mov(RAX, R11)
+            else:
+                self._asm.mov(R11, RAX)
+                self._asm.shl(RAX)
+                self._asm.mov(RDX, RAX)
+                self._asm.sar(RDX)
+                self._asm.cmp(RDX, R11)
+                self._asm.jcc(Cond.NE, self._bailout)
+
+            self._narrow(RAX, stmt.type)
+
+        self._move(dst, RAX, False)
+
+    def _lower_int_floordiv_mod(self, stmt: IRBinaryOp) -> None:
+        divisor = self._constants.get(stmt.right)
+
+        if isinstance(divisor, int) and divisor > 0:
+            self._lower_int_floordiv_mod_constant(stmt, divisor)
+            return
+
+        dst = self._operand(stmt.version)
+        is_mod = stmt.op == BinaryOpType.Mod
+
+        divide = self._asm.new_label("divide")
+        done = self._asm.new_label("divdone")
+
+        self._move(RCX, self._operand(stmt.right), False)
+        self._move(RAX, self._operand(stmt.left), False)
+
+        self._asm.test(RCX, RCX)
+        self._asm.jcc(Cond.E, self._bailout)
+
+        # idiv faults on INT64_MIN / -1
+        self._asm.cmp(RCX, -1)
+        self._asm.jcc(Cond.NE, divide)
+
+        if is_mod:
+            self._asm.mov(RDX, 0)
+        else:
+            self._asm.neg(RAX)
+            self._asm.jcc(Cond.O, self._bailout)
+
+        self._asm.jmp(done)
+
+        self._asm.bind(divide)
+        self._asm.cqo()
+        self._asm.idiv(RCX)
+
+        # idiv truncates towards zero, Python floors: adjust by one divisor when the remainder is not zero and
+        # its sign differs from the divisor one
+        self._asm.mov(R11, RDX)
+        self._asm.xor(R11, RCX)
+        self._asm.shr(R11, 63)
+        self._asm.test(RDX, RDX)
+        self._asm.cmov(Cond.E, R11, RDX)
+
+        if is_mod:
+            self._asm.neg(R11)
+            self._asm.and_(R11, RCX)
+            self._asm.add(RDX, R11)
+        else:
+            self._asm.sub(RAX, R11)
+
+        self._asm.bind(done)
+
+        # INT32_MIN // -1 does not fit 32 bits
+        if not is_mod:
+            self._narrow(RAX, stmt.type)
+
+        self._move(dst, RDX if is_mod else RAX, False)
+
+    def _lower_int_floordiv_mod_constant(self, stmt: IRBinaryOp, divisor: int) -> None:
+        """
+        Powers of two are arithmetic shifts and masks, which floor as Python does. Other divisors multiply
+        n ^ (n >> 63) by a magic number: it is n or ~n = -n - 1, never negative, and n // d = ~(~n // d) for
+        negative n. Numerators fit in 63 bits, so the magic number of Granlund and Montgomery fits in 64
+        """
+        dst = self._operand(stmt.version)
+        is_mod = stmt.op == BinaryOpType.Mod
+
+        self._move(RAX, self._operand(stmt.left), False)
+
+        if divisor == 1:
+            if is_mod:
+                self._asm.mov(RAX, 0)
+        elif divisor & (divisor - 1) == 0:
+            if is_mod:
+                self._asm.mov(R11, divisor - 1)
+                self._asm.and_(RAX, R11)
+            else:
+                self._asm.sar(RAX, divisor.bit_length() - 1)
+        else:
+            shift = (divisor - 1).bit_length()
+            magic = -(-(1 << (63 + shift)) // divisor)
+
+            self._asm.mov(RCX, RAX)
+            self._asm.mov(R11, RAX)
+            self._asm.sar(R11, 63)
+            self._asm.xor(RAX, R11)
+            self._asm.mov(RDX, magic - (1 << 64) if magic >= (1 << 63) else magic)
+            self._asm.mul(RDX)
+            self._asm.shr(RDX, shift - 1)
+            self._asm.xor(RDX, R11)
+
+            if is_mod:
+                # n - q * d wraps around when q * d is below INT64_MIN, the remainder is right anyway
+                self._asm.mov(R11, divisor)
+                self._asm.imul(RDX, R11)
+                self._asm.sub(RCX, RDX)
+                self._asm.mov(RAX, RCX)
+            else:
+                self._asm.mov(RAX, RDX)
+
+        self._move(dst, RAX, False)
+
+    def _lower_int_pow(self, stmt: IRBinaryOp) -> None:
+        """
+        Square and multiply from the lowest bit of the exponent. The base is only squared while bits are left,
+        so an overflowing square means an overflowing result
+        """
+        dst = self._operand(stmt.version)
+
+        loop = self._asm.new_label("powloop")
+        skip = self._asm.new_label("powskip")
+        done = self._asm.new_label("powdone")
+
+        self._move(RCX, self._operand(stmt.right), False)
+        self._move(RDX, self._operand(stmt.left), False)
+
+        # Negative exponents produce floats
+        self._asm.test(RCX, RCX)
+        self._asm.jcc(Cond.S, self._bailout)
+
+        self._asm.mov(RAX, 1)
+
+        self._asm.bind(loop)
+        self._asm.test(RCX, RCX)
+        self._asm.jcc(Cond.E, done)
+        self._asm.mov(R11, RCX)
+        self._asm.and_(R11, 1)
+        self._asm.jcc(Cond.E, skip)
+        self._asm.imul(RAX, RDX)
+        self._asm.jcc(Cond.O, self._bailout)
+
+        self._asm.bind(skip)
+        self._asm.shr(RCX, 1)
+        self._asm.jcc(Cond.E, done)
+        self._asm.imul(RDX, RDX)
+        self._asm.jcc(Cond.O, self._bailout)
+        self._asm.jmp(loop)
+
+        self._asm.bind(done)
+        self._narrow(RAX, stmt.type)
+
+        self._move(dst, RAX, False)
+
+    def _lower_float_arith(self, stmt: IRBinaryOp) -> None:
+        dst = self._operand(stmt.version)
+        left = self._operand(stmt.left)
+        right = self._operand(stmt.right)
+
+        if stmt.op == BinaryOpType.Div and not self._nonzero_constant(stmt.right):
+            self._bailout_if_zero(right, True)
+
+        if dst == right and dst != left and stmt.op in _commutative_ops:
+            left, right = right, left
+
+        work = dst if isinstance(dst, XMM) and dst != right else XMM14
+
+        self._move(work, left, True)
+
+        if stmt.op == BinaryOpType.Add:
+            self._asm.addsd(work, right)
+        elif stmt.op == BinaryOpType.Sub:
+            self._asm.subsd(work, right)
+        elif stmt.op == BinaryOpType.Mul:
+            self._asm.mulsd(work, right)
+        elif stmt.op == BinaryOpType.Div:
+            self._asm.divsd(work, right)
+
+        # Single precision results are the double ones rounded, as doubles have more than twice their precision
+        self._narrow(work, stmt.type)
+
+        self._move(dst, work, True)
+
+    def _lower_float_min_max(self, stmt: IRBinaryOp) -> None:
+        """
+        min(a, b) and max(a, b) keep a unless b is smaller or greater, which is minsd and maxsd with b as their
+        destination: they return their source when the comparison fails, NaN included. copysign(a, b) takes
+        the sign bit of b and the other bits of a
+        """
+        dst = self._operand(stmt.version)
+        left = self._operand(stmt.left)
+        right = self._operand(stmt.right)
+
+        if stmt.op == BinaryOpType.CopySign:
+            self._move(XMM15, right, True)
+            self._asm.andpd(XMM15, self._asm.constant_i64(_SIGN_MASK))
+            self._move(XMM14, left, True)
+            self._asm.andpd(XMM14, self._asm.constant_i64(_ABS_MASK))
+            self._asm.orpd(XMM14, XMM15)
+        else:
+            self._move(XMM14, right, True)
+
+            if stmt.op == BinaryOpType.Min:
+                self._asm.minsd(XMM14, left)
+            else:
+                self._asm.maxsd(XMM14, left)
+
+        self._move(dst, XMM14, True)
+
+    def _lower_int_min_max(self, stmt: IRBinaryOp) -> None:
+        dst = self._operand(stmt.version)
+        left = self._operand(stmt.left)
+        right = self._operand(stmt.right)
+
+        self._move(RAX, left, False)
+        self._asm.cmp(RAX, right)
+        self._asm.cmov(Cond.G if stmt.op == BinaryOpType.Min else Cond.L, RAX, right)
+        self._move(dst, RAX, False)
+
+    def _lower_fma(self, stmt: IRFmaOp) -> None:
+        dst = self._operand(stmt.version)
+        left = self._operand(stmt.left)
+        right = self._operand(stmt.right)
+
+        if not isinstance(left, XMM):
+            left, right = right, left
+
+        if not isinstance(left, XMM):
+            self._move(XMM15, left, True)
+            left = XMM15
+
+        self._move(XMM14, self._operand(stmt.addend), True)
+
+        if stmt.negate_product and stmt.negate_addend:
+            self._asm.vfnmsub231sd(XMM14, left, right)
+        elif stmt.negate_product:
+            self._asm.vfnmadd231sd(XMM14, left, right)
+        elif stmt.negate_addend:
+            self._asm.vfmsub231sd(XMM14, left, right)
+        else:
+            self._asm.vfmadd231sd(XMM14, left, right)
+
+        self._narrow(XMM14, stmt.type)
+
+        self._move(dst, XMM14, True)
+
+    def _lower_float_floordiv_mod(self, stmt: IRBinaryOp) -> None:
+        """
+        Follows CPython float_divmod: mod = fmod(a, b) takes the sign of b, and a // b = (a - mod) / b rounded
+        """
+        dst = self._operand(stmt.version)
+        is_mod = stmt.op == BinaryOpType.Mod
+
+        a = self._temp(0)
+        b = self._temp(1)
+        div = self._temp(2)
+
+        if not self._nonzero_constant(stmt.right):
+            self._bailout_if_zero(self._operand(stmt.right), True)
+
+        self._save_caller_saved(stmt)
+
+        self._parallel_move([(a, self._operand(stmt.left), True), (b, self._operand(stmt.right), True)])
+
+        self._asm.movsd(XMM0, a)
+        self._asm.movsd(XMM1, b)
+        self._call("fmod")
+
+        done = self._asm.new_label("fdivdone")
+        nonzero_mod = self._asm.new_label("nonzero")
+        same_sign = self._asm.new_label("samesign")
+
+        if is_mod:
+            self._asm.xorpd(XMM14, XMM14)
+            self._asm.ucomisd(XMM0, XMM14)
+            self._jump_if(CompareOpType.NotEq, True, nonzero_mod)
+
+            # Zero takes the sign of b
+            self._asm.movsd(XMM0, b)
+            self._asm.andpd(XMM0, self._asm.constant_i64(_SIGN_MASK))
+            self._asm.jmp(done)
+
+            self._asm.bind(nonzero_mod)
+            self._asm.movq_from_xmm(RAX, XMM0)
+            self._asm.xor(RAX, b)
+            self._asm.jcc(Cond.NS, done)
+            self._asm.addsd(XMM0, b)
+        else:
+            zero_div = self._asm.new_label("zerodiv")
+
+            self._asm.movsd(XMM1, a)
+            self._asm.subsd(XMM1, XMM0)
+            self._asm.divsd(XMM1, b)
+
+            self._asm.xorpd(XMM14, XMM14)
+            self._asm.ucomisd(XMM0, XMM14)
+            self._jump_if(CompareOpType.Eq, True, same_sign)
+            self._asm.movq_from_xmm(RAX, XMM0)
+            self._asm.xor(RAX, b)
+            self._asm.jcc(Cond.NS, same_sign)
+            self._asm.subsd(XMM1, self._asm.constant_f64(1.0))
+            self._asm.bind(same_sign)
+
+            self._asm.ucomisd(XMM1, XMM14)
+            self._jump_if(CompareOpType.Eq, True, zero_div)
+
+            self._asm.movsd(div, XMM1)
+            self._asm.movsd(XMM0, XMM1)
+            self._call("floor")
+
+            # Rounds to the closest integer when floor went too far because of (a - mod) / b inexactness
+            self._asm.movsd(XMM1, div)
+            self._asm.subsd(XMM1, XMM0)
+            self._asm.ucomisd(XMM1, self._asm.constant_f64(0.5))
+            self._jump_if(CompareOpType.Gt, True, done, negate=True)
+            self._asm.addsd(XMM0, self._asm.constant_f64(1.0))
+            self._asm.jmp(done)
+
+            # Zero takes the sign of a / b
+            self._asm.bind(zero_div)
+            self._asm.movsd(XMM0, a)
+            self._asm.divsd(XMM0, b)
+            self._asm.andpd(XMM0, self._asm.constant_i64(_SIGN_MASK))
+
+        self._asm.bind(done)
+        self._asm.movsd(XMM14, XMM0)
+        self._narrow(XMM14, stmt.type)
+
+        self._restore_caller_saved()
+
+        self._move(dst, XMM14, True)
+
+    def _lower_float_pow(self, stmt: IRBinaryOp) -> None:
+        dst = self._operand(stmt.version)
+
+        self._save_caller_saved(stmt)
+
+        self._parallel_move([(XMM0, self._operand(stmt.left), True), (XMM1, self._operand(stmt.right), True)])
+        self._call("pow")
+
+        # Infinite and NaN results are errors in Python (overflow, complex results, 0 ** -1)
+        self._bailout_unless_finite(XMM0)
+        self._asm.movsd(XMM14, XMM0)
+        self._narrow(XMM14, stmt.type)
+
+        self._restore_caller_saved()
+
+        self._move(dst, XMM14, True)
+
+    def _lower_call(self, stmt: IRFuncOp) -> None:
+        """
+        Direct call to the native code of another jitted function, its bailouts are propagated to the caller
+        """
+        if stmt.symbol is None:
+            raise CodegenError(f"unsupported call: {stmt.func.name}")
+
+        is_float = is_float_type(stmt.func.return_type)
+        dst = self._operand(stmt.version) if stmt.version in self._allocation.locations else None
+
+        gprs = list(ARG_GPRS)
+        xmms = list(ARG_XMMS)
+        moves = list()
+
+        for arg in stmt.args:
+            arg_is_float = self._is_float(arg)
+            pool = xmms if arg_is_float else gprs
+
+            if len(pool) == 0:
+                raise CodegenError("too many arguments, stack arguments are not supported")
+
+            moves.append((pool.pop(0), self._operand(arg), arg_is_float))
+
+        recursive = stmt.symbol == self._function.name
+
+        if recursive:
+            # Bail out before the frames of the recursion outgrow RECURSION_STACK_SIZE
+            frame_size = 8 + 8 * len(self._callee_saved) + self._frame_size
+
+            self._asm.mov_reloc(R11, RECURSION_DEPTH_SYMBOL)
+            self._asm.cmp(Mem(R11), RECURSION_STACK_SIZE // frame_size)
+            self._asm.jcc(Cond.AE, self._bailout)
+            self._asm.add(Mem(R11), 1)
+
+        self._save_caller_saved(stmt)
+
+        self._parallel_move(moves)
+
+        if recursive:
+            self._asm.call(self._entry)
+
+            self._asm.mov_reloc(R11, RECURSION_DEPTH_SYMBOL)
+            self._asm.sub(Mem(R11), 1)
+        else:
+            self._asm.call_symbol(stmt.symbol)
+
+        self._asm.mov_reloc(R11, BAILOUT_SYMBOL)
+        self._asm.cmp(Mem(R11), 0)
+        self._asm.jcc(Cond.NE, self._bailout)
+
+        if is_float:
+            self._asm.movsd(XMM14, XMM0)
+
+        self._restore_caller_saved()
+
+        if dst is not None and stmt.func.return_type != TypeVoid:
+            self._move(dst, XMM14 if is_float else RAX, is_float)
+
+    def _lower_compare(self, stmt: IRCompareOp, op: CompareOpType) -> None:
+        left = self._operand(stmt.left)
+        right = self._operand(stmt.right)
+
+        if is_float_type(stmt.type):
+            if op in (CompareOpType.Lt, CompareOpType.LtEq):
+                left, right = right, left
+
+            if not isinstance(left, XMM):
+                self._asm.movsd(XMM14, left)
+                left = XMM14
+
+            self._asm.ucomisd(left, right)
+        else:
+            if isinstance(left, Mem) and isinstance(right, Mem):
+                self._asm.mov(RAX, left)
+                left = RAX
+
+            self._asm.cmp(left, right)
+
+    def _selects_with_mask(self, stmt: IRCMovOp) -> bool:
+        # Packed logic ops need aligned memory operands, spilled values keep a branch
+        return is_float_type(stmt.type) and \
+               isinstance(self._operand(stmt.true_val), XMM) and isinstance(self._operand(stmt.false_val), XMM)
+
+    def _lower_cmov(self, stmt: IRCMovOp, compare: IRCompareOp) -> None:
+        dst = self._operand(stmt.version)
+        true_val = self._operand(stmt.true_val)
+        false_val = self._operand(stmt.false_val)
+
+        is_float_compare = is_float_type(compare.type)
+
+        if self._selects_with_mask(stmt):
+            self._lower_float_select(stmt, compare)
+        elif is_float_type(stmt.type):
+            work = dst if isinstance(dst, XMM) and dst != true_val else XMM14
+            skip = self._asm.new_label("cmov")
+
+            # Moves do not modify the flags
+            self._move(work, false_val, True)
+            self._jump_if(stmt.op, is_float_compare, skip, negate=True)
+            self._move(work, true_val, True)
+            self._asm.bind(skip)
+            self._move(dst, work, True)
+        else:
+            work = dst if isinstance(dst, GPR) and dst != true_val and dst != false_val else RAX
+
+            self._move(work, false_val, False)
+
+            if not is_float_compare:
+                self._asm.cmov(_int_conditions[stmt.op], work, true_val)
+            elif stmt.op == CompareOpType.Eq:
+                self._asm.cmov(Cond.E, work, true_val)
+                self._asm.cmov(Cond.P, work, false_val)
+            elif stmt.op == CompareOpType.NotEq:
+                self._asm.cmov(Cond.NE, work, true_val)
+                self._asm.cmov(Cond.P, work, true_val)
+            else:
+                # Lt and LtEq operands are swapped when emitting the compare, unordered sets the carry
+                self._asm.cmov(Cond.A if stmt.op in (CompareOpType.Lt, CompareOpType.Gt) else Cond.AE, work, true_val)
+
+            self._move(dst, work, False)
+
+    def _lower_float_select(self, stmt: IRCMovOp, compare: IRCompareOp) -> None:
+        """
+        Selects between floats with a mask of ones or zeros: (mask & true) | (~mask & false). The mask of a
+        float compare comes from its operands with cmpsd, the one of an integer compare from its flags
+        """
+        if is_float_type(compare.type):
+            predicate, swap = _float_predicates[stmt.op]
+            left = self._operand(compare.left)
+            right = self._operand(compare.right)
+
+            if swap:
+                left, right = right, left
+
+            self._asm.movsd(XMM14, left)
+            self._asm.cmpsd(XMM14, right, predicate)
+        else:
+            self._asm.setcc(_int_conditions[stmt.op], RAX)
+            self._asm.movzx8(RAX, RAX)
+            self._asm.neg(RAX)
+            self._asm.movq_to_xmm(XMM14, RAX)
+
+        self._asm.movapd(XMM15, self._operand(stmt.true_val))
+        self._asm.andpd(XMM15, XMM14)
+        self._asm.andnpd(XMM14, self._operand(stmt.false_val))
+        self._asm.orpd(XMM14, XMM15)
+        self._move(self._operand(stmt.version), XMM14, True)
+
+    def _lower_mem_load(self, stmt: IrMemLoadOp) -> None:
+        dst = self._operand(stmt.version)
+        base = self._operand(stmt.base_ptr)
+
+        if isinstance(base, Mem):
+            self._asm.mov(RDX, base)
+            base = RDX
+
+        self._move(RAX, self._operand(stmt.offset), False)
+
+        if stmt.length is not None:
+            length = self._operand(stmt.length)
+            in_bounds = self._asm.new_label("inbounds")
+
+            # 0 <= index < length, otherwise wrap negative indices once
+            self._asm.cmp(RAX, length)
+            self._asm.jcc(Cond.B, in_bounds)
+            self._asm.add(RAX, length)
+            self._asm.cmp(RAX, length)
+            self._asm.jcc(Cond.AE, self._bailout)
+            self._asm.bind(in_bounds)
+
+        size = element_size(stmt.type)
+        address = Mem(base, RAX, size)
+
+        if is_float_type(stmt.type):
+            work = dst if isinstance(dst, XMM) else XMM14
+
+            if stmt.type == TypeFloat32:
+                self._asm.cvtss2sd(work, address)
+            else:
+                self._asm.movsd(work, address)
+                self._narrow(work, self._type(stmt.version))
+
+            self._move(dst, work, True)
+        else:
+            work = dst if isinstance(dst, GPR) else RAX
+
+            self._asm.load(work, address, size, signed=not is_unsigned_type(stmt.type))
+            self._move(dst, work, False)
+
+    def _lower_bounds_check(self, stmt: IRBoundsCheck) -> None:
+        skip = self._asm.new_label("checked")
+
+        self._move(RAX, self._operand(stmt.index), False)
+        self._asm.cmp(RAX, self._operand(stmt.stop))
+        self._asm.jcc(Cond.GE, skip)
+        self._asm.test(RAX, RAX)
+        self._asm.jcc(Cond.S, self._bailout)
+        self._move(RAX, self._operand(stmt.stop), False)
+
+        for length in stmt.lengths:
+            self._asm.cmp(RAX, self._operand(length))
+            self._asm.jcc(Cond.G, self._bailout)
+
+        self._asm.bind(skip)
+
+    def _lower_overflow_check(self, stmt: IROverflowCheck) -> None:
+        checked = self._asm.new_label("finite")
+
+        self._asm.movsd(XMM14, self._operand(stmt.value))
+        self._asm.andpd(XMM14, self._asm.constant_i64(_ABS_MASK))
+        self._asm.ucomisd(XMM14, self._asm.constant_f64(math.inf))
+        self._jump_if(CompareOpType.Eq, True, checked, negate=True)
+
+        self._asm.movsd(XMM14, self._operand(stmt.base))
+        self._asm.andpd(XMM14, self._asm.constant_i64(_ABS_MASK))
+        self._asm.ucomisd(XMM14, self._asm.constant_f64(math.inf))
+        self._jump_if(CompareOpType.Eq, True, self._bailout, negate=True)
+
+        self._asm.bind(checked)
+
+    def _lower_inc_dec(self, stmt: Union[IRIncOp, IRDecOp]) -> None:
+        # Induction variables of range loops cannot overflow as they stay below the loop bound
+        dst = self._operand(stmt.version)
+
+        self._move(dst, self._operand(stmt.operand), False)
+
+        if isinstance(stmt, IRIncOp):
+            self._asm.add(dst, 1)
+        else:
+            self._asm.sub(dst, 1)
+
+    # Vector loops
+
+    def _lower_vector_loop(self, stmt: IRVectorLoop) -> None:
+        """
+        Runs groups of 2 lanes per register (4 for 32 bits values), unrolled as long as registers are left, while a
+        whole group fits below stop. Lanes are only loaded when 0 <= index and stop <= len for every array still
+        checked, otherwise the scalar loop runs all the iterations with its bounds checks. Integer accumulators are
+        summed at the end and overflows are left to the interpreter, float ones are accumulated lane after lane
+        unless the loop reassociates them. Fused products are then accumulated with FMA when available
+
+        With AVX2, loops only accumulating in lanes run on ymm registers, twice as many lanes at a time. Loops
+        accumulating floats in order would not run faster, their additions depending on each other
+        """
+        asm = self._asm
+        wide = "avx2" in self._features and all(stmt.accumulates_in_lanes(reduction) for reduction in stmt.reductions)
+        self._uses_ymm |= wide
+
+        # Lanes per xmm register, or per half of a ymm one
+        half_width = stmt.width()
+        width = half_width * 2 if wide else half_width
+        size = 32 if wide else 16
+
+        loop = asm.new_label("vloop")
+        done = asm.new_label("vdone")
+
+        self._save_caller_saved(stmt)
+
+        inputs = set(self._operand(version) for version in stmt.uses())
+        pool = [reg for reg in ALLOCATABLE_XMMS if reg not in inputs]
+
+        unroll = next((unroll for unroll in (4, 2, 1) if stmt.num_vector_registers(unroll) <= len(pool)), None)
+
+        if unroll is None:
+            raise CodegenError("not enough registers for the vector loop")
+
+        group = unroll * width
+
+        self._move(RAX, self._operand(stmt.index), False)
+        self._move(RCX, self._operand(stmt.stop), False)
+
+        arrays = dict()
+
+        for element in stmt.body:
+            if isinstance(element, IrMemLoadOp):
+                arrays.setdefault(element.base_ptr, element.length)
+
+        lengths = set(length for length in arrays.values() if length is not None)
+
+        asm.test(RAX, RAX)
+        asm.jcc(Cond.S, done)
+
+        for length in lengths:
+            asm.cmp(RCX, self._operand(length))
+            asm.jcc(Cond.G, done)
+
+        asm.sub(RCX, group - 1)
+        asm.cmp(RAX, RCX)
+        asm.jcc(Cond.GE, done)
+
+        bases = dict()
+        base_regs = [RDX, R11]
+
+        for base in arrays:
+            operand = self._operand(base)
+
+            if isinstance(operand, Mem):
+                reg = base_regs.pop(0)
+                asm.mov(reg, operand)
+                operand = reg
+
+            bases[base] = operand
+
+        overflow = None
+        temp = None
+
+        if stmt.checks_overflow():
+            overflow = pool.pop(0)
+            temp = pool.pop(0)
+
+            if wide:
+                asm.vpxor(overflow, overflow, overflow, wide)
+            else:
+                asm.pxor(overflow, overflow)
+
+        # Shared by the math kernels of the body, along with xmm14 and xmm15
+        kernel = [pool.pop(0) for _ in range(max(stmt.kernel_registers(), default=0))]
+
+        accumulators: Dict[int, List[XMM]] = dict()
+
+        for reduction in stmt.reductions:
+            if not stmt.accumulates_in_lanes(reduction):
+                accumulators[reduction.version] = [pool.pop(0)]
+
+                # Single precision values are accumulated in single precision, rounding as the scalar loop does
+                if reduction.type == TypeFloat32:
+                    asm.cvtsd2ss(accumulators[reduction.version][0], self._operand(reduction.version))
+                else:
+                    asm.movsd(accumulators[reduction.version][0], self._operand(reduction.version))
+                continue
+
+            accumulators[reduction.version] = [pool.pop(0) for _ in range(unroll)]
+
+            for reg in accumulators[reduction.version]:
+                if reduction.op in _lane_starts:
+                    start = _lane_starts[reduction.op]
+                    start = asm.constant_f32(start, size) if reduction.type == TypeFloat32 else asm.constant_f64(start, size)
+
+                    if wide:
+                        asm.vmovupd(reg, start, wide)
+                    else:
+                        asm.movapd(reg, start)
+                elif wide:
+                    if reduction.op == BinaryOpType.BitAnd:
+                        asm.vpcmpeqd(reg, reg, reg, wide)
+                    else:
+                        asm.vpxor(reg, reg, reg, wide)
+                elif reduction.op == BinaryOpType.BitAnd:
+                    asm.pcmpeqd(reg, reg)
+                else:
+                    asm.pxor(reg, reg)
+
+        fused = stmt.fused_products() if "fma" in self._features else dict()
+        fused_versions = set(product.version for product in fused.values())
+
+        lanes: Dict[int, Union[XMM, RipRel]] = dict()
+
+        for element in stmt.body:
+            if isinstance(element, IRLiteral):
+                if element.type == TypeFloat32:
+                    lanes[element.version] = asm.constant_f32(float(element.value), size)
+                elif element.type == TypeInt32:
+                    lanes[element.version] = asm.constant_i32(int(element.value), size)
+                elif is_float_type(element.type):
+                    lanes[element.version] = asm.constant_f64(float(element.value), size)
+                else:
+                    lanes[element.version] = asm.constant_i64(int(element.value), size)
+            elif element.version not in lanes:
+                lanes[element.version] = pool.pop(0)
+
+        for version in stmt.invariants():
+            reg = pool.pop(0)
+            operand = self._operand(version)
+
+            if self._type(version) == TypeFloat32:
+                asm.cvtsd2ss(reg, operand)
+
+                if wide:
+                    asm.vbroadcastss(reg, reg)
+                else:
+                    asm.shufps(reg, reg, 0)
+            else:
+                if isinstance(operand, GPR):
+                    asm.movq_to_xmm(reg, operand)
+                else:
+                    asm.movsd(reg, operand)
+
+                # The low 32 bits of Int32 values hold them
+                if wide and is_float_type(self._type(version)):
+                    asm.vbroadcastsd(reg, reg)
+                elif wide:
+                    broadcast = asm.vpbroadcastd if half_width == 4 else asm.vpbroadcastq
+                    broadcast(reg, reg)
+                elif half_width == 4:
+                    asm.pshufd(reg, reg, 0)
+                else:
+                    asm.unpcklpd(reg, reg)
+
+            lanes[version] = reg
+
+        asm.bind(loop)
+
+        for u in range(unroll):
+            for element in stmt.body:
+                if element.version not in fused_versions:
+                    self._lower_lane_statement(element, lanes, bases, u * width, overflow, temp, kernel, wide)
+
+            for reduction in stmt.reductions:
+                value = lanes[reduction.right]
+
+                if not stmt.accumulates_in_lanes(reduction):
+                    self._accumulate_lanes(reduction.op, reduction.type, accumulators[reduction.version][0], value)
+                elif reduction.version in fused:
+                    self._accumulate_product(reduction, fused[reduction.version], lanes, accumulators[reduction.version][u], wide)
+                else:
+                    accumulator = accumulators[reduction.version][u]
+                    self._lower_lane_arith(reduction.op, reduction.type, accumulator, accumulator, value, overflow, temp, wide)
+
+        asm.add(RAX, group)
+        asm.cmp(RAX, RCX)
+        asm.jcc(Cond.L, loop)
+
+        if overflow is not None:
+            if wide:
+                mask = asm.vmovmskps if half_width == 4 else asm.vmovmskpd
+                mask(RDX, overflow, wide)
+            elif half_width == 4:
+                asm.movmskps(RDX, overflow)
+            else:
+                asm.movmskpd(RDX, overflow)
+
+            asm.test(RDX, RDX)
+            asm.jcc(Cond.NE, self._bailout)
+
+        for reduction in stmt.reductions:
+            dst = self._operand(reduction.version)
+
+            if is_float_type(reduction.type) and stmt.accumulates_in_lanes(reduction):
+                self._combine_float_lanes(reduction, accumulators[reduction.version], dst, wide)
+                continue
+
+            if is_float_type(reduction.type):
+                if reduction.type == TypeFloat32:
+                    asm.cvtss2sd(accumulators[reduction.version][0], accumulators[reduction.version][0])
+
+                self._move(dst, accumulators[reduction.version][0], True)
+                continue
+
+            # Subtractions accumulated the negated values
+            combine = BinaryOpType.Add if reduction.op == BinaryOpType.Sub else reduction.op
+
+            self._move(RDX, dst, False)
+
+            for reg in accumulators[reduction.version]:
+                halves = [reg]
+
+                if wide:
+                    asm.vextractf128(XMM14, reg, 1)
+                    halves.append(XMM14)
+
+                for half, lane in ((half, lane) for half in halves for lane in range(half_width)):
+                    if lane == 0:
+                        asm.movq_from_xmm(R11, half)
+                    else:
+                        asm.pshufd(XMM15, half, lane if half_width == 4 else 0xEE)
+                        asm.movq_from_xmm(R11, XMM15)
+
+                    if half_width == 4:
+                        asm.movsxd(R11, R11)
+
+                    if combine == BinaryOpType.Add:
+                        asm.add(RDX, R11)
+                        asm.jcc(Cond.O, self._bailout)
+                    elif combine == BinaryOpType.BitAnd:
+                        asm.and_(RDX, R11)
+                    elif combine == BinaryOpType.BitOr:
+                        asm.or_(RDX, R11)
+                    else:
+                        asm.xor(RDX, R11)
+
+            self._narrow(RDX, reduction.type)
+            self._move(dst, RDX, False)
+
+        if wide:
+            asm.vzeroupper()
+
+        self._move(self._operand(stmt.index), RAX, False)
+
+        asm.bind(done)
+
+        self._restore_caller_saved()
+
+    def _lower_lane_statement(self,
+                              stmt: IRStatement,
+                              lanes: Dict[int, Union[XMM, RipRel]],
+                              bases: Dict[int, GPR],
+                              lane_offset: int,
+                              overflow: Optional[XMM],
+                              temp: Optional[XMM],
+                              kernel: List[XMM],
+                              wide: bool) -> None:
+        if isinstance(stmt, IRLiteral):
+            return
+
+        dst = lanes[stmt.version]
+
+        if isinstance(stmt, IrMemLoadOp):
+            size = element_size(stmt.type)
+            address = Mem(bases[stmt.base_ptr], RAX, size, lane_offset * size)
+
+            if wide:
+                if stmt.type == TypeFloat32 and self._type(stmt.version) == TypeFloat32:
+                    self._asm.vmovups(dst, address, wide)
+                elif stmt.type == TypeFloat32:
+                    self._asm.vcvtps2pd(dst, address)
+                elif is_float_type(stmt.type):
+                    self._asm.vmovupd(dst, address, wide)
+                else:
+                    self._asm.vmovdqu(dst, address, wide)
+            elif stmt.type == TypeFloat32 and self._type(stmt.version) == TypeFloat32:
+                self._asm.movups(dst, address)
+            elif stmt.type == TypeFloat32:
+                self._asm.cvtps2pd(dst, address)
+            elif is_float_type(stmt.type):
+                self._asm.movupd(dst, address)
+            else:
+                self._asm.movdqu(dst, address)
+        elif isinstance(stmt, IRMoveOp):
+            if wide:
+                self._asm.vmovupd(dst, lanes[stmt.operand], wide)
+            else:
+                self._asm.movapd(dst, lanes[stmt.operand])
+        elif isinstance(stmt, IRUnaryOp):
+            self._lower_lane_unary(stmt, dst, lanes[stmt.operand], overflow, temp, kernel, wide)
+        elif isinstance(stmt, IRBinaryOp):
+            self._lower_lane_arith(stmt.op,
+                                   stmt.type,
+                                   dst,
+                                   lanes[stmt.left],
+                                   lanes[stmt.right],
+                                   overflow,
+                                   temp,
+                                   wide)
+        else:
+            raise CodegenError(f"unsupported statement in vector loop: {type(stmt).__name__}")
+
+    def _lane_mask(self, sign: bool, single: bool, wide: bool) -> RipRel:
+        """
+        Constant with the sign bit of each lane set, or all the others when sign is False
+        """
+        size = 32 if wide else 16
+
+        if single:
+            return self._asm.constant_i32(-0x80000000 if sign else 0x7FFFFFFF, size)
+
+        return self._asm.constant_i64(_SIGN_MASK if sign else _ABS_MASK, size)
+
+    def _lower_lane_unary(self,
+                          stmt: IRUnaryOp,
+                          dst: XMM,
+                          operand: Union[XMM, RipRel],
+                          overflow: XMM,
+                          temp: XMM,
+                          kernel: List[XMM],
+                          wide: bool) -> None:
+        """
+        Absolute values clear the sign bits, square roots flag the lanes of negative values in overflow
+        """
+        asm = self._asm
+        single = stmt.type == TypeFloat32
+
+        if stmt.op in TRANSCENDENTAL_OPS:
+            self._lower_lane_kernel(stmt, dst, operand, overflow, [XMM14, XMM15] + kernel, wide)
+            return
+
+        if wide and not isinstance(operand, XMM):
+            asm.vmovupd(XMM15, operand, wide)
+            operand = XMM15
+
+        if stmt.op == UnaryOpType.Abs:
+            if wide:
+                asm.vpand(dst, operand, self._lane_mask(False, single, wide), wide)
+            else:
+                asm.movapd(dst, operand)
+                asm.andpd(dst, self._lane_mask(False, single, wide))
+            return
+
+        size = 32 if wide else 16
+        zero = asm.constant_f32(0.0, size) if single else asm.constant_f64(0.0, size)
+
+        if wide:
+            compare = asm.vcmpps if single else asm.vcmppd
+            compare(temp, operand, zero, 1, wide)
+            asm.vpor(overflow, overflow, temp, wide)
+
+            root = asm.vsqrtps if single else asm.vsqrtpd
+            root(dst, operand, wide)
+        else:
+            asm.movapd(temp, operand)
+
+            compare = asm.cmpps if single else asm.cmppd
+            compare(temp, zero, 1)
+            asm.por(overflow, temp)
+
+            root = asm.sqrtps if single else asm.sqrtpd
+            root(dst, operand)
+
+    def _lower_lane_kernel(self,
+                           stmt: IRUnaryOp,
+                           dst: XMM,
+                           operand: Union[XMM, RipRel],
+                           overflow: XMM,
+                           registers: List[XMM],
+                           wide: bool) -> None:
+        """
+        Runs the math kernel of stmt on the lanes of operand. Single precision lanes are widened to doubles and
+        computed in two halves, the register following the ones of the kernel keeping the high half
+        """
+        asm = self._asm
+        x = registers[0]
+
+        if stmt.type != TypeFloat32:
+            if wide:
+                asm.vmovupd(x, operand, wide)
+                emit_kernel(asm, stmt.op, registers, overflow, wide)
+                asm.vmovapd(dst, x, wide)
+            else:
+                asm.movapd(x, operand)
+                emit_kernel(asm, stmt.op, registers, overflow)
+                asm.movapd(dst, x)
+            return
+
+        high = registers[KERNEL_REGISTERS[stmt.op]]
+
+        if wide:
+            asm.vmovups(high, operand, wide)
+            asm.vcvtps2pd(x, high)
+            emit_kernel(asm, stmt.op, registers, overflow, wide)
+            asm.vcvtpd2ps(dst, x)
+
+            asm.vextractf128(high, high, 1)
+            asm.vcvtps2pd(x, high)
+            emit_kernel(asm, stmt.op, registers, overflow, wide)
+            asm.vcvtpd2ps(x, x)
+            asm.vinsertf128(dst, dst, x, 1)
+        else:
+            asm.movapd(high, operand)
+            asm.cvtps2pd(x, high)
+            emit_kernel(asm, stmt.op, registers, overflow)
+            asm.cvtpd2ps(dst, x)
+
+            asm.movhlps(high, high)
+            asm.cvtps2pd(x, high)
+            emit_kernel(asm, stmt.op, registers, overflow)
+            asm.cvtpd2ps(x, x)
+            asm.movlhps(dst, x)
+
+    def _lower_lane_arith(self,
+                          op: BinaryOpType,
+                          type: Type,
+                          dst: XMM,
+                          left: Union[XMM, RipRel],
+                          right: Union[XMM, RipRel],
+                          overflow: Optional[XMM],
+                          temp: Optional[XMM],
+                          wide: bool = False) -> None:
+        asm = self._asm
+        single = type in (TypeFloat32, TypeInt32)
+
+        if wide:
+            self._lower_wide_lane_arith(op, type, dst, left, right, overflow, temp)
+            return
+
+        if is_float_type(type):
+            # As minsd and maxsd, the packed forms keep the lanes of their destination only when they are smaller
+            # or greater
+            if op in (BinaryOpType.Min, BinaryOpType.Max):
+                left, right = right, left
+
+            work = dst if dst != right else XMM15
+
+            asm.movapd(work, left)
+
+            if op == BinaryOpType.CopySign:
+                asm.andpd(work, self._lane_mask(False, single, False))
+                asm.movapd(XMM14, right)
+                asm.andpd(XMM14, self._lane_mask(True, single, False))
+                asm.orpd(work, XMM14)
+                asm.movapd(dst, work)
+                return
+
+            if op == BinaryOpType.Add:
+                packed = asm.addps if single else asm.addpd
+            elif op == BinaryOpType.Sub:
+                packed = asm.subps if single else asm.subpd
+            elif op == BinaryOpType.Min:
+                packed = asm.minps if single else asm.minpd
+            elif op == BinaryOpType.Max:
+                packed = asm.maxps if single else asm.maxpd
+            else:
+                packed = asm.mulps if single else asm.mulpd
+
+            packed(work, right)
+
+            asm.movapd(dst, work)
+            return
+
+        if op not in (BinaryOpType.Add, BinaryOpType.Sub):
+            asm.movapd(XMM15, left)
+
+            if op == BinaryOpType.BitAnd:
+                asm.pand(XMM15, right)
+            elif op == BinaryOpType.BitOr:
+                asm.por(XMM15, right)
+            else:
+                asm.pxor(XMM15, right)
+
+            asm.movapd(dst, XMM15)
+            return
+
+        # Both operands are kept to find the lanes that overflowed: the sign of the result differs from the
+        # sign of both operands for r = a + b, from the sign of a but not from the one of b for r = a - b
+        asm.movapd(XMM15, left)
+
+        if op == BinaryOpType.Add:
+            packed = asm.paddd if single else asm.paddq
+        else:
+            packed = asm.psubd if single else asm.psubq
+
+        packed(XMM15, right)
+
+        asm.movapd(XMM14, XMM15)
+        asm.pxor(XMM14, left)
+        asm.movapd(temp, XMM15)
+        asm.pxor(temp, right)
+
+        if op == BinaryOpType.Add:
+            asm.pand(temp, XMM14)
+        else:
+            asm.pandn(temp, XMM14)
+
+        asm.por(overflow, temp)
+        asm.movapd(dst, XMM15)
+
+    def _lower_wide_lane_arith(self,
+                               op: BinaryOpType,
+                               type: Type,
+                               dst: XMM,
+                               left: Union[XMM, RipRel],
+                               right: Union[XMM, RipRel],
+                               overflow: Optional[XMM],
+                               temp: Optional[XMM]) -> None:
+        """
+        Same operations as _lower_lane_arith on ymm registers, with the 3 operands AVX forms
+        """
+        asm = self._asm
+        single = type in (TypeFloat32, TypeInt32)
+        checked = not is_float_type(type) and op in (BinaryOpType.Add, BinaryOpType.Sub)
+
+        if op in (BinaryOpType.Min, BinaryOpType.Max):
+            left, right = right, left
+
+        # Only the second source can be in memory
+        if not isinstance(left, XMM) and op in _commutative_ops and not checked:
+            left, right = right, left
+
+        if not isinstance(left, XMM):
+            asm.vmovupd(XMM14 if checked else XMM15, left, True)
+            left = XMM14 if checked else XMM15
+
+        if is_float_type(type):
+            if op == BinaryOpType.CopySign:
+                if not isinstance(right, XMM):
+                    asm.vmovupd(XMM14, right, True)
+                    right = XMM14
+
+                asm.vpand(XMM14, right, self._lane_mask(True, single, True), True)
+                asm.vpand(dst, left, self._lane_mask(False, single, True), True)
+                asm.vpor(dst, dst, XMM14, True)
+                return
+
+            if op == BinaryOpType.Add:
+                packed = asm.vaddps if single else asm.vaddpd
+            elif op == BinaryOpType.Sub:
+                packed = asm.vsubps if single else asm.vsubpd
+            elif op == BinaryOpType.Min:
+                packed = asm.vminps if single else asm.vminpd
+            elif op == BinaryOpType.Max:
+                packed = asm.vmaxps if single else asm.vmaxpd
+            else:
+                packed = asm.vmulps if single else asm.vmulpd
+
+            packed(dst, left, right, True)
+            return
+
+        if not checked:
+            if op == BinaryOpType.BitAnd:
+                asm.vpand(dst, left, right, True)
+            elif op == BinaryOpType.BitOr:
+                asm.vpor(dst, left, right, True)
+            else:
+                asm.vpxor(dst, left, right, True)
+            return
+
+        if op == BinaryOpType.Add:
+            packed = asm.vpaddd if single else asm.vpaddq
+        else:
+            packed = asm.vpsubd if single else asm.vpsubq
+
+        packed(XMM15, left, right, True)
+
+        asm.vpxor(XMM14, XMM15, left, True)
+        asm.vpxor(temp, XMM15, right, True)
+
+        if op == BinaryOpType.Add:
+            asm.vpand(temp, temp, XMM14, True)
+        else:
+            asm.vpandn(temp, temp, XMM14, True)
+
+        asm.vpor(overflow, overflow, temp, True)
+        asm.vmovapd(dst, XMM15, True)
+
+    def _accumulate_product(self,
+                            reduction: IRBinaryOp,
+                            product: IRBinaryOp,
+                            lanes: Dict[int, Union[XMM, RipRel]],
+                            accumulator: XMM,
+                            wide: bool) -> None:
+        """
+        Adds or subtracts the lanes of product to the ones of accumulator, rounding once
+        """
+        left = lanes[product.left]
+        right = lanes[product.right]
+
+        if not isinstance(left, XMM):
+            left, right = right, left
+
+        if not isinstance(left, XMM):
+            self._asm.vmovupd(XMM15, left, wide)
+            left = XMM15
+
+        if reduction.op == BinaryOpType.Add:
+            fused = self._asm.vfmadd231ps if reduction.type == TypeFloat32 else self._asm.vfmadd231pd
+        else:
+            fused = self._asm.vfnmadd231ps if reduction.type == TypeFloat32 else self._asm.vfnmadd231pd
+
+        fused(accumulator, left, right, wide)
+
+    def _combine_float_lanes(self,
+                             reduction: IRBinaryOp,
+                             accumulators: List[XMM],
+                             dst: Union[XMM, Mem],
+                             wide: bool) -> None:
+        """
+        Folds the lanes of the accumulators of a reassociated float reduction into its scalar accumulator.
+        Subtractions accumulated the negated values
+        """
+        asm = self._asm
+        single = reduction.type == TypeFloat32
+        combine = BinaryOpType.Add if reduction.op == BinaryOpType.Sub else reduction.op
+        total = accumulators[0]
+
+        for reg in accumulators[1:]:
+            self._lower_lane_arith(combine, reduction.type, total, total, reg, None, None, wide)
+
+        if wide:
+            asm.vextractf128(XMM14, total, 1)
+            self._lower_lane_arith(combine, reduction.type, total, total, XMM14, None, None)
+
+        if single:
+            # Adds the high half onto the low one, then the second lane onto the first
+            asm.movapd(XMM14, total)
+            asm.shufps(XMM14, XMM14, 0x4E)
+            self._lower_lane_arith(combine, reduction.type, total, total, XMM14, None, None)
+
+            asm.movapd(XMM14, total)
+            asm.shufps(XMM14, XMM14, 0xB1)
+            scalar = self._scalar_float_op(combine, True)
+
+            scalar(total, XMM14)
+
+            asm.cvtsd2ss(XMM14, dst)
+            scalar(XMM14, total)
+            asm.cvtss2sd(XMM14, XMM14)
+        else:
+            asm.movapd(XMM14, total)
+            asm.unpckhpd(XMM14, XMM14)
+            scalar = self._scalar_float_op(combine, False)
+
+            scalar(total, XMM14)
+
+            self._move(XMM14, dst, True)
+            scalar(XMM14, total)
+
+        self._move(dst, XMM14, True)
+
+    def _accumulate_lanes(self, op: BinaryOpType, type: Type, accumulator: XMM, value: Union[XMM, RipRel]) -> None:
+        """
+        Folds the lanes of value into the low lane of accumulator in order, rounding as the scalar loop does
+        """
+        asm = self._asm
+        single = type == TypeFloat32
+        scalar = self._scalar_float_op(op, single)
+
+        asm.movapd(XMM14, value)
+
+        for lane in range(4 if single else 2):
+            # Rotates the next lane down
+            if lane > 0 and single:
+                asm.shufps(XMM14, XMM14, 0x39)
+            elif lane > 0:
+                asm.unpckhpd(XMM14, XMM14)
+
+            # max(acc, x) keeps acc unless x is greater, x is the destination of maxsd
+            if op in (BinaryOpType.Min, BinaryOpType.Max):
+                asm.movapd(XMM15, XMM14)
+                scalar(XMM15, accumulator)
+                asm.movapd(accumulator, XMM15)
+            else:
+                scalar(accumulator, XMM14)
+
+    def _scalar_float_op(self, op: BinaryOpType, single: bool) -> Callable[[XMM, Operand], None]:
+        """
+        Scalar instruction of the reduction op, on single or double precision values
+        """
+        asm = self._asm
+
+        ops = {
+            BinaryOpType.Add: (asm.addss, asm.addsd),
+            BinaryOpType.Sub: (asm.subss, asm.subsd),
+            BinaryOpType.Mul: (asm.mulss, asm.mulsd),
+            BinaryOpType.Min: (asm.minss, asm.minsd),
+            BinaryOpType.Max: (asm.maxss, asm.maxsd),
+        }
+
+        return ops[op][0 if single else 1]
+
+    def _lower_return(self, terminator: IRReturn) -> None:
+        if terminator.value is not None:
+            if self._is_float(terminator.value):
+                self._move(XMM0, self._operand(terminator.value), True)
+            else:
+                self._move(RAX, self._operand(terminator.value), False)
+
+        self._emit_epilogue()
+
+    def _lower_block(self, index: int, block: IRBlock) -> None:
+        self._asm.bind(self._block_labels[block.name])
+
+        compare = None
+
+        for i, stmt in enumerate(block.statements):
+            if isinstance(stmt, IRVariable):
+                continue
+            elif isinstance(stmt, IRLiteral):
+                self._lower_literal(stmt)
+            elif isinstance(stmt, IRMoveOp):
+                self._lower_move(stmt)
+            elif isinstance(stmt, IRCastOp):
+                self._lower_cast(stmt)
+            elif isinstance(stmt, IRUnaryOp):
+                self._lower_unary(stmt)
+            elif isinstance(stmt, IRBinaryOp):
+                self._lower_binary(stmt)
+            elif isinstance(stmt, IRFmaOp):
+                self._lower_fma(stmt)
+            elif isinstance(stmt, IRCompareOp):
+                compare = stmt
+
+                # The consumer of the compare decides of the operands order for floats
+                if i + 1 < len(block.statements) and isinstance(block.statements[i + 1], IRCMovOp):
+                    consumer = block.statements[i + 1]
+
+                    # Float selections read the operands of float compares instead of the flags
+                    if is_float_type(stmt.type) and self._selects_with_mask(consumer):
+                        continue
+
+                    op = consumer.op
+                elif i + 1 == len(block.statements) and isinstance(block.terminator, IRJump):
+                    op = block.terminator.comp
+                else:
+                    raise CodegenError("compare is not followed by its consumer")
+
+                self._lower_compare(stmt, op)
+            elif isinstance(stmt, IRCMovOp):
+                self._lower_cmov(stmt, compare)
+            elif isinstance(stmt, IrMemLoadOp):
+                self._lower_mem_load(stmt)
+            elif isinstance(stmt, IRBoundsCheck):
+                self._lower_bounds_check(stmt)
+            elif isinstance(stmt, IROverflowCheck):
+                self._lower_overflow_check(stmt)
+            elif isinstance(stmt, (IRIncOp, IRDecOp)):
+                self._lower_inc_dec(stmt)
+            elif isinstance(stmt, IRVectorLoop):
+                self._lower_vector_loop(stmt)
+            elif isinstance(stmt, IRFuncOp):
+                self._lower_call(stmt)
+            else:
+                raise CodegenError(f"unsupported statement: {type(stmt).__name__}")
+
+        terminator = block.terminator
+        next_block = self._function.blocks[index + 1] if index + 1 < len(self._function.blocks) else None
+
+        if isinstance(terminator, IRReturn):
+            self._lower_return(terminator)
+        elif isinstance(terminator, IRJump):
+            target = self._block_labels[terminator.block.name]
+
+            if terminator.comp is None:
+                if terminator.block is not next_block:
+                    self._asm.jmp(target)
+            else:
+                self._jump_if(terminator.comp, is_float_type(compare.type), target)
+        elif next_block is None:
+            # Falling off the end of the function returns None
+            if self._function.return_type == TypeVoid:
+                self._emit_epilogue()
+            else:
+                self._asm.jmp(self._bailout)
+
+    def generate(self) -> MachineCode:
+        self._asm.bind(self._entry)
+        self._emit_prologue()
+
+        for index, block in enumerate(self._function.blocks):
+            self._lower_block(index, block)
+
+        if self._asm.is_referenced(self._bailout):
+            self._emit_bailout()
+
+        code, relocations = self._asm.finalize()
+
+        return MachineCode(self._function.name, code, relocations, self._asm.listing())
+
+def generate_function(ir: IR, function: IRFunction, features: Tuple[str, ...] = TARGET_FEATURES) -> Optional[MachineCode]:
+    """
+    Generates the machine code of function
+
+    Args:
+        ir (IR): IR the function belongs to, holding the types of the versions
+        function (IRFunction): function to compile
+        features (Tuple[str, ...]): instruction set extensions the code may use
+
+    Returns:
+        Optional[MachineCode]: the machine code, None if the function uses unsupported features
+    """
+    try:
+        allocation = linear_scan(ir, function)
+
+        return FunctionCodegen(ir, function, allocation, features).generate()
+    except CodegenError as err:
+        print_generic_error(f"codegen failed for \"{function.name}\": {err}")
+
+    return None
@@ -1,29 +1,260 @@
 import ast
+import builtins
+import contextlib
+import functools
 import ctypes
 import hashlib
 import inspect
 import os
+import platform
+import threading
 
-from typing import Dict, Any, Callable, Tuple, List, Optional
+from typing import Dict, Any, Callable, Tuple, List, Optional, Set
 
 from ._type import *
-from ._execmem import ExecMemory
+from ._execmem import CodeArena
 from ._symtable import SymbolTable, Parameter, FunctionDef, ScopeType
-from ._ir import IR
-
-DEBUG = 1
+from ._ir import IR, IRFunction
+from ._codegen import MachineCode, TARGET_FEATURES, generate_function
+from ._diskcache import DiskCache
+from ._ssa import construct_ssa, destruct_ssa
+from ._sccp import propagate_constants
+from ._strength import reduce_strength
+from ._gvn import number_values
+from ._dce import eliminate_dead_code
+from ._licm import hoist_loop_invariants
+from ._inline import MAX_INLINE_DEPTH, inline_calls
+from ._tailcall import eliminate_tail_calls
+from ._bounds import eliminate_bounds_checks
+from ._vectorize import vectorize_loops
+from ._fma import contract_multiply_adds
+from ._runtime import link, bailout_flag
+from ._x86 import Relocation
+from ._log import print_generic_error
+
+DEBUG = int(os.environ.get("VENOM_DEBUG", "0"))
+
+class JITBailout(Exception):
+    """
+    Raised when a jitted function could not complete, the function has to be run by the interpreter
+    """
+    pass
+
+def _int_range(ctype: Any) -> Optional[Tuple[int, int]]:
+    """
+    Bounds of the values of an integer ctypes type, None for the other types
+    """
+    if ctype not in (ctypes.c_int8, ctypes.c_int16, ctypes.c_int32, ctypes.c_int64,
+                     ctypes.c_uint8, ctypes.c_uint16, ctypes.c_uint32, ctypes.c_uint64):
+        return None
+
+    bits = ctypes.sizeof(ctype) * 8
+
+    return (-2 ** (bits - 1), 2 ** (bits - 1)) if ctype(-1).value < 0 else (0, 2 ** bits)
+
+class _PyBuffer(ctypes.Structure):
+    """
+    Py_buffer of the C API, giving the address of the read-only buffers ctypes cannot point to
+    """
+    _fields_ = [("buf", ctypes.c_void_p),
+                ("obj", ctypes.c_void_p),
+                ("len", ctypes.c_ssize_t),
+                ("itemsize", ctypes.c_ssize_t),
+                ("readonly", ctypes.c_int),
+                ("ndim", ctypes.c_int),
+                ("format", ctypes.c_char_p),
+                ("shape", ctypes.c_void_p),
+                ("strides", ctypes.c_void_p),
+                ("suboffsets", ctypes.c_void_p),
+                ("internal", ctypes.c_void_p)]
+
+_get_buffer = ctypes.pythonapi.PyObject_GetBuffer
+_get_buffer.argtypes = [ctypes.py_object, ctypes.POINTER(_PyBuffer), ctypes.c_int]
+_get_buffer.restype = ctypes.c_int
+
+_release_buffer = ctypes.pythonapi.PyBuffer_Release
+_release_buffer.argtypes = [ctypes.POINTER(_PyBuffer)]
+_release_buffer.restype = None
 
 class _JITFunc():
     
-    def __init__(self, bytecode: bytes, argtypes: Tuple, restype: Any) -> None:
-        self._exec_mem = ExecMemory(len(bytecode))
-        self._exec_mem.write(bytecode)
+    def __init__(self, address: int, func_type: FunctionType) -> None:
+        self._address = address
+        self._signature = func_type
+
+        argtypes = list()
+
+        # Arrays are passed as a pointer to their first element followed by their length
+        self._array_args = list()
+
+        # ctypes silently wraps the ints out of the range of their type, the interpreter runs those calls
+        self._int_args = list()
+
+        for i, arg_type in enumerate(func_type.args.values()):
+            if isinstance(arg_type, ArrayType):
+                element_ctype = type_to_ctypes_type(arg_type.element_type)
+                self._array_args.append((i, element_ctype, _int_range(element_ctype)))
+                argtypes.extend([ctypes.c_void_p, ctypes.c_int64])
+            else:
+                argtypes.append(abi_ctypes_type(arg_type))
+
+                # Int32 values are passed in 64 bits registers, but must be checked before they can wrap
+                int_range = _int_range(type_to_ctypes_type(arg_type))
+
+                if arg_type != TypeBool and int_range is not None:
+                    self._int_args.append((i, *int_range))
+
+        self._returns_bool = func_type.return_type == TypeBool
+
+        # Jitted functions are short, holding the GIL is cheaper than releasing and taking it back
+        self._func_type = ctypes.PYFUNCTYPE(abi_ctypes_type(func_type.return_type), *argtypes)
+        self._func = self._func_type(address)
+
+    def address(self) -> int:
+        return self._address
+
+    def signature(self) -> FunctionType:
+        return self._signature
+
+    def _convert_args(self, args: Tuple[Any, ...], buffers: List[_PyBuffer]) -> List[Any]:
+        """
+        Arguments of the native function, the read-only buffers acquired for the call are added to buffers
+        """
+        c_args = list(args)
+
+        for i, element_ctype, int_range in reversed(self._array_args):
+            arr = args[i]
+
+            if type(arr) is list:
+                if int_range is not None and arr and (min(arr) < int_range[0] or max(arr) >= int_range[1]):
+                    raise JITBailout()
+
+                # The values of lists are boxed, they have to be copied
+                data = (element_ctype * len(arr))(*arr)
+            else:
+                # Buffers are passed in place, the jitted code never writes to the read-only ones
+                view = memoryview(arr)
+
+                if view.readonly:
+                    buffer = _PyBuffer()
+                    _get_buffer(view, ctypes.byref(buffer), 0)
+                    buffers.append(buffer)
+
+                    c_args[i:i + 1] = [buffer.buf, len(view)]
+                    continue
+
+                data = (element_ctype * len(view)).from_buffer(view)
+
+            c_args[i:i + 1] = [data, len(data)]
 
-        self._func_type = ctypes.CFUNCTYPE(restype, *argtypes)
-        self._func = self._func_type(self._exec_mem.address())
+        return c_args
 
     def __call__(self, *args):
-        return self._func(*args)
+        for i, low, high in self._int_args:
+            if not low <= args[i] < high:
+                raise JITBailout()
+
+        buffers: List[_PyBuffer] = list()
+
+        try:
+            if self._array_args:
+                args = self._convert_args(args, buffers)
+
+            result = self._func(*args)
+        except ctypes.ArgumentError:
+            # Arguments converted once the interpreter ran out of stack, the interpreter raises the same errors as
+            # without jit-compilation. ctypes wraps wide ints instead of raising, they are checked beforehand
+            raise JITBailout()
+        finally:
+            for buffer in buffers:
+                _release_buffer(ctypes.byref(buffer))
+
+        if bailout_flag.value:
+            bailout_flag.value = 0
+            raise JITBailout()
+
+        return bool(result) if self._returns_bool else result
+
+def _list_tag(arr: list) -> Tuple[type, Optional[type]]:
+    element_types = set(map(type, arr))
+
+    # Empty and mixed lists cannot be specialized, they all share the same tag
+    return (list, element_types.pop() if len(element_types) == 1 else None)
+
+def _arg_tag(arg: Any, t: type) -> Any:
+    if t is list:
+        return _list_tag(arg)
+
+    if t in _SCALAR_TYPES:
+        return t
+
+    try:
+        view = memoryview(arg)
+    except TypeError:
+        return t
+
+    # Objects exposing a buffer are specialized on the layout of their elements
+    return (t, view.format, view.itemsize, view.ndim, view.c_contiguous)
+
+_SCALAR_TYPES = frozenset((int, float, bool))
+
+def type_signature(arg_types: List[Type]) -> str:
+    return str('_'.join(t.beautiful_repr() for t in arg_types))
+
+def types_from_annotations(func: Callable, precision: Precision = DEFAULT_PRECISION) -> Optional[List[Type]]:
+    """
+    Returns the types of the parameters of func from their annotations, None if one of them is missing
+    """
+    code = func.__code__
+    names = code.co_varnames[:code.co_argcount]
+    annotations = getattr(func, "__annotations__", {})
+
+    if len(names) == 0 or any(name not in annotations for name in names):
+        return None
+
+    types = list()
+
+    for name in names:
+        annotation = annotations[name]
+        t = pystrtype_to_type(annotation) if isinstance(annotation, str) else pytype_to_type(annotation)
+
+        if t is None:
+            return None
+
+        types.append(precision.scalar_type(t))
+
+    return types
+
+def dispatch_key(args: Tuple[Any, ...], key: Tuple[type, ...]) -> Tuple[Any, ...]:
+    """
+    Returns a cheap key identifying the specialization matching the given arguments from their Python types,
+    adding the element type of lists and buffers
+    """
+    if not _SCALAR_TYPES.issuperset(key):
+        return tuple(_arg_tag(arg, t) for arg, t in zip(args, key))
+
+    return key
+
+# Value of the names bound to nothing
+_UNBOUND = object()
+
+def _resolve_name(func: Callable, name: str) -> Any:
+    """
+    Value name is bound to when func runs: a variable of its closure, a global of its module or a builtin,
+    _UNBOUND if it is none of them yet
+    """
+    code = func.__code__
+
+    if name in code.co_freevars:
+        try:
+            return func.__closure__[code.co_freevars.index(name)].cell_contents
+        except ValueError:
+            return _UNBOUND
+
+    if name in func.__globals__:
+        return func.__globals__[name]
+
+    return getattr(builtins, name, _UNBOUND)
 
 class _JITFile():
     
@@ -34,9 +265,26 @@ class _JITFile():
 class _JITCompiler():
 
     _cache: Dict[str, _JITFunc]
+    _arena: CodeArena
+    _disk_cache: Optional[DiskCache]
+    _features: Tuple[str, ...]
 
-    def __init__(self) -> None:
+    def __init__(self, features: Tuple[str, ...] = TARGET_FEATURES) -> None:
         self._cache = dict()
+        self._arena = CodeArena()
+        self._disk_cache = None
+
+        # Instruction set extensions of the generated code, the entries of the disk cache depend on them
+        self._features = features
+
+        # Specializations can be compiled from the background thread, the lock guards the caches and the arena
+        self._lock = threading.RLock()
+        self._batch_depth = 0
+
+        # Specializations being compiled, calls back into one of them are recursive
+        self._compiling: Set[Tuple[Callable, str]] = set()
+
+        self.set_cache_dir(os.environ.get("VENOM_CACHE_DIR"))
 
     def _fix_source_indentation(self, source: str) -> str:
         i = 0
@@ -51,42 +299,312 @@ class _JITCompiler():
 
         return '\n'.join(lines)
 
-    def _get_type_signature(self, args: Tuple[Any, ...]) -> str:
-        return str('_'.join(t.beautiful_repr() for t in types_from_function_signature(args)))
-    
+    def set_cache_dir(self, directory: Optional[str]) -> None:
+        with self._lock:
+            self._disk_cache = DiskCache(directory) if directory else None
+
+    @contextlib.contextmanager
+    def batch(self):
+        """
+        Holds the compiler and delays sealing the code arena until the end of the block, so that the
+        specializations compiled in the block share pages. Their code is only executable once the block exits
+        """
+        with self._lock:
+            self._batch_depth += 1
+
+            try:
+                yield
+            finally:
+                self._batch_depth -= 1
+
+                if self._batch_depth == 0:
+                    self._arena.seal()
+
     def jit_func(self, func: Callable, args: Tuple[Any, ...]) -> Optional[_JITFunc]:
+        arg_types = types_from_function_signature(args)
+
+        if arg_types is None:
+            return None
+
+        return self.jit_specialization(func, arg_types)
+
+    def jit_specialization(self,
+                           func: Callable,
+                           arg_types: List[Type],
+                           return_type: Optional[Type] = None,
+                           precision: Precision = DEFAULT_PRECISION) -> Optional[_JITFunc]:
+        """
+        Compiles func for the given argument types, or fetches it from the caches
+
+        Args:
+            func (Callable): function to compile
+            arg_types (List[Type]): types of the arguments
+            return_type (Optional[Type]): return type, deduced from the function if None
+            precision (Precision): types of the ints and floats of the function
+
+        Returns:
+            Optional[_JITFunc]: the compiled function, None if it cannot be compiled
+        """
+        with self.batch():
+            return self._jit_specialization(func, arg_types, return_type, precision)
+
+    def _jit_specialization(self,
+                            func: Callable,
+                            arg_types: List[Type],
+                            return_type: Optional[Type],
+                            precision: Precision) -> Optional[_JITFunc]:
+        for arg_type in arg_types:
+            if not isinstance(arg_type, ArrayType) and arg_type not in (TypeInt64, TypeInt32, TypeFloat64, TypeFloat32, TypeBool):
+                print_generic_error(f"unsupported scalar argument type: {arg_type}, only int, float and bool are supported")
+                return None
+
         func_source = inspect.getsource(func)
 
-        type_sig = self._get_type_signature(args)
+        signature = type_signature(arg_types)
+        type_sig = signature
 
-        if type_sig is None:
-            return None
+        if return_type is not None:
+            type_sig = f"{type_sig}->{return_type.beautiful_repr()}"
+
+        if precision != DEFAULT_PRECISION:
+            type_sig = f"{type_sig}@{precision.key()}"
         
-        cache_key = hashlib.md5(f"{func_source}_{type_sig}".encode()).hexdigest()
+        # The code of func depends on the jitted functions it calls, which can change without its source
+        callees_key = self._callees_key(func, func_source)
+
+        cache_key = hashlib.md5(f"{func_source}_{callees_key}_{type_sig}".encode()).hexdigest()
         
         if cache_key in self._cache:
             return self._cache[cache_key]
-        else:
-            source = self._fix_source_indentation(inspect.getsource(func))
-            tree = ast.parse(source)
-            func_node = tree.body[0]
+
+        if platform.system() == "Windows" or platform.machine().lower() not in ("x86_64", "amd64"):
+            print(f"Error: jit-compilation is only supported on x86-64 System V platforms")
+            return None
+
+        disk_key = None
+
+        if self._disk_cache is not None:
+            disk_key = self._disk_cache.key(func_source, type_sig, self._features, callees_key)
+            cached = self._disk_cache.load(disk_key)
+
+            if cached is not None:
+                jit_func = self._install(cached.func_type, cached.code, cached.relocations)
+                self._cache[cache_key] = jit_func
+
+                return jit_func
+
+        self._compiling.add((func, signature))
+
+        try:
+            compiled = self._compile(func, func_source, arg_types, return_type, precision)
+        finally:
+            self._compiling.discard((func, signature))
+
+        if compiled is None:
+            return None
+
+        func_type, machine_code, callees = compiled
+
+        # The addresses of the callees change from one process to another, inlined ones are not referenced
+        if disk_key is not None and not any(relocation.relative for relocation in machine_code.relocations):
+            self._disk_cache.store(disk_key, func_type, machine_code.code, machine_code.relocations)
+
+        jit_func = self._install(func_type, machine_code.code, machine_code.relocations, callees)
+
+        if jit_func is None:
+            return None
+
+        self._cache[cache_key] = jit_func
+
+        return jit_func
+
+    def _install(self,
+                 func_type: FunctionType,
+                 code: bytes,
+                 relocations: List[Relocation],
+                 callees: Optional[Dict[str, int]] = None) -> Optional[_JITFunc]:
+        """
+        Links the code and copies it to the code arena, it is executable once the current batch is sealed
+        """
+        address = self._arena.allocate(len(code))
+        linked = link(code, relocations, address, callees)
+
+        if linked is None:
+            print(f"Error: the functions called by \"{func_type.name}\" are out of reach of a direct call")
+            return None
+
+        self._arena.copy(address, linked)
+
+        return _JITFunc(address, func_type)
+
+    def _jitted_callees(self, func: Callable, func_node: ast.FunctionDef) -> Dict[str, Callable]:
+        """
+        Jitted functions called by name from func, looked up in its closure and globals at compile time
+        """
+        names = set(node.func.id for node in ast.walk(func_node)
+                    if isinstance(node, ast.Call) and isinstance(node.func, ast.Name))
+
+        try:
+            closure = inspect.getclosurevars(func)
+        except (TypeError, ValueError):
+            return dict()
+
+        callees = dict()
+
+        for name in names:
+            value = closure.nonlocals.get(name, closure.globals.get(name))
+
+            # Calls to the function itself are compiled along with it
+            if hasattr(value, "__venom_specialize__") and value.__wrapped__ is not func:
+                callees[name] = value
+
+        return callees
+
+    def unresolved_calls(self, func: Callable) -> Set[str]:
+        """
+        Names called by func that its closure, globals and builtins do not define yet, like the functions
+        defined after it in its module. Calls to func itself are left out
+        """
+        func_node = ast.parse(self._fix_source_indentation(inspect.getsource(func))).body[0]
+
+        return set(node.func.id for node in ast.walk(func_node)
+                   if isinstance(node, ast.Call) and isinstance(node.func, ast.Name) and
+                      node.func.id != func_node.name and _resolve_name(func, node.func.id) is _UNBOUND)
+
+    def _callees_key(self, func: Callable, func_source: str) -> str:
+        """
+        Names, precisions and sources of the jitted functions func calls, directly or through other callees
+        """
+        parts = list()
+        pending = [(func, func_source)]
+        visited = { func }
+
+        while pending:
+            caller, source = pending.pop()
+            func_node = ast.parse(self._fix_source_indentation(source)).body[0]
 
             if not isinstance(func_node, ast.FunctionDef):
-                print(f"Error: cannot compile \"{type(func_node)}\", it is not a function definition")
+                continue
+
+            for name, callee in sorted(self._jitted_callees(caller, func_node).items()):
+                callee_source = inspect.getsource(callee.__wrapped__)
+                parts.append(f"{name}@{callee.__venom_precision__.key()}\n{callee_source}")
+
+                if callee.__wrapped__ not in visited:
+                    visited.add(callee.__wrapped__)
+                    pending.append((callee.__wrapped__, callee_source))
+
+        return "\n".join(parts)
+
+    def _build_ir(self,
+                  func: Callable,
+                  func_source: str,
+                  arg_types: List[Type],
+                  return_type: Optional[Type],
+                  precision: Precision = DEFAULT_PRECISION,
+                  depth: int = 0) -> Optional[Tuple[FunctionType, IR, Dict[str, int]]]:
+        """
+        Runs semantic analysis and IR generation for one specialization of func. The jitted functions it calls
+        are compiled first, their addresses are returned by symbol, and the small ones are inlined up to
+        MAX_INLINE_DEPTH levels deep
+        """
+        source = self._fix_source_indentation(func_source)
+        tree = ast.parse(source)
+        func_node = tree.body[0]
+
+        if not isinstance(func_node, ast.FunctionDef):
+            print(f"Error: cannot compile \"{type(func_node)}\", it is not a function definition")
+            return None
+
+        args = { arg.arg: t for arg, t in zip(func_node.args.args, arg_types) }
+
+        func_type = FunctionType(func_node.name, args, None)
+
+        jitted_callees = self._jitted_callees(func, func_node)
+        callees: Dict[str, int] = dict()
+        inlined: Dict[str, Tuple[IR, IRFunction]] = dict()
+
+        def specialize(symbol: FunctionDef, callee_arg_types: List[Type]) -> Optional[FunctionType]:
+            if symbol.name not in jitted_callees:
+                print(f"Error: recursive calls to \"{symbol.name}\" must pass arguments of the types it is compiled for")
+                return None
+
+            callee = jitted_callees[symbol.name]
+
+            if (callee.__wrapped__, type_signature(callee_arg_types)) in self._compiling:
+                print(f"Error: mutually recursive call to \"{symbol.name}\" is not supported")
+                return None
+
+            jit_func = callee.__venom_specialize__(callee_arg_types)
+
+            if jit_func is None:
                 return None
 
-            args = { arg.arg: t for arg, t in zip(func_node.args.args, types_from_function_signature(args)) }
+            # Named after the called symbol, as different functions can share the same name
+            signature = jit_func.signature()
+            callee_type = FunctionType(symbol.name, signature.args, signature.return_type)
+            callees[callee_type.mangled_name()] = jit_func.address()
+
+            # The passes of fastmath functions would change the rounding of the callees compiled without it
+            if depth < MAX_INLINE_DEPTH and (callee.__venom_precision__.fastmath or not precision.fastmath):
+                built = self._build_ir(callee.__wrapped__,
+                                       inspect.getsource(callee.__wrapped__),
+                                       callee_arg_types,
+                                       None,
+                                       callee.__venom_precision__,
+                                       depth + 1)
+
+                if built is not None:
+                    _, callee_ir, callee_callees = built
+                    callees.update(callee_callees)
+                    inlined[callee_type.mangled_name()] = (callee_ir, callee_ir.get_functions()[0])
+
+            return callee_type
+
+        recursive = func_node.name not in jitted_callees and \
+                    any(isinstance(node, ast.Call) and isinstance(node.func, ast.Name) and node.func.id == func_node.name
+                        for node in ast.walk(func_node))
+
+        # Calls of a recursive function to itself return the annotated type, otherwise int, float then bool until
+        # the return type deduced from the function agrees with it. Errors are only reported for the last try
+        annotation = precision.scalar_type(pystrtype_to_type(func_node.returns.id)) if isinstance(func_node.returns, ast.Name) else None
+
+        if return_type is not None:
+            recursive_types = [return_type]
+        elif annotation not in (None, TypeInvalid):
+            recursive_types = [annotation]
+        else:
+            recursive_types = [precision.int_type, precision.float_type, TypeBool]
+
+            # Callers with another precision pass 64 bits values, which the function may return
+            recursive_types += [t for t in (TypeInt64, TypeFloat64) if t not in recursive_types]
+
+        for recursive_type in recursive_types:
+            quiet = recursive and recursive_type is not recursive_types[-1]
 
-            func_type = FunctionType(func_node.name, args, None)
+            symtable = SymbolTable("__jitmodule__", precision)
+            symtable.set_name_resolver(functools.partial(_resolve_name, func))
+
+            for name, callee in jitted_callees.items():
+                code = callee.__wrapped__.__code__
+                symtable.add_symbol(FunctionDef(name, None, None, list(code.co_varnames[:code.co_argcount])))
+
+            if recursive:
+                self_type = FunctionType(func_node.name, args, recursive_type)
+                symtable.add_symbol(FunctionDef(func_node.name, None, func_node, list(args.keys()), { self_type.mangled_name(): self_type }))
+
+            symtable.set_function_specializer(specialize)
 
-            symtable = SymbolTable("__jitmodule__")
             symtable.push_scope(func_node.name, ScopeType.Function)
 
             for name, type in args.items():
                 symtable.add_symbol(Parameter(name, type))
 
             # Build the symtable and run semantic analysis for the jit function
-            func_return_type = symtable.collect_from_function(func_node, source)
+            func_return_type = symtable.collect_from_function(func_node, source, quiet)
+
+            if quiet and func_return_type in (None, TypeInvalid):
+                continue
 
             if func_return_type is None:
                 print(f"Error: error caught during parse of function \"{func.__name__}\", aborting jit-compilation")
@@ -95,33 +613,94 @@ class _JITCompiler():
                 print(f"Error: cannot deduce return type for function \"{func.__name__}\", aborting jit-compilation")
                 return None
 
-            func_type.return_type = func_return_type
+            # An explicit signature has the last word, return values are cast to it
+            func_type.return_type = return_type if return_type is not None else func_return_type
 
             # Back to module scope
             symtable.pop_scope()
 
-            # Add the function to the module scope
-            symtable.add_symbol(FunctionDef(func_node.name, None, func_node, list(args.keys()), { func_type.mangled_name(): func_type }))
+            if not recursive or func_type.return_type == recursive_type:
+                break
+        else:
+            print(f"Error: cannot deduce return type for recursive function \"{func.__name__}\", aborting jit-compilation")
+            return None
+
+        # Add the function to the module scope
+        symtable.add_symbol(FunctionDef(func_node.name, None, func_node, list(args.keys()), { func_type.mangled_name(): func_type }))
+
+        # Generate the Intermediate Representation
+        ir = IR(symtable)
+
+        if not ir.build(func_node):
+            print(f"Error: error caught during IR generation of function \"{func.__name__}\", aborting jit-compilation")
+            return None
+
+        for function in ir.get_functions():
+            inline_calls(ir, function, inlined)
+
+        if DEBUG and depth == 0:
+            print("SOURCE")
+            print(source)
+
+            print()
+
+            symtable.print()
+
+            print()
 
-            # Generate the Intermediate Representation
-            ir = IR(symtable)
-            ir.build(func_node)
+        return func_type, ir, callees
 
-            if DEBUG:
-                print("SOURCE")
-                print(source)
+    def _compile(self,
+                 func: Callable,
+                 func_source: str,
+                 arg_types: List[Type],
+                 return_type: Optional[Type],
+                 precision: Precision = DEFAULT_PRECISION) -> Optional[Tuple[FunctionType, MachineCode, Dict[str, int]]]:
+        """
+        Runs semantic analysis, IR generation and code generation for one specialization of func
+        """
+        built = self._build_ir(func, func_source, arg_types, return_type, precision)
+
+        if built is None:
+            return None
+
+        func_type, ir, callees = built
 
-                print()
+        # Optimize the IR
+        for function in ir.get_functions():
+            eliminate_tail_calls(ir, function)
+            construct_ssa(ir, function)
+            propagate_constants(ir, function)
+            reduce_strength(ir, function, precision.fastmath)
+            number_values(ir, function)
+            hoist_loop_invariants(ir, function)
+            eliminate_dead_code(ir, function)
+            destruct_ssa(ir, function)
 
-                symtable.print()
+            eliminate_bounds_checks(ir, function)
+            vectorize_loops(ir, function, precision.fastmath)
 
-                print()
-                ir.print()
+            if precision.fastmath and "fma" in self._features:
+                contract_multiply_adds(ir, function)
 
-                print()
+        if DEBUG:
+            ir.print()
 
+            print()
+
+        # Generate the machine code
+        machine_code = generate_function(ir, ir.get_functions()[0], self._features)
+
+        if machine_code is None:
             return None
 
+        if DEBUG:
+            machine_code.print()
+
+            print()
+
+        return func_type, machine_code, callees
+
     def jit_file(self, filepath: str) -> Optional[_JITFile]:
         """
         Compiles the given file, as it is currently being worked on the function will change
@@ -0,0 +1,129 @@
+import ctypes
+import platform
+
+from typing import Optional, Tuple
+
+from ._execmem import ExecMemory
+from ._log import print_generic_error
+
+# cpuid(leaf, subleaf, out) storing eax, ebx, ecx and edx in out[0..3], rbx is callee-saved
+_CPUID_CODE = bytes([
+    0x53,                   # push rbx
+    0x49, 0x89, 0xD0,       # mov r8, rdx
+    0x89, 0xF8,             # mov eax, edi
+    0x89, 0xF1,             # mov ecx, esi
+    0x0F, 0xA2,             # cpuid
+    0x41, 0x89, 0x00,       # mov [r8], eax
+    0x41, 0x89, 0x58, 0x04, # mov [r8 + 4], ebx
+    0x41, 0x89, 0x48, 0x08, # mov [r8 + 8], ecx
+    0x41, 0x89, 0x50, 0x0C, # mov [r8 + 12], edx
+    0x5B,                   # pop rbx
+    0xC3,                   # ret
+])
+
+# xgetbv(0), the register states the OS saves on context switches
+_XGETBV_CODE = bytes([
+    0x31, 0xC9,             # xor ecx, ecx
+    0x0F, 0x01, 0xD0,       # xgetbv
+    0x48, 0xC1, 0xE2, 0x20, # shl rdx, 32
+    0x48, 0x09, 0xD0,       # or rax, rdx
+    0xC3,                   # ret
+])
+
+# Extensions enabled by each level VENOM_CPU can name, those the host lacks are left out
+CPU_LEVELS = {
+    "sse2": ("sse2",),
+    "sse4.1": ("sse2", "sse4_1"),
+    "avx2": ("sse2", "sse4_1", "avx", "fma", "avx2", "bmi2"),
+    "avx512": ("sse2", "sse4_1", "avx", "fma", "avx2", "bmi2", "avx512f"),
+}
+
+_host_features: Optional[Tuple[str, ...]] = None
+
+def _detect_features() -> Tuple[str, ...]:
+    # The stubs follow the System V calling convention, as the generated code does
+    if platform.machine().lower() not in ("x86_64", "amd64") or platform.system() == "Windows":
+        return ("sse2",)
+
+    cpuid_memory = ExecMemory(len(_CPUID_CODE))
+    cpuid_memory.write(_CPUID_CODE)
+    cpuid = ctypes.CFUNCTYPE(None, ctypes.c_uint32, ctypes.c_uint32, ctypes.POINTER(ctypes.c_uint32))(cpuid_memory.address())
+
+    registers = (ctypes.c_uint32 * 4)()
+
+    cpuid(0, 0, registers)
+    max_leaf = registers[0]
+
+    cpuid(1, 0, registers)
+    ecx = registers[2]
+
+    ebx = 0
+
+    if max_leaf >= 7:
+        cpuid(7, 0, registers)
+        ebx = registers[1]
+
+    features = ["sse2"]
+
+    if ecx & (1 << 19):
+        features.append("sse4_1")
+
+    # The VEX and EVEX encoded extensions need the OS to save the ymm and zmm registers
+    xcr0 = 0
+
+    if ecx & (1 << 27):
+        xgetbv_memory = ExecMemory(len(_XGETBV_CODE))
+        xgetbv_memory.write(_XGETBV_CODE)
+        xcr0 = ctypes.CFUNCTYPE(ctypes.c_uint64)(xgetbv_memory.address())()
+
+    if ecx & (1 << 28) and xcr0 & 0x6 == 0x6:
+        features.append("avx")
+
+        if ecx & (1 << 12):
+            features.append("fma")
+
+        if ebx & (1 << 5):
+            features.append("avx2")
+
+        if ebx & (1 << 16) and xcr0 & 0xE0 == 0xE0:
+            features.append("avx512f")
+
+    if ebx & (1 << 8):
+        features.append("bmi2")
+
+    return tuple(features)
+
+def host_features() -> Tuple[str, ...]:
+    """
+    Instruction set extensions of the running CPU the code generator knows of, detected once with cpuid
+
+    Returns:
+        Tuple[str, ...]: names of the extensions, "sse2" always being there
+    """
+    global _host_features
+
+    if _host_features is None:
+        _host_features = _detect_features()
+
+    return _host_features
+
+def target_features(cpu: Optional[str] = None) -> Tuple[str, ...]:
+    """
+    Extensions the code is generated for: the ones of the host, limited to a level of CPU_LEVELS when cpu
+    names one. cpu comes from the VENOM_CPU environment variable, None or "native" keeps all of them
+
+    Returns:
+        Tuple[str, ...]: names of the extensions, in the order of host_features()
+    """
+    features = host_features()
+
+    if cpu is None or cpu.strip().lower() in ("", "native"):
+        return features
+
+    level = CPU_LEVELS.get(cpu.strip().lower())
+
+    if level is None:
+        print_generic_error(f"unknown cpu \"{cpu}\", expected \"native\" or one of {', '.join(CPU_LEVELS)}")
+        return features
+
+    return tuple(feature for feature in features if feature in level)
@@ -0,0 +1,139 @@
+from typing import Dict, List, Optional, Set, Tuple
+
+from ._ir import *
+from ._op import *
+from ._type import *
+from ._regalloc import is_float_type
+
+def _is_non_zero_literal(stmt: Optional[IRStatement]) -> bool:
+    return isinstance(stmt, IRLiteral) and stmt.value != 0
+
+def _is_non_negative_literal(stmt: Optional[IRStatement]) -> bool:
+    return isinstance(stmt, IRLiteral) and stmt.value >= 0
+
+def has_effects(stmt: IRStatement, definitions: Dict[int, IRStatement]) -> bool:
+    """
+    Statements which have to run even if their value is never read: calls, and the ones raising an error in
+    Python that the interpreter reports after a bailout, such as out of bounds accesses and divisions by zero
+    """
+    if isinstance(stmt, (IRVariable, IRLiteral, IRMoveOp, IRCMovOp, IRIncOp, IRDecOp)):
+        return False
+
+    if isinstance(stmt, IRUnaryOp):
+        return stmt.op in (UnaryOpType.Sqrt,) + TRANSCENDENTAL_OPS
+
+    if isinstance(stmt, IRCastOp):
+        return is_float_type(stmt.type_from) and not is_float_type(stmt.type_to) and stmt.type_to != TypeBool
+
+    if isinstance(stmt, IrMemLoadOp):
+        return stmt.length is not None
+
+    if isinstance(stmt, IRBinaryOp):
+        right = definitions.get(stmt.right)
+
+        if stmt.op in (BinaryOpType.Div, BinaryOpType.FloorDiv, BinaryOpType.Mod):
+            return not _is_non_zero_literal(right)
+
+        if stmt.op in (BinaryOpType.LShift, BinaryOpType.RShift):
+            return not _is_non_negative_literal(right)
+
+        return stmt.op == BinaryOpType.Pow
+
+    return True
+
+def eliminate_dead_code(ir: IR, function: IRFunction) -> int:
+    """
+    Removes the statements and block parameters of the SSA form of function whose value is never used,
+    unless they have effects. Declarations of local variables go as well, only the ones of the parameters
+    of the function are kept
+
+    Returns:
+        int: number of statements and parameters removed
+    """
+    definitions: Dict[int, IRStatement] = dict()
+    parameters: Dict[int, Tuple[IRBlock, int]] = dict()
+
+    for block in function.blocks:
+        for i, parameter in enumerate(block.parameters):
+            parameters[parameter] = (block, i)
+
+        for stmt in block.statements:
+            for version in stmt.defines():
+                definitions[version] = stmt
+
+    live: Set[int] = set()
+    kept: Set[int] = set()
+    worklist: List[int] = list()
+
+    def mark(versions: List[int]) -> None:
+        for version in versions:
+            if version not in live:
+                live.add(version)
+                worklist.append(version)
+
+    def keep(block: IRBlock, i: int) -> None:
+        stmt = block.statements[i]
+
+        if id(stmt) in kept:
+            return
+
+        kept.add(id(stmt))
+        mark(stmt.uses())
+
+        # Selections need the flags of their compare
+        if isinstance(stmt, IRCMovOp):
+            keep(block, i - 1)
+
+    positions: Dict[int, Tuple[IRBlock, int]] = dict()
+
+    for block in function.blocks:
+        for i, stmt in enumerate(block.statements):
+            for version in stmt.defines():
+                positions[version] = (block, i)
+
+            if has_effects(stmt, definitions) and not isinstance(stmt, (IRCompareOp, IRVariable)):
+                keep(block, i)
+
+        # Compares setting the flags of the jump
+        if isinstance(block.terminator, IRJump) and block.terminator.comp is not None:
+            keep(block, len(block.statements) - 1)
+
+        if block.terminator is not None:
+            mark(block.terminator.uses())
+
+    while len(worklist) > 0:
+        version = worklist.pop()
+
+        if version in positions:
+            keep(*positions[version])
+        elif version in parameters:
+            block, i = parameters[version]
+            mark([arguments[i] for arguments in block.arguments.values()])
+
+    entry_values = set(function.parameter_versions.values()) | set(function.array_lengths.values())
+    count = 0
+
+    for block in function.blocks:
+        statements = list()
+
+        for stmt in block.statements:
+            if id(stmt) in kept or (isinstance(stmt, IRVariable) and stmt.version in entry_values):
+                statements.append(stmt)
+            else:
+                count += 1
+
+        block.statements = statements
+
+        for i in reversed(range(len(block.parameters))):
+            if block.parameters[i] not in live:
+                block.parameters.pop(i)
+
+                for arguments in block.arguments.values():
+                    arguments.pop(i)
+
+                count += 1
+
+        if len(block.parameters) == 0:
+            block.arguments = dict()
+
+    return count
@@ -0,0 +1,151 @@
+import hashlib
+import json
+import os
+import platform
+import struct
+import tempfile
+
+from dataclasses import dataclass
+from typing import List, Optional, Tuple
+
+from ._type import *
+from ._x86 import Relocation
+from ._version import __version__
+
+# Bumped when the layout of the cache files changes
+_FORMAT_VERSION = 1
+
+_MAGIC = b"VENOMJIT"
+
+_compiler_fingerprint = None
+
+def _get_compiler_fingerprint() -> str:
+    """
+    Hash of the sources of venom itself, so that entries written by another build of the compiler are
+    never loaded
+    """
+    global _compiler_fingerprint
+
+    if _compiler_fingerprint is None:
+        package_dir = os.path.dirname(os.path.abspath(__file__))
+        digest = hashlib.sha256()
+
+        for filename in sorted(os.listdir(package_dir)):
+            if filename.endswith(".py"):
+                with open(os.path.join(package_dir, filename), "rb") as file:
+                    digest.update(filename.encode())
+                    digest.update(file.read())
+
+        _compiler_fingerprint = digest.hexdigest()
+
+    return _compiler_fingerprint
+
+@dataclass
+class CachedFunction():
+    """
+    Specialization loaded from the disk cache, the code still has to be linked
+    """
+
+    func_type: FunctionType
+    code: bytes
+    relocations: List[Relocation]
+
+class DiskCache():
+    """
+    Directory holding the machine code of compiled specializations, one file per specialization. Entries
+    are keyed by the function source, the sources of the jitted functions it calls and may inline, its
+    signature, the venom version and the CPU features the code relies on. Files are written atomically so
+    that several processes can share the same directory
+    """
+
+    def __init__(self, directory: str) -> None:
+        self._directory = directory
+
+    def directory(self) -> str:
+        return self._directory
+
+    def key(self, source: str, signature: str, cpu_features: Tuple[str, ...], callees: str = "") -> str:
+        digest = hashlib.sha256()
+
+        for part in (source,
+                     callees,
+                     signature,
+                     __version__,
+                     str(_FORMAT_VERSION),
+                     _get_compiler_fingerprint(),
+                     platform.machine(),
+                     ",".join(cpu_features)):
+            digest.update(part.encode())
+            digest.update(b"\0")
+
+        return digest.hexdigest()
+
+    def _path(self, key: str) -> str:
+        return os.path.join(self._directory, f"{key}.vjit")
+
+    def load(self, key: str) -> Optional[CachedFunction]:
+        """
+        Returns the cached specialization, None if there is none or if the entry cannot be read
+        """
+        try:
+            with open(self._path(key), "rb") as file:
+                data = file.read()
+        except OSError:
+            return None
+
+        try:
+            if not data.startswith(_MAGIC):
+                return None
+
+            (metadata_size,) = struct.unpack_from("<I", data, len(_MAGIC))
+            metadata_start = len(_MAGIC) + 4
+            metadata = json.loads(data[metadata_start:metadata_start + metadata_size].decode())
+
+            args = { name: type_from_letter(letter) for name, letter in metadata["args"] }
+            return_type = type_from_letter(metadata["return"])
+
+            if return_type is None or any(t is None for t in args.values()):
+                return None
+
+            code = data[metadata_start + metadata_size:]
+
+            if len(code) != metadata["size"]:
+                return None
+
+            relocations = [Relocation(offset, symbol) for offset, symbol in metadata["relocations"]]
+
+            return CachedFunction(FunctionType(metadata["name"], args, return_type), code, relocations)
+        except (ValueError, KeyError, TypeError, struct.error):
+            return None
+
+    def store(self, key: str, func_type: FunctionType, code: bytes, relocations: List[Relocation]) -> None:
+        """
+        Writes the machine code of a specialization, before linking. Failures are ignored as the cache is
+        only an optimization
+        """
+        metadata = json.dumps({
+            "name": func_type.name,
+            "args": [[name, t.to_letter()] for name, t in func_type.args.items()],
+            "return": func_type.return_type.to_letter(),
+            "size": len(code),
+            "relocations": [[relocation.offset, relocation.symbol] for relocation in relocations],
+        }).encode()
+
+        try:
+            os.makedirs(self._directory, exist_ok=True)
+
+            fd, tmp_path = tempfile.mkstemp(dir=self._directory, suffix=".tmp")
+
+            try:
+                with os.fdopen(fd, "wb") as file:
+                    file.write(_MAGIC)
+                    file.write(struct.pack("<I", len(metadata)))
+                    file.write(metadata)
+                    file.write(code)
+
+                os.replace(tmp_path, self._path(key))
+            except OSError:
+                os.unlink(tmp_path)
+                raise
+        except OSError:
+            pass
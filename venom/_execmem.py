@@ -5,6 +5,16 @@ import typing
 
 from ctypes import wintypes
 
+_libc = None
+
+def _get_libc() -> ctypes.CDLL:
+    global _libc
+
+    if _libc is None:
+        _libc = ctypes.CDLL(None)
+
+    return _libc
+
 class ExecMemory():
 
     def __init__(self, size: int) -> None:
@@ -46,15 +56,28 @@ class ExecMemory():
         self._ptr = ctypes.addressof(ctypes.c_char.from_buffer(self._mmap_obj))
 
     def write(self, code: bytes) -> None:
-        if len(code) > self._size:
-            raise ValueError("Code too large for buffer")
-
-        ctypes.memmove(self._ptr, code, len(code))
+        self.copy(code, 0)
 
         self._protect_exec()
 
+    def copy(self, code: bytes, offset: int) -> None:
+        """
+        Copies code at offset without changing the protection of the memory
+        """
+        if offset + len(code) > self._size:
+            raise ValueError("Code too large for buffer")
+
+        ctypes.memmove(self._ptr + offset, code, len(code))
+
     def _protect_exec(self) -> None:
+        self.protect(0, self._size, True)
+
+    def protect(self, offset: int, size: int, executable: bool) -> None:
+        """
+        Makes the pages in [offset, offset + size) either readable and executable, or readable and writable
+        """
         if self._platform == "Windows":
+            PAGE_READWRITE = 0x04
             PAGE_EXECUTE_READ = 0x20
             old_protect = ctypes.c_ulong()
 
@@ -66,26 +89,28 @@ class ExecMemory():
                 wintypes.PDWORD, # lpflOldProtect
             )
 
-            res = ctypes.windll.kernel32.VirtualProtect(wintypes.LPVOID(self._ptr),
-                                                        ctypes.c_size_t(self._size),
-                                                        PAGE_EXECUTE_READ,
+            res = ctypes.windll.kernel32.VirtualProtect(wintypes.LPVOID(self._ptr + offset),
+                                                        ctypes.c_size_t(size),
+                                                        PAGE_EXECUTE_READ if executable else PAGE_READWRITE,
                                                         ctypes.byref(old_protect))
 
             if res == 0:
                 raise OSError("VirtualProtect failed")
         else:
             PROT_READ = 1
+            PROT_WRITE = 2
             PROT_EXEC = 4
 
-            libc = ctypes.CDLL(None)
-
-            res = libc.mprotect(ctypes.c_void_p(self._ptr),
-                                ctypes.c_size_t(self._size),
-                                PROT_READ | PROT_EXEC)
+            res = _get_libc().mprotect(ctypes.c_void_p(self._ptr + offset),
+                                       ctypes.c_size_t(size),
+                                       PROT_READ | (PROT_EXEC if executable else PROT_WRITE))
 
             if res != 0:
                 raise OSError("mprotect failed")
 
+    def size(self) -> int:
+        return self._size
+
     def address(self) -> typing.Optional[ctypes.c_void_p]:
         return self._ptr
 
@@ -111,3 +136,96 @@ class ExecMemory():
 
     def __del__(self):
         self.free()
+
+def _align_up(value: int, alignment: int) -> int:
+    return (value + alignment - 1) & ~(alignment - 1)
+
+class _ArenaChunk():
+
+    def __init__(self, size: int) -> None:
+        self.memory = ExecMemory(size)
+        self.offset = 0
+        # Pages below are executable, pages above are writable
+        self.exec_end = 0
+
+class CodeArena():
+    """
+    Bump allocator packing the code of many functions in large chunks of executable memory. Written code is
+    only executable once seal() has been called, which changes the protection of all the pages written since
+    the previous seal at once.
+
+    Sealed pages are never made writable again as other threads may be running their code, writes following
+    a seal start on the next page. Batching writes between seals keeps the code dense. Not thread-safe
+    """
+
+    CHUNK_SIZE = 256 * 1024
+    FUNCTION_ALIGNMENT = 16
+
+    def __init__(self) -> None:
+        self._chunks: typing.List[_ArenaChunk] = list()
+        self._page_size = mmap.PAGESIZE if platform.system() != "Windows" else 4096
+
+    def allocate(self, size: int) -> int:
+        """
+        Reserves room for size bytes of code, so that code referencing its own address can be linked before
+        being copied
+
+        Args:
+            size (int): size of the code
+
+        Returns:
+            int: address of the code, executable after the next call to seal()
+        """
+        chunk = self._chunks[-1] if len(self._chunks) > 0 else None
+
+        start = _align_up(chunk.offset, self.FUNCTION_ALIGNMENT) if chunk is not None else 0
+
+        if chunk is not None and start < chunk.exec_end:
+            start = chunk.exec_end
+
+        if chunk is None or start + size > chunk.memory.size():
+            chunk = _ArenaChunk(_align_up(max(self.CHUNK_SIZE, size), self._page_size))
+            self._chunks.append(chunk)
+            start = 0
+
+        chunk.offset = start + size
+
+        return chunk.memory.address() + start
+
+    def copy(self, address: int, code: bytes) -> None:
+        """
+        Copies code to an address returned by allocate() since the last call to seal()
+        """
+        ctypes.memmove(address, code, len(code))
+
+    def write(self, code: bytes) -> int:
+        """
+        Copies code to the arena
+
+        Args:
+            code (bytes): position independent machine code
+
+        Returns:
+            int: address of the code, executable after the next call to seal()
+        """
+        address = self.allocate(len(code))
+        self.copy(address, code)
+
+        return address
+
+    def seal(self) -> None:
+        """
+        Makes all the code written since the last call executable
+        """
+        for chunk in self._chunks:
+            end = _align_up(chunk.offset, self._page_size)
+
+            if end > chunk.exec_end:
+                chunk.memory.protect(chunk.exec_end, end - chunk.exec_end, True)
+                chunk.exec_end = end
+
+    def used(self) -> int:
+        """
+        Returns the number of bytes of code written to the arena
+        """
+        return sum(chunk.offset for chunk in self._chunks)
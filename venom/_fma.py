@@ -0,0 +1,90 @@
+from typing import Dict, List, Optional
+
+from ._ir import *
+from ._op import *
+from ._type import *
+from ._regalloc import is_float_type
+
+def _fuse(stmt: IRBinaryOp, product: IRBinaryOp) -> IRFmaOp:
+    """
+    Fused statement computing stmt, one of its operands being the result of product
+    """
+    if stmt.op == BinaryOpType.Add:
+        addend = stmt.right if stmt.left == product.version else stmt.left
+
+        return IRFmaOp(stmt.version, product.left, product.right, addend, stmt.type)
+
+    # a * b - c or c - a * b
+    if stmt.left == product.version:
+        return IRFmaOp(stmt.version, product.left, product.right, stmt.right, stmt.type, negate_addend=True)
+
+    return IRFmaOp(stmt.version, product.left, product.right, stmt.left, stmt.type, negate_product=True)
+
+def _contract_block(block: IRBlock, definitions: Dict[int, int], uses: Dict[int, int]) -> int:
+    statements: List[Optional[IRStatement]] = list(block.statements)
+    products: Dict[int, int] = dict()
+    count = 0
+
+    for i, stmt in enumerate(statements):
+        if isinstance(stmt, IRBinaryOp) and is_float_type(stmt.type) and stmt.op in (BinaryOpType.Add, BinaryOpType.Sub):
+            index = next((products[version] for version in (stmt.left, stmt.right)
+                          if version in products and statements[products[version]].type == stmt.type), None)
+
+            if index is not None:
+                product = statements[index]
+                statements[i] = _fuse(stmt, product)
+                statements[index] = None
+
+                del products[product.version]
+                count += 1
+
+                stmt = statements[i]
+
+        # Products are moved down to their use, the versions they read must not change in between
+        for version in stmt.defines():
+            for other, index in list(products.items()):
+                if version in (other, statements[index].left, statements[index].right):
+                    del products[other]
+
+        if isinstance(stmt, IRBinaryOp) and stmt.op == BinaryOpType.Mul and is_float_type(stmt.type) and \
+           definitions.get(stmt.version) == 1 and uses.get(stmt.version) == 1 and stmt.version not in (stmt.left, stmt.right):
+            products[stmt.version] = i
+
+    block.statements = [stmt for stmt in statements if stmt is not None]
+
+    return count
+
+def contract_multiply_adds(ir: IR, function: IRFunction) -> int:
+    """
+    Fuses the float multiplications of function whose result is only added to or subtracted from another
+    value in the same block into IRFmaOp, rounding once instead of twice. Runs on the functions compiled with
+    fastmath after vectorization, so that the multiplications of vector loops stay lane operations
+
+    Returns:
+        int: number of fused multiplications
+    """
+    definitions: Dict[int, int] = dict()
+    uses: Dict[int, int] = dict()
+
+    for block in function.blocks:
+        for stmt in block.statements:
+            for version in stmt.defines():
+                definitions[version] = definitions.get(version, 0) + 1
+
+            for version in stmt.uses():
+                uses[version] = uses.get(version, 0) + 1
+
+        if block.terminator is not None:
+            for version in block.terminator.uses():
+                uses[version] = uses.get(version, 0) + 1
+
+        for arguments in block.arguments.values():
+            for version in arguments:
+                uses[version] = uses.get(version, 0) + 1
+
+    count = 0
+
+    for block in function.blocks:
+        count += _contract_block(block, definitions, uses)
+
+    return count
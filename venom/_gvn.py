@@ -0,0 +1,172 @@
+import struct
+
+from typing import Any, Callable, Dict, List, Optional, Tuple
+
+from ._ir import *
+from ._op import *
+from ._type import *
+from ._ssa import DominatorTree
+
+_commutative_ops = (BinaryOpType.Add, BinaryOpType.Mul, BinaryOpType.BitAnd, BinaryOpType.BitOr, BinaryOpType.BitXor)
+
+def _literal_number(stmt: IRLiteral) -> Tuple[Any, ...]:
+    # -0.0 and 0.0 are different values
+    value = struct.pack("<d", stmt.value) if isinstance(stmt.value, float) else stmt.value
+
+    return ("literal", stmt.type, type(stmt.value), value)
+
+def _value_key(stmt: IRStatement, compare: Optional[IRCompareOp], number: Callable[[int], Any]) -> Optional[Tuple[Any, ...]]:
+    """
+    Key identifying the value computed by a pure statement from the value numbers of its operands, None if it
+    cannot be merged
+    """
+    if isinstance(stmt, IRCastOp):
+        return ("cast", stmt.type_from, stmt.type_to, number(stmt.operand))
+
+    if isinstance(stmt, IRUnaryOp):
+        return ("unary", stmt.op, stmt.type, stmt.fastmath, number(stmt.operand))
+
+    if isinstance(stmt, IRBinaryOp):
+        left, right = number(stmt.left), number(stmt.right)
+
+        if stmt.op in _commutative_ops and repr(left) > repr(right):
+            left, right = right, left
+
+        return ("binary", stmt.op, stmt.type, left, right)
+
+    if isinstance(stmt, IrMemLoadOp):
+        return ("load", number(stmt.base_ptr), stmt.type, number(stmt.offset), number(stmt.length))
+
+    if isinstance(stmt, (IRIncOp, IRDecOp)):
+        return (type(stmt).__name__, stmt.type, number(stmt.operand))
+
+    if isinstance(stmt, IRCMovOp) and compare is not None:
+        return ("cmov", stmt.op, stmt.type, number(stmt.true_val), number(stmt.false_val),
+                number(compare.left), number(compare.right), compare.type)
+
+    return None
+
+def _replace_everywhere(function: IRFunction, replacements: Dict[int, int]) -> None:
+    for block in function.blocks:
+        for stmt in block.statements:
+            stmt.replace_uses(replacements)
+
+        if block.terminator is not None:
+            block.terminator.replace_uses(replacements)
+
+        for name, arguments in block.arguments.items():
+            block.arguments[name] = [replacements.get(argument, argument) for argument in arguments]
+
+def number_values(ir: IR, function: IRFunction) -> int:
+    """
+    Dominator based global value numbering on the SSA form of function. Copies are propagated, statements
+    computing a value already computed by a dominating statement are removed, and block parameters receiving
+    the same value from every predecessor are replaced by it. Literals are numbered by their value but kept,
+    materializing them where they are used is cheaper than keeping them in registers
+
+    Returns:
+        int: number of statements and parameters removed
+    """
+    tree = DominatorTree(function)
+    blocks = { block.name: block for block in function.blocks }
+
+    replacements: Dict[int, int] = dict()
+    available: Dict[Tuple[Any, ...], int] = dict()
+    literals: Dict[int, Tuple[Any, ...]] = dict()
+
+    def resolve(version: int) -> int:
+        while version in replacements:
+            version = replacements[version]
+
+        return version
+
+    def number(version: int) -> Any:
+        return literals.get(version, version)
+
+    count = 0
+
+    def visit(block: IRBlock) -> None:
+        nonlocal count
+
+        added = list()
+        statements = list()
+        compare = None
+
+        for stmt in block.statements:
+            stmt.replace_uses({ version: resolve(version) for version in stmt.uses() })
+
+            if isinstance(stmt, IRCompareOp):
+                compare = stmt
+                statements.append(stmt)
+                continue
+
+            if isinstance(stmt, IRMoveOp):
+                replacements[stmt.version] = stmt.operand
+                count += 1
+                continue
+
+            if isinstance(stmt, IRLiteral):
+                literals[stmt.version] = _literal_number(stmt)
+                statements.append(stmt)
+                continue
+
+            key = _value_key(stmt, compare if isinstance(stmt, IRCMovOp) else None, number)
+
+            if key is not None and key in available:
+                replacements[stmt.version] = available[key]
+                count += 1
+
+                # The compare only sets the flags of the selection
+                if isinstance(stmt, IRCMovOp):
+                    statements.pop()
+
+                continue
+
+            if key is not None:
+                available[key] = stmt.version
+                added.append(key)
+
+            statements.append(stmt)
+
+        block.statements = statements
+
+        if block.terminator is not None:
+            block.terminator.replace_uses({ version: resolve(version) for version in block.terminator.uses() })
+
+        for child in tree.children[block.name]:
+            visit(blocks[child])
+
+        for key in added:
+            del available[key]
+
+    visit(function.blocks[0])
+
+    # Arguments of back edges are only known once the whole function has been visited
+    changed = True
+
+    while changed:
+        _replace_everywhere(function, { version: resolve(version) for version in list(replacements) })
+
+        changed = False
+
+        for block in function.blocks:
+            for i in reversed(range(len(block.parameters))):
+                parameter = block.parameters[i]
+                values = set(arguments[i] for arguments in block.arguments.values()) - { parameter }
+
+                if len(values) != 1:
+                    continue
+
+                replacements[parameter] = values.pop()
+                block.parameters.pop(i)
+
+                for arguments in block.arguments.values():
+                    arguments.pop(i)
+
+                count += 1
+                changed = True
+
+            if len(block.parameters) == 0:
+                block.arguments = dict()
+
+    return count
@@ -0,0 +1,188 @@
+import copy
+
+from typing import Dict, List, Tuple
+
+from ._ir import *
+from ._op import *
+from ._type import *
+
+# Callees up to this number of statements are inlined, larger ones keep their call
+MAX_INLINE_STATEMENTS = 40
+
+# Number of statements the inlined callees may add to a function
+MAX_INLINE_GROWTH = 400
+
+# Callees inlining their own callees, bounded as each level builds the IR of its callees again
+MAX_INLINE_DEPTH = 3
+
+def inline_size(function: IRFunction) -> int:
+    return sum(1 for block in function.blocks for stmt in block.statements if not isinstance(stmt, IRVariable))
+
+def _is_recursive(function: IRFunction) -> bool:
+    return any(isinstance(stmt, IRFuncOp) and stmt.symbol == function.name
+               for block in function.blocks for stmt in block.statements)
+
+def _copy_statement(stmt: IRStatement, mapping: Dict[int, int]) -> IRStatement:
+    stmt = copy.copy(stmt)
+    stmt.replace_uses(mapping)
+
+    if stmt.version is not None:
+        stmt.version = mapping[stmt.version]
+
+    return stmt
+
+class _Inliner():
+
+    def __init__(self, ir: IR, callee_ir: IR, callee: IRFunction, call: IRFuncOp) -> None:
+        self._ir = ir
+        self._callee_ir = callee_ir
+        self._callee = callee
+        self._call = call
+
+        self.mapping: Dict[int, int] = dict()
+
+    def _version(self, version: int) -> int:
+        if version not in self.mapping:
+            self.mapping[version] = self._ir.new_version("_inl", self._callee_ir.get_version_type(version))
+
+        return self.mapping[version]
+
+    def bind_arguments(self) -> List[IRStatement]:
+        """
+        Moves of the arguments to the parameters of the callee. Arrays cannot be assigned, they are read in place
+        """
+        statements = list()
+        args = iter(self._call.args)
+
+        for name, type in self._callee.parameters.items():
+            version = self._callee.parameter_versions[name]
+            arg = next(args)
+
+            if isinstance(type, ArrayType):
+                self.mapping[version] = arg
+                self.mapping[self._callee.array_lengths[version]] = next(args)
+            else:
+                statements.append(IRMoveOp(self._version(version), arg, type))
+
+        return statements
+
+    def copy_statements(self, block: IRBlock) -> List[IRStatement]:
+        statements = list()
+
+        for stmt in block.statements:
+            # Declarations carry nothing the caller needs, the types of the versions are held by the IR
+            if isinstance(stmt, IRVariable):
+                continue
+
+            # Compares do not define their version, they set the flags
+            for version in stmt.uses() + ([stmt.version] if stmt.version is not None else []):
+                self._version(version)
+
+            statements.append(_copy_statement(stmt, self.mapping))
+
+        return statements
+
+    def return_value(self, terminator: IRReturn) -> List[IRStatement]:
+        if terminator.value is None or self._call.func.return_type == TypeVoid:
+            return []
+
+        return [IRMoveOp(self._call.version, self._version(terminator.value), self._call.func.return_type)]
+
+def _inline_call(ir: IR,
+                 function: IRFunction,
+                 block: IRBlock,
+                 index: int,
+                 callee_ir: IR,
+                 callee: IRFunction,
+                 count: int) -> None:
+    call = block.statements[index]
+    inliner = _Inliner(ir, callee_ir, callee, call)
+
+    head = block.statements[:index] + inliner.bind_arguments()
+    tail = block.statements[index + 1:]
+
+    # Straight-line callees are spliced in the block of the call
+    if len(callee.blocks) == 1 and isinstance(callee.blocks[0].terminator, IRReturn):
+        body = inliner.copy_statements(callee.blocks[0])
+        block.statements = head + body + inliner.return_value(callee.blocks[0].terminator) + tail
+        return
+
+    names = set(other.name for other in function.blocks)
+
+    def unique(name: str) -> str:
+        while name in names:
+            name = f"{name}_{len(names)}"
+
+        names.add(name)
+
+        return name
+
+    # The statements following the call move to a block reached by the returns of the callee
+    tail_block = IRBlock(unique(f"{block.name}_ret{count}"), statements=tail, terminator=block.terminator)
+
+    copies = { callee_block.name: IRBlock(unique(f"inl{count}_{callee_block.name}")) for callee_block in callee.blocks }
+
+    for callee_block in callee.blocks:
+        copied = copies[callee_block.name]
+        copied.statements = inliner.copy_statements(callee_block)
+        terminator = callee_block.terminator
+
+        if isinstance(terminator, IRReturn):
+            copied.statements.extend(inliner.return_value(terminator))
+            copied.terminator = IRJump(tail_block, None)
+        elif isinstance(terminator, IRJump):
+            copied.terminator = IRJump(copies[terminator.block.name], terminator.comp)
+
+    # The last block of the callee cannot fall through its end, a function without a final return returns None
+    last = copies[callee.blocks[-1].name]
+
+    if last.terminator is None:
+        last.terminator = IRJump(tail_block, None)
+
+    block.statements = head
+    block.terminator = None
+
+    position = function.blocks.index(block) + 1
+    function.blocks[position:position] = [copies[callee_block.name] for callee_block in callee.blocks] + [tail_block]
+
+def inline_calls(ir: IR, function: IRFunction, callees: Dict[str, Tuple[IR, IRFunction]]) -> int:
+    """
+    Replaces the calls of function to the jitted functions found in callees, indexed by symbol, by a copy of
+    their IR with renumbered versions. Both are taken before SSA construction, so that the following passes
+    see through the callees. Only the callees up to MAX_INLINE_STATEMENTS statements are inlined, until the
+    function has grown by MAX_INLINE_GROWTH statements
+
+    Returns:
+        int: number of calls inlined
+    """
+    count = 0
+    growth = 0
+
+    changed = True
+
+    while changed:
+        changed = False
+
+        for block in function.blocks:
+            for i, stmt in enumerate(block.statements):
+                if not isinstance(stmt, IRFuncOp) or stmt.symbol not in callees:
+                    continue
+
+                callee_ir, callee = callees[stmt.symbol]
+                size = inline_size(callee)
+
+                # The calls of recursive callees to themselves would need their address
+                if size > MAX_INLINE_STATEMENTS or growth + size > MAX_INLINE_GROWTH or _is_recursive(callee):
+                    continue
+
+                _inline_call(ir, function, block, i, callee_ir, callee, count)
+
+                count += 1
+                growth += size
+                changed = True
+                break
+
+            if changed:
+                break
+
+    return count
@@ -8,6 +8,9 @@ from typing import List, Optional, Union, Dict, Any, Tuple
 from ._op import *
 from ._type import *
 from ._symtable import SymbolTable, FunctionDef
+from ._builtin import get_intrinsic_return_type
+from ._kernels import KERNEL_REGISTERS
+from ._log import print_generic_error
 
 @dataclass
 class IRStatement():
@@ -20,6 +23,24 @@ class IRStatement():
     def print(self, indent_size: int, depth: int) -> None:
         raise NotImplementedError
 
+    def defines(self) -> List[int]:
+        """
+        Versions written by this statement
+        """
+        return [self.version] if self.version is not None else []
+
+    def uses(self) -> List[int]:
+        """
+        Versions read by this statement
+        """
+        return []
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        """
+        Renames the versions read by this statement found in mapping
+        """
+        pass
+
 @dataclass
 class IRTerminator():
     """
@@ -29,22 +50,35 @@ class IRTerminator():
     def print(self, indent_size: int, depth: int) -> None:
         raise NotImplementedError
 
+    def uses(self) -> List[int]:
+        return []
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        pass
+
 @dataclass
 class IRBlock():
     """
-    Base class for an IRBlock, consisting of parameters, statements and a terminator
+    Base class for an IRBlock, consisting of parameters, statements and a terminator. In SSA form, parameters
+    are the versions merging the values coming from the predecessors at the start of the block, and arguments
+    the versions passed to them by each predecessor, indexed by its name
     """
     
     name: str
-    parameters: List[str] = field(default_factory=list)
+    parameters: List[int] = field(default_factory=list)
     statements: List[IRStatement] = field(default_factory=list)
     terminator: Optional[IRTerminator] = None
+    arguments: Dict[str, List[int]] = field(default_factory=dict)
 
     def print(self, indent_size: int, depth: int) -> None:
-        parameters_str = ', '.join(self.parameters) if self.parameters is not None else ""
+        parameters_str = ', '.join(f"%{parameter}" for parameter in self.parameters)
 
         print(" " * indent_size * depth, f"BLOCK {self.name} ({parameters_str})")
 
+        for name, arguments in self.arguments.items():
+            arguments_str = ', '.join(f"%{argument}" for argument in arguments)
+            print(" " * indent_size * (depth + 1), f"from {name} ({arguments_str})")
+
         for stmt in self.statements:
             stmt.print(indent_size, depth + 1)
 
@@ -62,6 +96,74 @@ class IRFunction():
     parameters: Dict[str, Type] = field(default_factory=dict)
     blocks: List[IRBlock] = field(default_factory=list)
 
+    # Version holding each parameter, arrays also carry a hidden version holding their length
+    parameter_versions: Dict[str, int] = field(default_factory=dict)
+    array_lengths: Dict[int, int] = field(default_factory=dict)
+
+    def successors(self, block: IRBlock) -> List[IRBlock]:
+        """
+        Blocks control can flow to at the end of block, conditional jumps fall through the next block
+        """
+        index = self.blocks.index(block)
+        next_block = self.blocks[index + 1] if index + 1 < len(self.blocks) else None
+
+        if isinstance(block.terminator, IRReturn):
+            return []
+
+        if isinstance(block.terminator, IRJump):
+            if block.terminator.comp is None or next_block is None:
+                return [block.terminator.block]
+
+            return [block.terminator.block, next_block]
+
+        return [next_block] if next_block is not None else []
+
+    def predecessors(self) -> Dict[str, List[IRBlock]]:
+        """
+        Blocks control can flow from to the start of every block, indexed by block name
+        """
+        predecessors = { block.name: list() for block in self.blocks }
+
+        for block in self.blocks:
+            for successor in self.successors(block):
+                if block not in predecessors[successor.name]:
+                    predecessors[successor.name].append(block)
+
+        return predecessors
+
+    def prune_unreachable_blocks(self) -> None:
+        """
+        Removes the blocks control cannot flow to from the entry block
+        """
+        reachable = set()
+        worklist = [self.blocks[0]]
+
+        while len(worklist) > 0:
+            block = worklist.pop()
+
+            if block.name in reachable:
+                continue
+
+            reachable.add(block.name)
+            worklist.extend(self.successors(block))
+
+        # A reachable block cannot fall through an unreachable one, so removing them keeps the layout valid
+        self.blocks = [block for block in self.blocks if block.name in reachable]
+
+    def loop_guard(self, header: IRBlock) -> Optional[IRBlock]:
+        """
+        Block testing the range of a loop built by IRBuilder.visit_For before falling through its header, either
+        directly or through the preheaders only entered from the block before them
+        """
+        predecessors = self.predecessors()
+        index = self.blocks.index(header) - 1
+
+        while index > 0 and self.blocks[index].terminator is None and \
+              predecessors[self.blocks[index].name] == [self.blocks[index - 1]]:
+            index -= 1
+
+        return self.blocks[index] if index >= 0 else None
+
     def print(self, indent_size: int, depth: int) -> None:
         parameters_str = ', '.join([f"{name}: {type.ir_repr()}" for name, type in self.parameters.items()])
 
@@ -93,6 +195,10 @@ class IRVariable(IRStatement):
     def print(self, indent_size: int, depth: int) -> None:
         print(" " * indent_size * depth, f"%{self.version} = {self.type.ir_repr()} {self.name}")
 
+    def defines(self) -> List[int]:
+        # Declaration only, parameters are defined on function entry
+        return []
+
 @dataclass
 class IRLiteral(IRStatement):
     """
@@ -108,16 +214,46 @@ class IRLiteral(IRStatement):
 
 # IR Ops
 
+@dataclass
+class IRMoveOp(IRStatement):
+    """
+    Copy of a version into another one (assignments)
+    """
+
+    operand: int
+    type: Type
+
+    def print(self, indent_size: int, depth: int) -> None:
+        print(" " * indent_size * depth,
+              f"%{self.version} = {self.type.ir_repr()} mov %{self.operand}")
+
+    def uses(self) -> List[int]:
+        return [self.operand]
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        self.operand = mapping.get(self.operand, self.operand)
+
 @dataclass
 class IrMemLoadOp(IRStatement):
     
     base_ptr: int
     type: Type
     offset: int
+    length: Optional[int] = None # Version of the array length to check the offset against, None if unchecked
 
     def print(self, indent_size: int, depth: int) -> None:
+        bounds_str = f" bounds %{self.length}" if self.length is not None else ""
+
         print(" " * indent_size * depth,
-              f"%{self.version} = {self.type.ir_repr()} memload %{self.base_ptr}[%{self.offset}]")
+              f"%{self.version} = {self.type.ir_repr()} memload %{self.base_ptr}[%{self.offset}]{bounds_str}")
+
+    def uses(self) -> List[int]:
+        return [self.base_ptr, self.offset] + ([self.length] if self.length is not None else [])
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        self.base_ptr = mapping.get(self.base_ptr, self.base_ptr)
+        self.offset = mapping.get(self.offset, self.offset)
+        self.length = mapping.get(self.length, self.length)
 
 @dataclass
 class IRCastOp(IRStatement):
@@ -130,14 +266,35 @@ class IRCastOp(IRStatement):
         print(" " * indent_size * depth, 
               f"%{self.version} = {self.type_to.ir_repr()} cast %{self.operand}")
 
+    def uses(self) -> List[int]:
+        return [self.operand]
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        self.operand = mapping.get(self.operand, self.operand)
+
 @dataclass
 class IRUnaryOp(IRStatement):
+    """
+    Unary operation, or function of the math module lowered to one. With fastmath, the transcendental ones are
+    computed by the kernels of venom instead of the libm
+    """
 
     op: UnaryOpType
     operand: int
+    type: Type
+    fastmath: bool = False
 
     def print(self, indent_size: int, depth: int) -> None:
-        pass
+        name = f"{unop_to_string(self.op)}{'.fast' if self.fastmath else ''}"
+
+        print(" " * indent_size * depth,
+              f"%{self.version} = {self.type.ir_repr()} {name} %{self.operand}")
+
+    def uses(self) -> List[int]:
+        return [self.operand]
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        self.operand = mapping.get(self.operand, self.operand)
 
 @dataclass
 class IRBinaryOp(IRStatement):
@@ -151,8 +308,47 @@ class IRBinaryOp(IRStatement):
         print(" " * indent_size * depth, 
               f"%{self.version} = {self.type.ir_repr()} {binop_to_string(self.op)} %{self.left} %{self.right}")
 
+    def uses(self) -> List[int]:
+        return [self.left, self.right]
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        self.left = mapping.get(self.left, self.left)
+        self.right = mapping.get(self.right, self.right)
+
+@dataclass
+class IRFmaOp(IRStatement):
+    """
+    Fused multiply-add: left * right + addend rounded once, the product and the addend being negated when
+    asked. Only built for the functions compiled with fastmath, on CPUs supporting FMA
+    """
+
+    left: int
+    right: int
+    addend: int
+    type: Type
+    negate_product: bool = False
+    negate_addend: bool = False
+
+    def print(self, indent_size: int, depth: int) -> None:
+        product = f"{'-' if self.negate_product else ''}%{self.left} * %{self.right}"
+
+        print(" " * indent_size * depth,
+              f"%{self.version} = {self.type.ir_repr()} fma {product} {'-' if self.negate_addend else '+'} %{self.addend}")
+
+    def uses(self) -> List[int]:
+        return [self.left, self.right, self.addend]
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        self.left = mapping.get(self.left, self.left)
+        self.right = mapping.get(self.right, self.right)
+        self.addend = mapping.get(self.addend, self.addend)
+
 @dataclass
 class IRCompareOp(IRStatement):
+    """
+    Compares two versions and sets the flags read by the following IRCMovOp or block IRJump. A compare is
+    always immediately followed by its consumer: nothing can be scheduled in between
+    """
     
     left: int
     right: int
@@ -162,6 +358,17 @@ class IRCompareOp(IRStatement):
         print(" " * indent_size * depth,
               f"cmp {self.type.ir_repr()} %{self.left}, %{self.right}")
 
+    def defines(self) -> List[int]:
+        # Only the flags are written
+        return []
+
+    def uses(self) -> List[int]:
+        return [self.left, self.right]
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        self.left = mapping.get(self.left, self.left)
+        self.right = mapping.get(self.right, self.right)
+
 @dataclass
 class IRCMovOp(IRStatement):
     
@@ -174,6 +381,13 @@ class IRCMovOp(IRStatement):
         print(" " * indent_size * depth,
               f"%{self.version} = {self.type.ir_repr()} cmov %{self.true_val}, %{self.false_val} {compareop_to_ir_string(self.op)}")
 
+    def uses(self) -> List[int]:
+        return [self.true_val, self.false_val]
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        self.true_val = mapping.get(self.true_val, self.true_val)
+        self.false_val = mapping.get(self.false_val, self.false_val)
+
 @dataclass
 class IRTernaryOp(IRStatement):
 
@@ -188,16 +402,36 @@ class IRTernaryOp(IRStatement):
         print(" " * indent_size * depth,
               f"%{self.version} = {self.type.ir_repr()} cmov ")
 
+    def uses(self) -> List[int]:
+        return [self.left, self.right, self.true_val, self.false_val]
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        self.left = mapping.get(self.left, self.left)
+        self.right = mapping.get(self.right, self.right)
+        self.true_val = mapping.get(self.true_val, self.true_val)
+        self.false_val = mapping.get(self.false_val, self.false_val)
+
 @dataclass
 class IRFuncOp(IRStatement):
+    """
+    Call to func. Calls to other jitted functions have the symbol of their native code, and pass arrays as
+    their pointer followed by their length
+    """
 
     func: FunctionType
     args: List[int]
+    symbol: Optional[str] = None
 
     def print(self, indent_size: int, depth: int) -> None:
         print(" " * indent_size * depth,
               f"%{self.version} = {self.func.return_type.ir_repr()} call {self.func.mangled_name()}({','.join(f'%{arg}' for arg in self.args)})")
 
+    def uses(self) -> List[int]:
+        return list(self.args)
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        self.args = [mapping.get(arg, arg) for arg in self.args]
+
 @dataclass
 class IRIncOp(IRStatement):
     
@@ -206,7 +440,13 @@ class IRIncOp(IRStatement):
 
     def print(self, indent_size: int, depth: int) -> None:
         print(" " * indent_size * depth,
-              f"%{self.operand} = {self.type.ir_repr()} inc %{self.operand}")
+              f"%{self.version} = {self.type.ir_repr()} inc %{self.operand}")
+
+    def uses(self) -> List[int]:
+        return [self.operand]
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        self.operand = mapping.get(self.operand, self.operand)
 
 @dataclass
 class IRDecOp(IRStatement):
@@ -216,7 +456,181 @@ class IRDecOp(IRStatement):
 
     def print(self, indent_size: int, depth: int) -> None:
         print(" " * indent_size * depth,
-              f"%{self.operand} = {self.type.ir_repr()} dec %{self.operand}")
+              f"%{self.version} = {self.type.ir_repr()} dec %{self.operand}")
+
+    def uses(self) -> List[int]:
+        return [self.operand]
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        self.operand = mapping.get(self.operand, self.operand)
+
+@dataclass
+class IRBoundsCheck(IRStatement):
+    """
+    Checks ahead of a loop running index from its current value up to stop that all the values are valid
+    offsets in the arrays of the given lengths. Bails out unless the range is empty or 0 <= index and
+    stop <= length, the interpreter then raises the error
+    """
+
+    index: int
+    stop: int
+    lengths: List[int]
+
+    def print(self, indent_size: int, depth: int) -> None:
+        lengths_str = ', '.join(f"%{length}" for length in self.lengths)
+
+        print(" " * indent_size * depth, f"boundscheck %{self.index} < %{self.stop} within {lengths_str}")
+
+    def uses(self) -> List[int]:
+        return [self.index, self.stop] + self.lengths
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        self.index = mapping.get(self.index, self.index)
+        self.stop = mapping.get(self.stop, self.stop)
+        self.lengths = [mapping.get(length, length) for length in self.lengths]
+
+@dataclass
+class IROverflowCheck(IRStatement):
+    """
+    Checks the result of a power computed by multiplications, or by the reciprocal of their product: bails out
+    if value is infinite while base is finite, the interpreter then raises the OverflowError of pow
+    """
+
+    value: int
+    base: int
+
+    def print(self, indent_size: int, depth: int) -> None:
+        print(" " * indent_size * depth, f"overflowcheck %{self.value} from %{self.base}")
+
+    def uses(self) -> List[int]:
+        return [self.value, self.base]
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        self.value = mapping.get(self.value, self.value)
+        self.base = mapping.get(self.base, self.base)
+
+@dataclass
+class IRVectorLoop(IRStatement):
+    """
+    Runs the iterations of a counted loop by groups of packed lanes, advancing index as long as a whole group
+    fits below stop. body holds the element statements (loads at [index], literals, moves and arithmetic) and
+    reductions the statements folding their values into the accumulators. The remaining iterations are left
+    to the scalar loop following it. Float reductions are accumulated in order unless reassociate is set
+    """
+
+    index: int
+    stop: int
+    body: List[IRStatement]
+    reductions: List[IRBinaryOp]
+    reassociate: bool = False
+
+    def print(self, indent_size: int, depth: int) -> None:
+        defined = ', '.join(f"%{version}" for version in self.defines())
+
+        print(" " * indent_size * depth, f"{defined} = vector loop %{self.index} < %{self.stop}")
+
+        for stmt in self.body + self.reductions:
+            stmt.print(indent_size, depth + 1)
+
+    def defines(self) -> List[int]:
+        return [self.index] + [reduction.version for reduction in self.reductions]
+
+    def uses(self) -> List[int]:
+        # Element versions are local to the vector loop, only the values coming from outside are read
+        local = set(stmt.version for stmt in self.body)
+        uses = [self.index, self.stop]
+
+        for stmt in self.body + self.reductions:
+            uses.extend(version for version in stmt.uses() if version not in local and version not in uses)
+
+        return uses
+
+    def invariants(self) -> List[int]:
+        """
+        Versions coming from outside of the loop used as lane operands, they are broadcast to every lane
+        """
+        local = set(stmt.version for stmt in self.body)
+        invariants = list()
+
+        operands = [reduction.right for reduction in self.reductions]
+
+        for stmt in self.body:
+            if isinstance(stmt, (IRMoveOp, IRUnaryOp)):
+                operands.append(stmt.operand)
+            elif isinstance(stmt, IRBinaryOp):
+                operands.extend([stmt.left, stmt.right])
+
+        for version in operands:
+            if version not in local and version not in invariants:
+                invariants.append(version)
+
+        return invariants
+
+    def checks_overflow(self) -> bool:
+        """
+        Returns True if lanes can require a bailout: integer additions and subtractions overflowing, square
+        roots of negative values and the arguments the math kernels flag
+        """
+        return any((isinstance(stmt, IRBinaryOp) and stmt.type in (TypeInt64, TypeInt32) and stmt.op in (BinaryOpType.Add, BinaryOpType.Sub)) or
+                   (isinstance(stmt, IRUnaryOp) and stmt.op in (UnaryOpType.Sqrt,) + TRANSCENDENTAL_OPS)
+                   for stmt in self.body + self.reductions)
+
+    def accumulates_in_lanes(self, reduction: IRBinaryOp) -> bool:
+        """
+        Returns True if reduction keeps one accumulator per lane, combined after the loop
+        """
+        return type_rank(reduction.type) != 3 or self.reassociate
+
+    def fused_products(self) -> Dict[int, IRBinaryOp]:
+        """
+        Multiplications of the body only read by a reassociated float reduction adding or subtracting them,
+        indexed by the version of the reduction. They can be fused with it
+        """
+        products = dict()
+
+        for reduction in self.reductions:
+            if not self.reassociate or type_rank(reduction.type) != 3 or reduction.op not in (BinaryOpType.Add, BinaryOpType.Sub):
+                continue
+
+            product = next((stmt for stmt in self.body if stmt.version == reduction.right), None)
+
+            if not isinstance(product, IRBinaryOp) or product.op != BinaryOpType.Mul or product.type != reduction.type:
+                continue
+
+            readers = [stmt for stmt in self.body + self.reductions if reduction.right in stmt.uses()]
+
+            if readers == [reduction]:
+                products[reduction.version] = product
+
+        return products
+
+    def width(self) -> int:
+        """
+        Number of lanes per register, 4 when the loop runs on 32 bits values and 2 on 64 bits ones
+        """
+        return 4 if self.reductions[0].type in (TypeInt32, TypeFloat32) else 2
+
+    def num_vector_registers(self, unroll: int) -> int:
+        """
+        Number of xmm registers needed to run unroll groups of lanes per iteration: one per element version and
+        invariant, unroll per accumulator kept in lanes and one per other float accumulator, plus the overflow
+        mask and a temporary. Math kernels take xmm14 and xmm15 and the other registers they need
+        """
+        elements = set(stmt.version for stmt in self.body if not isinstance(stmt, IRLiteral))
+        registers = len(elements) + len(self.invariants())
+
+        for reduction in self.reductions:
+            registers += unroll if self.accumulates_in_lanes(reduction) else 1
+
+        return registers + (2 if self.checks_overflow() else 0) + max(self.kernel_registers(), default=0)
+
+    def kernel_registers(self) -> List[int]:
+        """
+        Registers taken by each math kernel of the body beside xmm14 and xmm15, single precision lanes being
+        split in two halves of doubles
+        """
+        return [KERNEL_REGISTERS[stmt.op] - 2 + (1 if stmt.type == TypeFloat32 else 0)
+                for stmt in self.body if isinstance(stmt, IRUnaryOp) and stmt.op in TRANSCENDENTAL_OPS]
 
 # IR Terminators
 
@@ -231,17 +645,42 @@ class IRReturn(IRTerminator):
         else:
             print(" " * indent_size * depth, f"return %{self.value}")
 
+    def uses(self) -> List[int]:
+        return [self.value] if self.value is not None else []
+
+    def replace_uses(self, mapping: Dict[int, int]) -> None:
+        self.value = mapping.get(self.value, self.value)
+
 @dataclass
 class IRJump(IRTerminator):
+    """
+    Jumps to block if the last compare of the block satisfies comp, otherwise falls through the next block.
+    If comp is None, the jump is unconditional
+    """
     
     block: IRBlock
-    comp: CompareOpType
+    comp: Optional[CompareOpType]
 
     def print(self, indent_size: int, depth: int) -> None:
-        print(" " * indent_size * depth, f"jump {self.block.name} {compareop_to_ir_string(self.comp)}")
+        if self.comp is None:
+            print(" " * indent_size * depth, f"jump {self.block.name}")
+        else:
+            print(" " * indent_size * depth, f"jump {self.block.name} {compareop_to_ir_string(self.comp)}")
 
 # IR AST Visitor
 
+# Intrinsics taking one argument converted to their return type
+_intrinsic_unary_ops = {
+    "abs": UnaryOpType.Abs,
+    "math.fabs": UnaryOpType.Abs,
+    "math.sqrt": UnaryOpType.Sqrt,
+    "math.exp": UnaryOpType.Exp,
+    "math.log": UnaryOpType.Log,
+    "math.sin": UnaryOpType.Sin,
+    "math.cos": UnaryOpType.Cos,
+    "math.tanh": UnaryOpType.Tanh,
+}
+
 class IRBuilder(ast.NodeVisitor):
     
     def __init__(self, ir: "IR", symtable: SymbolTable) -> None:
@@ -262,6 +701,8 @@ class IRBuilder(ast.NodeVisitor):
     def _error(self, err: str) -> None:
         self._has_error = True
 
+        print_generic_error(err)
+
     def has_error(self) -> bool:
         return self._has_error
 
@@ -275,7 +716,13 @@ class IRBuilder(ast.NodeVisitor):
         return self._classes
 
     def new_block(self, name: str, parameters: Optional[List[int]] = None) -> IRBlock:
-        block = IRBlock(name, parameters)
+        blocks = self._current_function.blocks if self._current_function is not None else self._blocks
+
+        # Block names are used as labels, they need to be unique
+        if any(block.name == name for block in blocks):
+            name = f"{name}_{len(blocks)}"
+
+        block = IRBlock(name, parameters if parameters is not None else list())
 
         # No IRBlocks inside classes
         if self._current_function is not None:
@@ -303,21 +750,64 @@ class IRBuilder(ast.NodeVisitor):
             right_rank = type_rank(right_type)
             
             if left_rank > 0 and right_rank > 0:
-                if left_rank > right_rank:
-                    cast_version = self._ir.new_version("_cast", left_type)
-                    cast_stmt = IRCastOp(cast_version, version_right, right_type, left_type)
-                    self.emit(cast_stmt)
-                    version_right = cast_version
-                elif right_rank > left_rank:
-                    cast_version = self._ir.new_version("_cast", right_type)
-                    cast_stmt = IRCastOp(cast_version, version_left, left_type, right_type)
-                    self.emit(cast_stmt)
-                    version_left = cast_version
-                    final_type = right_type
-            # TODO: If types are incompatible for casting, error
+                final_type = max(left_type, right_type, key=type_order)
+                version_left = self._cast_to(version_left, final_type)
+                version_right = self._cast_to(version_right, final_type)
+            else:
+                self._error(f"incompatible types: {left_type} and {right_type}")
 
         return version_left, version_right, final_type
 
+    def _cast_to(self, version: int, type: Type) -> int:
+        version_type = self._ir.get_version_type(version)
+
+        if version_type == type:
+            return version
+
+        if type_rank(version_type) == 0 or type_rank(type) == 0:
+            self._error(f"cannot cast {version_type} to {type}")
+            return version
+
+        cast_version = self._ir.new_version("_cast", type)
+        cast_stmt = IRCastOp(cast_version, version, version_type, type)
+        self.emit(cast_stmt)
+
+        return cast_version
+
+    def _binary_op(self, op: BinaryOpType, left: int, right: int, version: Optional[int] = None) -> int:
+        left, right, final_type = self._cast_types(left, right)
+
+        # True division always produces a float
+        if op == BinaryOpType.Div and type_rank(final_type) != 3:
+            final_type = self._symtable.precision().float_type
+            left = self._cast_to(left, final_type)
+            right = self._cast_to(right, final_type)
+
+        if version is None or self._ir.get_version_type(version) != final_type:
+            result = self._ir.new_version("_tmp", final_type)
+            stmt = IRBinaryOp(result, op, left, right, final_type)
+            self.emit(stmt)
+
+            if version is None:
+                return result
+
+            # The result needs to be cast to the type of the destination
+            result_type = self._ir.get_version_type(version)
+            stmt = IRMoveOp(version, self._cast_to(result, result_type), result_type)
+            self.emit(stmt)
+
+            return version
+
+        stmt = IRBinaryOp(version, op, left, right, final_type)
+        self.emit(stmt)
+
+        return version
+
+    # Visitors
+
+    def generic_visit(self, node: ast.AST) -> None:
+        self._error(f"unsupported syntax: {type(node).__name__} (line {getattr(node, 'lineno', '?')})")
+
     def visit_FunctionDef(self, node: ast.FunctionDef) -> None:
         func_symbol = self._symtable.resolve_symbol(node.name)
 
@@ -327,6 +817,7 @@ class IRBuilder(ast.NodeVisitor):
 
         for name, func_type in func_symbol.specializations.items():
             self._symtable.set_scope(node.name)
+            self._ir.clear_variables()
 
             func = IRFunction(name, func_type.return_type, func_type.args)
             self._current_function = func
@@ -334,13 +825,37 @@ class IRBuilder(ast.NodeVisitor):
             self._functions.append(func)
             entry_block = self.new_block(f"body{node.lineno}")
 
+            # Parameters are declared upfront, in the order of the calling convention
+            for arg_name, arg_type in func_type.args.items():
+                version = self._ir.new_version(arg_name, arg_type)
+                self.emit(IRVariable(version, arg_name, arg_type))
+                func.parameter_versions[arg_name] = version
+
+                if isinstance(arg_type, ArrayType):
+                    length_name = f"len({arg_name})"
+                    length_version = self._ir.new_version(length_name, TypeInt64)
+                    self.emit(IRVariable(length_version, length_name, TypeInt64))
+                    func.array_lengths[version] = length_version
+
             for stmt in node.body:
                 self.visit(stmt)
 
+            func.prune_unreachable_blocks()
+
             self._current_function = None
 
             self._symtable.pop_scope()
 
+    def visit_Pass(self, node: ast.Pass) -> None:
+        pass
+
+    def visit_Expr(self, node: ast.Expr) -> None:
+        # Docstrings
+        if isinstance(node.value, ast.Constant) and isinstance(node.value.value, str):
+            return
+
+        self.visit(node.value)
+
     def visit_Name(self, node: ast.Name) -> int:
         sym = self._symtable.resolve_symbol(node.id)
         
@@ -354,10 +869,12 @@ class IRBuilder(ast.NodeVisitor):
         return version 
 
     def visit_Constant(self, node: ast.Constant) -> int:
-        node_type = pytype_to_type(type(node.value))
+        node_type = self._symtable.precision().literal_type(node.value)
         version = self._ir.new_version("_const", node_type)
 
-        stmt = IRLiteral(version, str(node.value), node_type, node.value)
+        value = to_float32(node.value) if node_type == TypeFloat32 else node.value
+
+        stmt = IRLiteral(version, str(value), node_type, value)
         self.emit(stmt)
 
         return version
@@ -367,8 +884,18 @@ class IRBuilder(ast.NodeVisitor):
         operand_type = self._ir.get_version_type(operand)
 
         op = ast_unop_to_unop(node)
+
+        if op == UnaryOpType.Not:
+            self._error("not operator is not supported yet")
+            return None
+
+        # Unary ops on bools operate on their integer value
+        if operand_type == TypeBool:
+            operand = self._cast_to(operand, TypeInt64)
+            operand_type = TypeInt64
+
         version = self._ir.new_version("_tmp", operand_type)
-        stmt = IRUnaryOp(version, op, operand)
+        stmt = IRUnaryOp(version, op, operand, operand_type)
         self.emit(stmt)
 
         return version
@@ -377,32 +904,107 @@ class IRBuilder(ast.NodeVisitor):
         left = self.visit(node.left)
         right = self.visit(node.right)
 
-        left, right, final_type = self._cast_types(left, right)
-        
-        op = ast_binop_to_binop(node)
-        version = self._ir.new_version("_tmp", final_type)
-        stmt = IRBinaryOp(version, op, left, right, final_type)
-        self.emit(stmt)
-        
-        return version
+        return self._binary_op(ast_binop_to_binop(node), left, right)
+
+    def visit_Assign(self, node: ast.Assign) -> None:
+        value = self.visit(node.value)
+
+        for target in node.targets:
+            if not isinstance(target, ast.Name):
+                self._error(f"unsupported assignment target: {type(target).__name__}")
+                return
+
+            target_version = self.visit_Name(target)
+            target_type = self._ir.get_version_type(target_version)
+
+            if not isinstance(target_type, PrimitiveType):
+                self._error(f"unsupported assignment of type {target_type} to \"{target.id}\"")
+                return
+
+            # Variables are typed once for the whole function, narrowing would not match Python semantics
+            if type_rank(self._ir.get_version_type(value)) > type_rank(target_type):
+                self._error(f"cannot assign {self._ir.get_version_type(value)} to \"{target.id}\" of type {target_type}")
+                return
+
+            stmt = IRMoveOp(target_version, self._cast_to(value, target_type), target_type)
+            self.emit(stmt)
+
+    def visit_AnnAssign(self, node: ast.AnnAssign) -> None:
+        if node.value is None:
+            return
+
+        self.visit_Assign(ast.Assign([node.target], node.value))
 
     def visit_AugAssign(self, node: ast.AugAssign) -> int:
+        if not isinstance(node.target, ast.Name):
+            self._error(f"unsupported assignment target: {type(node.target).__name__}")
+            return None
+
         target = self.visit(node.target)
         value = self.visit(node.value)
 
-        target, value, final_type = self._cast_types(target, value)
+        target_type = self._ir.get_version_type(target)
 
-        op = ast_binop_to_binop(node)
+        if type_rank(self._ir.get_version_type(value)) > type_rank(target_type):
+            self._error(f"cannot assign {self._ir.get_version_type(value)} to \"{node.target.id}\" of type {target_type}")
+            return None
 
-        stmt = IRBinaryOp(target, op, target, value, final_type)
-        self.emit(stmt)
+        return self._binary_op(ast_binop_to_binop(node), target, value, target)
 
-        return target
+    def _calls_function(self, node: ast.expr) -> bool:
+        return any(isinstance(child, ast.Call) and isinstance(child.func, ast.Name) and
+                   isinstance(self._symtable.resolve_symbol(child.func.id), FunctionDef) for child in ast.walk(node))
+
+    def _branch_if_exp(self, node: ast.IfExp) -> int:
+        """
+        Evaluates only the selected value, as the other one may call a function recursing endlessly or bailing out
+        """
+        op = ast_compareop_to_compareop(node.test)
+
+        left = self.visit(node.test.left)
+        right = self.visit(node.test.comparators[0])
+
+        left, right, cmp_type = self._cast_types(left, right)
+
+        cmp_version = self._ir.new_version("_tmp", TypeBool)
+        self.emit(IRCompareOp(cmp_version, left, right, cmp_type))
+        test_block = self._current_block
+
+        false_block = self.new_block(f"iffalse{node.lineno}")
+        false_val = self.visit(node.orelse)
+        false_end = self._current_block
+
+        true_block = self.new_block(f"iftrue{node.lineno}")
+        true_val = self.visit(node.body)
+
+        true_type = self._ir.get_version_type(true_val)
+        false_type = self._ir.get_version_type(false_val)
+        mov_type = true_type if type_order(true_type) >= type_order(false_type) else false_type
+
+        version = self._ir.new_version("_tmp", mov_type)
+
+        self.emit(IRMoveOp(version, self._cast_to(true_val, mov_type), mov_type))
+
+        self._current_block = false_end
+        self.emit(IRMoveOp(version, self._cast_to(false_val, mov_type), mov_type))
+
+        # The true branch ends with the last block built, and falls through the exit block
+        exit_block = self.new_block(f"ifexit{node.lineno}")
+        false_end.terminator = IRJump(exit_block, None)
+        test_block.terminator = IRJump(true_block, op)
+
+        return version
 
     def visit_IfExp(self, node: ast.IfExp) -> int:
+        if self._current_function is not None and (self._calls_function(node.body) or self._calls_function(node.orelse)):
+            return self._branch_if_exp(node)
+
         true_val = self.visit(node.body)
         false_val = self.visit(node.orelse)
 
+        # Casts are emitted first as the compare must be immediately followed by the cmov
+        true_val, false_val, mov_type = self._cast_types(true_val, false_val)
+
         # For now, since the test should be a compare as verified when building the symbol table 
         # and running the semantic analysis, and only one compare op should be present
         op = ast_compareop_to_compareop(node.test)
@@ -416,20 +1018,31 @@ class IRBuilder(ast.NodeVisitor):
         stmt = IRCompareOp(cmp_version, left, right, cmp_type)
         self.emit(stmt)
 
-        true_val, false_val, mov_type = self._cast_types(true_val, false_val)
-
         version = self._ir.new_version("_tmp", mov_type)
         stmt = IRCMovOp(version, op, true_val, false_val, mov_type)
         self.emit(stmt)
         
         return version
 
-    def visit_Return(self, node):
-        value = self.visit(node.value)
+    def visit_Return(self, node: ast.Return) -> None:
+        value = None
+
+        if node.value is not None:
+            value = self._cast_to(self.visit(node.value), self._current_function.return_type)
+
         self._current_block.terminator = IRReturn(value)
 
+        # Anything following a return is unreachable, and pruned once the function is built
+        self.new_block(f"dead{node.lineno}")
+
     def visit_Call(self, node: ast.Call) -> int:
+        intrinsic = self._symtable.resolve_intrinsic(node.func)
+
+        if intrinsic is not None:
+            return self._call_intrinsic(intrinsic, node.args)
+
         if not isinstance(node.func, ast.Name):
+            self._error(f"unsupported call: {type(node.func).__name__}")
             return None
 
         arg_versions = list()
@@ -439,7 +1052,34 @@ class IRBuilder(ast.NodeVisitor):
 
         arg_types = [self._ir.get_version_type(version) for version in arg_versions]
 
-        func_specializations = self._ir._symtable.get_builtin_specializations().get(node.func.id, list())
+        func_name = node.func.id
+
+        if func_name == "len" and len(arg_versions) == 1:
+            length = self._current_function.array_lengths.get(arg_versions[0])
+
+            if length is None:
+                self._error("len() is only supported on array parameters")
+                return None
+
+            version = self._ir.new_version("_tmp", TypeInt64)
+            stmt = IRMoveOp(version, length, TypeInt64)
+            self.emit(stmt)
+
+            return version
+
+        # Conversions builtins are casts
+        precision = self._symtable.precision()
+        conversions = { "float": precision.float_type, "int": precision.int_type, "bool": TypeBool }
+
+        if func_name in conversions and len(arg_versions) == 1:
+            return self._cast_to(arg_versions[0], conversions[func_name])
+
+        symbol = self._symtable.resolve_symbol(func_name)
+
+        if isinstance(symbol, FunctionDef):
+            return self._call_function(symbol, arg_versions, arg_types)
+
+        func_specializations = self._ir._symtable.get_builtin_specializations().get(func_name, list())
 
         func_specialization = None
 
@@ -449,6 +1089,7 @@ class IRBuilder(ast.NodeVisitor):
                 break
 
         if func_specialization is None:
+            self._error(f"unsupported call: {func_name}")
             return None
 
         version = self._ir.new_version("_tmp", func_specialization.return_type)
@@ -457,41 +1098,194 @@ class IRBuilder(ast.NodeVisitor):
 
         return version
 
+    def _call_intrinsic(self, name: str, args: List[ast.expr]) -> Optional[int]:
+        """
+        Lowers the builtins and functions of the math module having instructions of their own to operations
+        """
+        arg_versions = [self.visit(arg) for arg in args]
+        arg_types = [self._ir.get_version_type(version) for version in arg_versions]
+
+        return_type = get_intrinsic_return_type(name, arg_types, self._symtable.precision())
+
+        if return_type is None:
+            self._error(f"unsupported call: {name}")
+            return None
+
+        # min(a, b, c) is min(min(a, b), c), the first argument being kept unless another one is smaller
+        if name in ("min", "max"):
+            op = BinaryOpType.Min if name == "min" else BinaryOpType.Max
+            result = arg_versions[0]
+
+            for version in arg_versions[1:]:
+                result = self._binary_op(op, result, version)
+
+            return result
+
+        if name == "math.copysign":
+            return self._binary_op(BinaryOpType.CopySign,
+                                   self._cast_to(arg_versions[0], return_type),
+                                   self._cast_to(arg_versions[1], return_type))
+
+        operand = arg_versions[0]
+
+        # Ints are already integral, floats are rounded then converted, bailing out on infinities and NaN
+        if name in ("math.floor", "math.ceil"):
+            if type_rank(arg_types[0]) != 3:
+                return self._cast_to(operand, return_type)
+
+            rounded = self._ir.new_version("_tmp", arg_types[0])
+            op = UnaryOpType.Floor if name == "math.floor" else UnaryOpType.Ceil
+            self.emit(IRUnaryOp(rounded, op, operand, arg_types[0]))
+
+            return self._cast_to(rounded, return_type)
+
+        operand = self._cast_to(operand, return_type)
+
+        version = self._ir.new_version("_tmp", return_type)
+        op = _intrinsic_unary_ops[name]
+        fastmath = op in TRANSCENDENTAL_OPS and self._symtable.precision().fastmath
+        self.emit(IRUnaryOp(version, op, operand, return_type, fastmath))
+
+        return version
+
+    def _call_function(self, symbol: FunctionDef, arg_versions: List[int], arg_types: List[Type]) -> Optional[int]:
+        func_type = self._symtable.specialize_function(symbol, arg_types) if len(arg_types) == len(symbol.parameters) else None
+
+        if func_type is None:
+            self._error(f"cannot compile {symbol.name} for the arguments of the call")
+            return None
+
+        args = list()
+
+        for version in arg_versions:
+            args.append(version)
+
+            if isinstance(self._ir.get_version_type(version), ArrayType):
+                length = self._current_function.array_lengths.get(version)
+
+                if length is None:
+                    self._error("only array parameters can be passed to other functions")
+                    return None
+
+                args.append(length)
+
+        version = self._ir.new_version("_tmp", func_type.return_type)
+        self.emit(IRFuncOp(version, func_type, args, func_type.mangled_name()))
+
+        return version
+
     def visit_Subscript(self, node: ast.Subscript) -> int:
         value = self.visit(node.value)
         value_type = self._ir.get_version_type(value)
         offset = self.visit(node.slice)
 
         if not isinstance(value_type, ArrayType):
-            return
+            self._error(f"unsupported subscript on {value_type}")
+            return None
 
-        version = self._ir.new_version("_tmp", value_type.element_type)
-        stmt = IrMemLoadOp(version, value, value_type.element_type, offset)
+        length = self._current_function.array_lengths.get(value)
+
+        if length is None:
+            self._error("subscripts are only supported on array parameters")
+            return None
+
+        offset = self._cast_to(offset, TypeInt64)
+
+        # The load widens the element to the type Python gives to the value
+        version = self._ir.new_version("_tmp", array_value_type(value_type.element_type, self._symtable.precision()))
+        stmt = IrMemLoadOp(version, value, value_type.element_type, offset, length)
         self.emit(stmt)
 
         return version
 
+    def _range_step(self, node: ast.expr) -> Optional[int]:
+        if isinstance(node, ast.Constant) and type(node.value) is int:
+            return node.value
+
+        if isinstance(node, ast.UnaryOp) and isinstance(node.op, ast.USub):
+            step = self._range_step(node.operand)
+            return -step if step is not None else None
+
+        return None
+
     def visit_For(self, node: ast.For) -> None:
-        if isinstance(node.iter, ast.Call):
-            loop_target = self.visit(node.target)
-            loop_iter = self.visit(node.iter)
+        if not isinstance(node.iter, ast.Call) or \
+           not isinstance(node.iter.func, ast.Name) or \
+           node.iter.func.id != "range":
+            self._error("only for loops over range() are supported")
+            return
+
+        if not isinstance(node.target, ast.Name) or len(node.orelse) > 0:
+            self._error("unsupported for loop form")
+            return
 
-            loop_target, loop_iter, cmp_type = self._cast_types(loop_target, loop_iter)
+        range_args = node.iter.args
 
-            for_block = self.new_block(f"for{node.lineno}")
+        if len(range_args) < 1 or len(range_args) > 3:
+            self._error("range() expects between 1 and 3 arguments")
+            return
 
-            for stmt_body in node.body:
-                self.visit(stmt_body)
+        step = 1 if len(range_args) < 3 else self._range_step(range_args[2])
 
-            stmt = IRIncOp(None, loop_target, self._ir.get_version_type(loop_target))
-            self.emit(stmt)
+        if step is None or step == 0:
+            self._error("range() step must be a non-zero integer literal")
+            return
 
-            cmp_version = self._ir.new_version("_tmp", TypeBool)
-            stmt = IRCompareOp(cmp_version, loop_target, loop_iter, cmp_type)
-            self.emit(stmt)
-            for_block.terminator = IRJump(for_block, CompareOpType.Lt)
+        if len(range_args) == 1:
+            start = self.visit_Constant(ast.Constant(0))
+            stop = self.visit(range_args[0])
+        else:
+            start = self.visit(range_args[0])
+            stop = self.visit(range_args[1])
+
+        loop_target = self.visit(node.target)
+        loop_type = self._ir.get_version_type(loop_target)
+
+        start = self._cast_to(start, loop_type)
+        stop = self._cast_to(stop, loop_type)
+
+        # range() evaluates its bound once, copy it in case the variable is modified in the body
+        if isinstance(range_args[0 if len(range_args) == 1 else 1], ast.Name):
+            stop_copy = self._ir.new_version("_stop", loop_type)
+            self.emit(IRMoveOp(stop_copy, stop, loop_type))
+            stop = stop_copy
 
-            self.new_block(f"body{stmt_body.lineno + 1}")
+        # The loop variable is assigned from a hidden index at the top of each iteration, it keeps its value
+        # on empty ranges and holds the last value produced after the loop, as in Python
+        index = self._ir.new_version("_index", loop_type)
+        self.emit(IRMoveOp(index, start, loop_type))
+
+        continue_op = CompareOpType.Lt if step > 0 else CompareOpType.Gt
+        exit_op = CompareOpType.GtEq if step > 0 else CompareOpType.LtEq
+
+        # Skip the loop entirely if the range is empty
+        cmp_version = self._ir.new_version("_tmp", TypeBool)
+        self.emit(IRCompareOp(cmp_version, index, stop, loop_type))
+        guard_block = self._current_block
+
+        for_block = self.new_block(f"for{node.lineno}")
+        self.emit(IRMoveOp(loop_target, index, loop_type))
+
+        for stmt_body in node.body:
+            self.visit(stmt_body)
+
+        if step == 1:
+            stmt = IRIncOp(index, index, loop_type)
+        elif step == -1:
+            stmt = IRDecOp(index, index, loop_type)
+        else:
+            step_version = self.visit_Constant(ast.Constant(step))
+            stmt = IRBinaryOp(index, BinaryOpType.Add, index, step_version, loop_type)
+
+        self.emit(stmt)
+
+        cmp_version = self._ir.new_version("_tmp", TypeBool)
+        stmt = IRCompareOp(cmp_version, index, stop, loop_type)
+        self.emit(stmt)
+        self._current_block.terminator = IRJump(for_block, continue_op)
+
+        exit_block = self.new_block(f"body{stmt_body.end_lineno + 1}")
+        guard_block.terminator = IRJump(exit_block, exit_op)
 
 # IR 
 
@@ -520,6 +1314,12 @@ class IR():
     def get_version_type(self, version: int) -> Type:
         return self._version_types.get(version, TypeInvalid)
 
+    def clear_variables(self) -> None:
+        self._variables_versions.clear()
+
+    def get_functions(self) -> List[IRFunction]:
+        return self._functions
+
     def build(self, tree: ast.expr) -> bool:
         self._version_counter = 0
         self._variables_versions.clear()
@@ -531,6 +1331,8 @@ class IR():
         self._functions = ir_builder.get_functions()
         self._classes = ir_builder.get_classes()
 
+        return not ir_builder.has_error()
+
     def print(self, indent_size: int = 4) -> None:
         print("IR")
 
@@ -544,4 +1346,4 @@ class IR():
                 function.print(indent_size, 1)
 
         if len(self._blocks) > 0:
-            print("BLOCKS")
\ No newline at end of file
+            print("BLOCKS")
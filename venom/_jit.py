@@ -1,29 +1,177 @@
 import functools
 import os
+import traceback
 
-from typing import Callable
+from typing import Any, Callable, Dict, List, Optional, Tuple
 
-from ._compiler import _JITCompiler
+from ._background import BackgroundCompiler
+from ._compiler import _JITCompiler, _JITFunc, JITBailout, dispatch_key, type_signature, types_from_annotations
+from ._type import Type, parse_precision, parse_signature, types_from_function_signature
+from ._log import print_generic_error
 
 _compiler = _JITCompiler()
+_background = BackgroundCompiler(_compiler)
+
+def jit(func: Optional[Callable] = None,
+        *,
+        signatures: Optional[List[str]] = None,
+        background: bool = False,
+        float_type: str = "f64",
+        int_type: str = "i64",
+        fastmath: bool = False) -> Callable:
+    """
+    Compiles func for every set of argument types it is called with. The specializations listed in
+    signatures (like "f8(f8, f8)" or "i8(i8[:])"), and the one given by the annotations of all the
+    parameters, are compiled right away instead of on the first call, unless func calls functions that are not
+    defined yet
+
+    With background=True, specializations are compiled by a worker thread while the interpreter runs func,
+    calls switch to the native code once it is ready
+
+    float_type="f32" computes the floats of func in single precision and int_type="i32" its ints on 32 bits,
+    arrays of 32 bits elements are then processed twice as many at a time. Ints leaving the 32 bits range
+    bail out to the interpreter, floats are rounded to single precision after each operation
+
+    fastmath=True lets the float operations of func be reordered as in real arithmetic: reductions over arrays
+    are accumulated in several lanes, multiplications followed by additions are fused when the CPU supports
+    FMA, and divisions by constants become multiplications by their reciprocal. Results may differ from the
+    interpreter in the last bits
+
+    Can be used as @venom.jit or @venom.jit(signatures=[...], background=True, float_type="f32")
+    """
+    if func is None:
+        return lambda func: jit(func,
+                                signatures=signatures,
+                                background=background,
+                                float_type=float_type,
+                                int_type=int_type,
+                                fastmath=fastmath)
+
+    precision = parse_precision(int_type, float_type, fastmath)
+
+    if precision is None:
+        print(f"Error: invalid precision, disabling jit-compilation for \"{func.__name__}\"")
+        return func
+
+    # Specializations of func indexed by the signature of their argument types, None when the compilation failed
+    specializations: Dict[str, Optional[_JITFunc]] = dict()
+
+    # Same specializations indexed by dispatch_key, filled on the first call with each key
+    dispatch: Dict[Tuple[Any, ...], Optional[_JITFunc]] = dict()
+
+    # Return types of the eager specializations left to their first call, as they call functions not defined yet
+    deferred: Dict[str, Optional[Type]] = dict()
+
+    def specialize(arg_types: List[Type], return_type: Optional[Type] = None) -> Optional[_JITFunc]:
+        signature = type_signature(arg_types)
+
+        # Specializations stored during a batch of the compiler thread are only executable once it is sealed,
+        # taking the compiler waits for it
+        with _compiler.batch():
+            if signature in deferred:
+                return_type = deferred.pop(signature)
+
+            if signature not in specializations or return_type is not None:
+                try:
+                    jit_func = _compiler.jit_specialization(func, arg_types, return_type, precision)
+                except Exception:
+                    # Failures fall back to the interpreter, like in the background
+                    print_generic_error(f"compilation of \"{func.__name__}\" failed\n{traceback.format_exc()}")
+                    jit_func = None
+
+                specializations[signature] = jit_func
+
+            return specializations[signature]
+
+    def publish(key: Tuple[Any, ...], jit_func: Optional[_JITFunc]) -> None:
+        dispatch[key] = jit_func
+
+        if jit_func is None:
+            print(f"Error: jit compilation failed for \"{func.__name__}\", check the log for more information")
+
+    def lookup(key: Tuple[Any, ...], args: Tuple[Any, ...]) -> Optional[_JITFunc]:
+        arg_types = types_from_function_signature(args, precision)
+
+        if background and arg_types is not None and type_signature(arg_types) not in specializations:
+            # The interpreter runs func until the worker publishes the specialization
+            dispatch[key] = None
+            _background.submit(lambda: specialize(arg_types), lambda jit_func: publish(key, jit_func))
+            return None
+
+        jit_func = specialize(arg_types) if arg_types is not None else None
+        publish(key, jit_func)
+
+        return jit_func
 
-def jit(func: Callable) -> Callable:
     @functools.wraps(func)
     def wrapper(*args, **kwargs):
         if kwargs:
             print(f"Error: kwargs not supported for now, disabling jit-compilation for \"{func.__name__}\"")
             return func(*args, **kwargs)
-        
-        jit_func = _compiler.jit_func(func, args)
 
-        if jit_func is not None:
+        key = dispatch_key(args, tuple(map(type, args)))
+
+        try:
+            jit_func = dispatch[key]
+        except KeyError:
+            jit_func = lookup(key, args)
+
+        if jit_func is None:
+            return func(*args)
+
+        try:
             return jit_func(*args)
-        
-        print(f"Error: jit compilation failed for \"{func.__name__}\", check the log for more information")
-        
-        return func(*args, **kwargs)
-    
+        except JITBailout:
+            return func(*args)
+
+    eager = list()
+
+    annotated_types = types_from_annotations(func, precision)
+
+    if annotated_types is not None:
+        eager.append((None, annotated_types))
+
+    for signature in signatures or []:
+        parsed = parse_signature(signature)
+
+        if parsed is not None:
+            eager.append(parsed)
+
+    def check_eager(arg_types: List[Type], jit_func: Optional[_JITFunc]) -> None:
+        if jit_func is None:
+            print(f"Error: jit compilation failed for \"{func.__name__}\" with signature ({type_signature(arg_types)})")
+
+    # Functions defined later in the module are not there yet, their callers are compiled once called
+    if eager and _compiler.unresolved_calls(func):
+        deferred.update((type_signature(arg_types), return_type) for return_type, arg_types in eager)
+        eager.clear()
+
+    for return_type, arg_types in eager:
+        if background:
+            _background.submit(functools.partial(specialize, arg_types, return_type),
+                               functools.partial(check_eager, arg_types))
+        else:
+            check_eager(arg_types, specialize(arg_types, return_type))
+
+    wrapper.__venom_dispatch__ = dispatch
+    wrapper.__venom_specialize__ = specialize
+    wrapper.__venom_precision__ = precision
+    wrapper.__venom_specializations__ = specializations
+
     return wrapper
 
 def compile_file(filepath: str) -> None:
-    _compiler.jit_file(filepath)
\ No newline at end of file
+    _compiler.jit_file(filepath)
+
+def wait_for_compilation() -> None:
+    """
+    Blocks until the specializations queued by functions jitted with background=True are ready
+    """
+    _background.wait()
+
+def set_cache_dir(directory: Optional[str]) -> None:
+    """
+    Stores compiled specializations in directory so that other processes can reuse them, None disables the
+    cache. Defaults to the VENOM_CACHE_DIR environment variable
+    """
+    _compiler.set_cache_dir(directory)
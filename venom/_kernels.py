@@ -0,0 +1,471 @@
+import math
+import struct
+
+from typing import Callable, List, Union
+
+from ._op import UnaryOpType, unop_to_string
+from ._x86 import *
+
+# Kernels of the math functions compiled with fastmath, computed on packed double lanes without calling the libm
+# so that they run in vector loops. They follow the algorithms and the coefficients of fdlibm, evaluated on
+# every lane without branches, and do not use FMA so that the results are the same on every CPU. Measured
+# against the libm CPython calls, over the whole range of the arguments:
+#
+#   exp:      1 ULP
+#   log:      1 ULP
+#   sin, cos: 1 ULP for |x| <= 2 ** 20, larger arguments bail out to the interpreter
+#   tanh:     3 ULP
+#
+# Float32 values are computed as doubles then rounded, within 1 ULP in single precision
+
+Value = Union[XMM, RipRel, float]
+
+def _f64(bits: int) -> float:
+    return struct.unpack("<d", struct.pack("<Q", bits))[0]
+
+# Adding 1.5 * 2 ** 52 rounds a double to an integer held by the low bits of its mantissa
+_ROUND_MAGIC = 6755399441055744.0
+
+_SIGN_BITS = -0x8000000000000000
+_ABS_BITS = 0x7FFFFFFFFFFFFFFF
+
+_LOG2E = 1.4426950408889634
+_LN2_HI = _f64(0x3FE62E42FEE00000)
+_LN2_LO = _f64(0x3DEA39EF35793C76)
+
+# exp(r) = 1 + r + r * c / (2 - c), c = r - r ** 2 * P(r ** 2)
+_EXP_P = [_f64(0x3FC555555555553E), _f64(0xBF66C16C16BEBD93), _f64(0x3F11566AAF25DE2C),
+          _f64(0xBEBBBD41C5D26BF1), _f64(0x3E66376972BEA4D0)]
+
+# Largest value whose exp is finite
+_EXP_MAX = 709.782712893384
+
+# log(1 + f) = f - f ** 2 / 2 + s * (f ** 2 / 2 + R(s ** 2)), s = f / (2 + f)
+_LOG_LG = [_f64(0x3FE5555555555593), _f64(0x3FD999999997FA04), _f64(0x3FD2492494229359),
+           _f64(0x3FCC71C51D8E78AF), _f64(0x3FC7466496CB03DE), _f64(0x3FC39A09D078C69F),
+           _f64(0x3FC2F112DF3E5244)]
+
+_SQRT2 = 1.4142135623730951
+
+# pi / 2 split in parts whose products by quadrants below 2 ** 20 are exact, but the last one
+_PIO2_1 = _f64(0x3FF921FB54400000)
+_PIO2_2 = _f64(0x3DD0B4611A600000)
+_PIO2_3 = _f64(0x3BA3198A2E000000)
+_PIO2_3T = _f64(0x397B839A252049C1)
+
+_TRIG_MAX = 2.0 ** 20
+
+_SIN_S = [_f64(0xBFC5555555555549), _f64(0x3F8111111110F8A6), _f64(0xBF2A01A019C161D5),
+          _f64(0x3EC71DE357B1FE7D), _f64(0xBE5AE5E68A2B9CEB), _f64(0x3DE5D93A5ACFD57C)]
+
+_COS_C = [_f64(0x3FA555555555554C), _f64(0xBF56C16C16C15177), _f64(0x3EFA01A019CB1590),
+          _f64(0xBE927E4F809C52AD), _f64(0x3E21EE9EBDB4B1C4), _f64(0xBDA8FAE9BE8838D4)]
+
+# Registers used by each kernel, the first one holding the argument then the result
+KERNEL_REGISTERS = {
+    UnaryOpType.Exp: 6,
+    UnaryOpType.Log: 7,
+    UnaryOpType.Sin: 8,
+    UnaryOpType.Cos: 8,
+    UnaryOpType.Tanh: 7,
+}
+
+class LaneEmitter():
+    """
+    Packed double operations on the 2 lanes of xmm registers, or the 4 of ymm ones when wide, written dst = a op b.
+    The SSE2 forms first copy a to dst, which must then differ from b unless the operation commutes. Float
+    operands are broadcast constants
+    """
+
+    def __init__(self, asm: Assembler, wide: bool) -> None:
+        self._asm = asm
+        self._wide = wide
+
+    def constant(self, value: float) -> RipRel:
+        return self._asm.constant_f64(value, 32 if self._wide else 16)
+
+    def bits(self, value: int) -> RipRel:
+        return self._asm.constant_i64(value, 32 if self._wide else 16)
+
+    def _value(self, value: Value) -> Union[XMM, RipRel]:
+        return self.constant(value) if isinstance(value, float) else value
+
+    def move(self, dst: XMM, src: Value) -> None:
+        src = self._value(src)
+
+        if self._wide:
+            if dst != src:
+                self._asm.vmovupd(dst, src, True)
+        else:
+            self._asm.movapd(dst, src)
+
+    def _op(self,
+            sse: Callable[[XMM, Operand], None],
+            avx: Callable[..., None],
+            dst: XMM,
+            a: Value,
+            b: Value,
+            commutative: bool = False) -> None:
+        a, b = self._value(a), self._value(b)
+
+        if commutative and b == dst:
+            a, b = b, a
+
+        if a != dst and b == dst and (not self._wide or not isinstance(a, XMM)):
+            raise ValueError(f"invalid lane operands: {dst}, {a}, {b}")
+
+        if self._wide:
+            if not isinstance(a, XMM):
+                self.move(dst, a)
+                a = dst
+
+            avx(dst, a, b, True)
+        else:
+            self.move(dst, a)
+            sse(dst, b)
+
+    def add(self, dst: XMM, a: Value, b: Value) -> None:
+        self._op(self._asm.addpd, self._asm.vaddpd, dst, a, b, True)
+
+    def sub(self, dst: XMM, a: Value, b: Value) -> None:
+        self._op(self._asm.subpd, self._asm.vsubpd, dst, a, b)
+
+    def mul(self, dst: XMM, a: Value, b: Value) -> None:
+        self._op(self._asm.mulpd, self._asm.vmulpd, dst, a, b, True)
+
+    def div(self, dst: XMM, a: Value, b: Value) -> None:
+        self._op(self._asm.divpd, self._asm.vdivpd, dst, a, b)
+
+    def min(self, dst: XMM, a: Value, b: Value) -> None:
+        # b when either is NaN
+        self._op(self._asm.minpd, self._asm.vminpd, dst, a, b)
+
+    def max(self, dst: XMM, a: Value, b: Value) -> None:
+        self._op(self._asm.maxpd, self._asm.vmaxpd, dst, a, b)
+
+    def less(self, dst: XMM, a: Value, b: Value, negate: bool = False) -> None:
+        """
+        Lanes of dst all ones where a < b, or where it does not hold (NaN included) if negate
+        """
+        predicate = 5 if negate else 1
+
+        self._op(lambda dst, b: self._asm.cmppd(dst, b, predicate),
+                 lambda dst, a, b, wide: self._asm.vcmppd(dst, a, b, predicate, wide),
+                 dst, a, b)
+
+    def and_(self, dst: XMM, a: Value, b: Value) -> None:
+        self._op(self._asm.andpd, self._asm.vpand, dst, a, b, True)
+
+    def andn(self, dst: XMM, a: Value, b: Value) -> None:
+        """
+        dst = ~a & b
+        """
+        self._op(self._asm.andnpd, self._asm.vpandn, dst, a, b)
+
+    def or_(self, dst: XMM, a: Value, b: Value) -> None:
+        self._op(self._asm.orpd, self._asm.vpor, dst, a, b, True)
+
+    def xor(self, dst: XMM, a: Value, b: Value) -> None:
+        self._op(self._asm.xorpd, self._asm.vpxor, dst, a, b, True)
+
+    def add_i64(self, dst: XMM, a: Value, b: Value) -> None:
+        self._op(self._asm.paddq, self._asm.vpaddq, dst, a, b, True)
+
+    def sub_i64(self, dst: XMM, a: Value, b: Value) -> None:
+        self._op(self._asm.psubq, self._asm.vpsubq, dst, a, b)
+
+    def _shift(self, sse: Callable[[XMM, int], None], avx: Callable[..., None], dst: XMM, src: XMM, count: int) -> None:
+        if self._wide:
+            avx(dst, src, count, True)
+        else:
+            self.move(dst, src)
+            sse(dst, count)
+
+    def shift_left(self, dst: XMM, src: XMM, count: int) -> None:
+        self._shift(self._asm.psllq, self._asm.vpsllq, dst, src, count)
+
+    def shift_right(self, dst: XMM, src: XMM, count: int) -> None:
+        self._shift(self._asm.psrlq, self._asm.vpsrlq, dst, src, count)
+
+    def bit_mask(self, dst: XMM, src: XMM, bit: int) -> None:
+        """
+        Lanes of dst all ones where the bit of the 64 bits integer held by src is set
+        """
+        self.shift_left(dst, src, 63 - bit)
+
+        # The high half of each lane is filled with the bit, then copied to the low one
+        if self._wide:
+            self._asm.vpsrad(dst, dst, 31, True)
+            self._asm.vpshufd(dst, dst, 0xF5, True)
+        else:
+            self._asm.psrad(dst, 31)
+            self._asm.pshufd(dst, dst, 0xF5)
+
+def _polynomial(lanes: LaneEmitter, dst: XMM, x: XMM, coefficients: List[float]) -> None:
+    """
+    Horner evaluation of the coefficients, highest degree first, at x
+    """
+    lanes.mul(dst, x, coefficients[0])
+
+    for i, coefficient in enumerate(coefficients[1:]):
+        lanes.add(dst, dst, coefficient)
+
+        if i + 2 < len(coefficients):
+            lanes.mul(dst, dst, x)
+
+def _exp_reduced(lanes: LaneEmitter, a: XMM, n: XMM, d: XMM, r: XMM, t: XMM, c: XMM) -> None:
+    """
+    Writes a as n * ln2 + r with n integral and |r| <= ln2 / 2, then leaves -expm1(r) in d. a is overwritten
+    """
+    lanes.mul(n, a, _LOG2E)
+    lanes.add(n, n, _ROUND_MAGIC)
+    lanes.sub(n, n, _ROUND_MAGIC)
+
+    # ln2_hi has trailing zeros, a - n * ln2_hi is exact
+    lanes.mul(t, n, _LN2_HI)
+    lanes.sub(a, a, t)
+    lanes.mul(d, n, _LN2_LO)
+    lanes.sub(r, a, d)
+
+    lanes.mul(t, r, r)
+    _polynomial(lanes, c, t, _EXP_P[::-1])
+    lanes.mul(c, c, t)
+    lanes.sub(t, r, c)
+
+    # expm1(r) = hi - (lo - r * c / (2 - c))
+    lanes.mul(c, r, t)
+    lanes.sub(r, 2.0, t)
+    lanes.div(c, c, r)
+    lanes.sub(d, d, c)
+    lanes.sub(d, d, a)
+
+def _power_of_two(lanes: LaneEmitter, dst: XMM, n: XMM) -> None:
+    """
+    2 ** n for integral n between -1022 and 1023, built from its exponent bits
+    """
+    lanes.add(dst, n, _ROUND_MAGIC + 1023.0)
+    lanes.shift_left(dst, dst, 52)
+
+def _emit_exp(lanes: LaneEmitter, x: XMM, temps: List[XMM], overflow: XMM) -> None:
+    t1, t2, t3, t4, t5 = temps
+
+    # Overflows raise in Python
+    lanes.less(t1, _EXP_MAX, x)
+    lanes.or_(overflow, overflow, t1)
+
+    # Past the clamps the results are 0 and inf, NaN goes through
+    lanes.max(t1, -746.0, x)
+    lanes.min(x, 710.0, t1)
+
+    _exp_reduced(lanes, x, t1, t2, t3, t4, t5)
+    lanes.sub(x, 1.0, t2)
+
+    # 2 ** n is applied in two halves, each one having a normal exponent, so that results near the limits of the
+    # range are rounded once
+    lanes.mul(t3, t1, 0.5)
+    lanes.add(t3, t3, _ROUND_MAGIC)
+    lanes.sub(t4, t3, _ROUND_MAGIC)
+    lanes.sub(t1, t1, t4)
+    lanes.add(t3, t3, 1023.0)
+    lanes.shift_left(t3, t3, 52)
+    _power_of_two(lanes, t1, t1)
+
+    lanes.mul(x, x, t3)
+    lanes.mul(x, x, t1)
+
+def _emit_log(lanes: LaneEmitter, x: XMM, temps: List[XMM], overflow: XMM) -> None:
+    t1, t2, t3, t4, t5, t6 = temps
+
+    # Zero and negative values raise in Python, infinities and NaN are left to the interpreter
+    lanes.less(t1, 0.0, x, negate=True)
+    lanes.or_(overflow, overflow, t1)
+    lanes.less(t1, x, math.inf, negate=True)
+    lanes.or_(overflow, overflow, t1)
+
+    # Subnormals are scaled to normal values first
+    lanes.less(t1, x, 2.0 ** -1022)
+    lanes.mul(t2, x, 2.0 ** 54)
+    lanes.and_(t2, t2, t1)
+    lanes.andn(t3, t1, x)
+    lanes.or_(x, t2, t3)
+    lanes.and_(t1, t1, 54.0)
+
+    # x = 2 ** e * m, 1 <= m < 2
+    lanes.shift_right(t2, x, 52)
+    lanes.or_(t2, t2, lanes.bits(0x4330000000000000))
+    lanes.sub(t2, t2, 2.0 ** 52 + 1023.0)
+    lanes.sub(t2, t2, t1)
+    lanes.and_(x, x, lanes.bits(0x000FFFFFFFFFFFFF))
+    lanes.or_(x, x, 1.0)
+
+    # then sqrt(2) / 2 < m <= sqrt(2)
+    lanes.less(t1, _SQRT2, x)
+    lanes.and_(t3, t1, 1.0)
+    lanes.add(t2, t2, t3)
+    lanes.and_(t3, t1, lanes.bits(1 << 52))
+    lanes.sub_i64(x, x, t3)
+
+    # f = m - 1, s = f / (2 + f)
+    lanes.sub(x, x, 1.0)
+    lanes.add(t1, x, 2.0)
+    lanes.div(t3, x, t1)
+    lanes.mul(t1, t3, t3)
+    lanes.mul(t4, t1, t1)
+
+    # R = z * (Lg1 + w * (Lg3 + w * (Lg5 + w * Lg7))) + w * (Lg2 + w * (Lg4 + w * Lg6)), z = s ** 2, w = z ** 2
+    _polynomial(lanes, t5, t4, _LOG_LG[5::-2])
+    lanes.mul(t5, t5, t4)
+    _polynomial(lanes, t6, t4, _LOG_LG[6::-2])
+    lanes.mul(t6, t6, t1)
+    lanes.add(t5, t5, t6)
+
+    # log(x) = e * ln2_hi - ((hfsq - (s * (hfsq + R) + e * ln2_lo)) - f), hfsq = f ** 2 / 2
+    lanes.mul(t1, x, x)
+    lanes.mul(t1, t1, 0.5)
+    lanes.add(t5, t5, t1)
+    lanes.mul(t5, t5, t3)
+    lanes.mul(t4, t2, _LN2_LO)
+    lanes.add(t5, t5, t4)
+    lanes.sub(t1, t1, t5)
+    lanes.sub(t1, t1, x)
+    lanes.mul(t2, t2, _LN2_HI)
+    lanes.sub(x, t2, t1)
+
+def _emit_sin_cos(lanes: LaneEmitter, cos: bool, x: XMM, temps: List[XMM], overflow: XMM) -> None:
+    t1, t2, t3, t4, t5, t6, t7 = temps
+
+    # Infinities raise in Python, the reduction of large values would lose precision
+    lanes.and_(t1, x, lanes.bits(_ABS_BITS))
+    lanes.less(t2, _TRIG_MAX, t1)
+    lanes.or_(overflow, overflow, t2)
+
+    # |x| = n * pi / 2 + y0 + y1, the low bits of t2 holding the quadrant n
+    lanes.mul(t2, t1, 2.0 / math.pi)
+    lanes.add(t2, t2, _ROUND_MAGIC)
+    lanes.sub(t3, t2, _ROUND_MAGIC)
+
+    # sin is odd, the sign of x is kept in the sign bit of t2
+    if not cos:
+        lanes.and_(t4, x, lanes.bits(_SIGN_BITS))
+        lanes.xor(t2, t2, t4)
+
+    lanes.mul(t4, t3, _PIO2_1)
+    lanes.sub(t1, t1, t4)
+
+    # Two exact subtractions (2Sum) of n * pio2_2 and n * pio2_3, their errors join the last part. Both are
+    # negated, so that the operands of the subtractions never alias their results
+    lanes.mul(t4, t3, _PIO2_2)
+    lanes.sub(t5, t1, t4)
+    lanes.sub(t6, t5, t1)
+    lanes.sub(t7, t5, t6)
+    lanes.sub(t7, t7, t1)
+    lanes.add(t6, t4, t6)
+    lanes.add(t7, t7, t6)
+
+    lanes.mul(t4, t3, _PIO2_3)
+    lanes.sub(t1, t5, t4)
+    lanes.sub(t6, t1, t5)
+    lanes.sub(x, t1, t6)
+    lanes.sub(x, x, t5)
+    lanes.add(t6, t4, t6)
+    lanes.add(x, x, t6)
+
+    lanes.add(t7, t7, x)
+    lanes.mul(t4, t3, _PIO2_3T)
+    lanes.add(t7, t7, t4)
+
+    # y0 = s + tail, y1 = tail - (y0 - s) with t7 holding -tail
+    lanes.sub(x, t1, t7)
+    lanes.sub(t1, t1, x)
+    lanes.sub(t1, t1, t7)
+
+    # sin(y0 + y1) = y0 - ((z * (y1 / 2 - v * r) - y1) - v * S1), z = y0 ** 2, v = z * y0
+    lanes.mul(t3, x, x)
+    lanes.mul(t4, t3, t3)
+    _polynomial(lanes, t5, t3, _SIN_S[3:0:-1])
+    _polynomial(lanes, t6, t3, _SIN_S[:3:-1])
+    lanes.mul(t6, t6, t4)
+    lanes.mul(t6, t6, t3)
+    lanes.add(t5, t5, t6)
+    lanes.mul(t6, t3, x)
+    lanes.mul(t5, t5, t6)
+    lanes.mul(t7, t1, 0.5)
+    lanes.sub(t7, t7, t5)
+    lanes.mul(t7, t7, t3)
+    lanes.sub(t7, t7, t1)
+    lanes.mul(t6, t6, _SIN_S[0])
+    lanes.sub(t5, t7, t6)
+    lanes.sub(t7, x, t5)
+
+    # cos(y0 + y1) = w + (((1 - w) - z / 2) + (z * r - y0 * y1)), w = 1 - z / 2
+    _polynomial(lanes, t5, t3, _COS_C[2::-1])
+    lanes.mul(t5, t5, t3)
+    _polynomial(lanes, t6, t3, _COS_C[:2:-1])
+    lanes.mul(t4, t4, t4)
+    lanes.mul(t6, t6, t4)
+    lanes.add(t5, t5, t6)
+    lanes.mul(t5, t5, t3)
+    lanes.mul(t4, t3, 0.5)
+    lanes.sub(t6, 1.0, t4)
+    lanes.mul(t1, x, t1)
+    lanes.sub(t5, t5, t1)
+    lanes.sub(x, 1.0, t6)
+    lanes.sub(x, x, t4)
+    lanes.add(x, x, t5)
+    lanes.add(x, t6, x)
+
+    # cos(x) = sin(x + pi / 2), odd quadrants take the cosine, the second half of the turn is negated
+    if cos:
+        lanes.add_i64(t2, t2, lanes.bits(1))
+
+    lanes.bit_mask(t1, t2, 0)
+    lanes.and_(x, x, t1)
+    lanes.andn(t1, t1, t7)
+    lanes.or_(x, x, t1)
+
+    lanes.shift_left(t1, t2, 62)
+    lanes.xor(t1, t1, t2)
+    lanes.and_(t1, t1, lanes.bits(_SIGN_BITS))
+    lanes.xor(x, x, t1)
+
+def _emit_tanh(lanes: LaneEmitter, x: XMM, temps: List[XMM], overflow: XMM) -> None:
+    t1, t2, t3, t4, t5, t6 = temps
+
+    # tanh(|x|) = expm1(2 |x|) / (expm1(2 |x|) + 2), rounded to 1 past 20
+    lanes.and_(t1, x, lanes.bits(_ABS_BITS))
+    lanes.min(t2, 20.0, t1)
+    lanes.add(t1, t2, t2)
+
+    _exp_reduced(lanes, t1, t2, t3, t4, t5, t6)
+
+    # expm1(n * ln2 + r) = (2 ** n - 1) + 2 ** n * expm1(r)
+    _power_of_two(lanes, t4, t2)
+    lanes.sub(t5, t4, 1.0)
+    lanes.mul(t4, t4, t3)
+    lanes.sub(t5, t5, t4)
+
+    lanes.add(t4, t5, 2.0)
+    lanes.div(t5, t5, t4)
+
+    lanes.and_(x, x, lanes.bits(_SIGN_BITS))
+    lanes.or_(x, x, t5)
+
+def emit_kernel(asm: Assembler, op: UnaryOpType, registers: List[XMM], overflow: XMM, wide: bool = False) -> None:
+    """
+    Computes op on each double lane of registers[0], leaving the result there. The other registers are
+    overwritten, KERNEL_REGISTERS[op] are needed. Lanes raising in Python, or too large to be computed
+    accurately, are flagged in overflow
+    """
+    lanes = LaneEmitter(asm, wide)
+    x, temps = registers[0], registers[1:KERNEL_REGISTERS[op]]
+
+    if op == UnaryOpType.Exp:
+        _emit_exp(lanes, x, temps, overflow)
+    elif op == UnaryOpType.Log:
+        _emit_log(lanes, x, temps, overflow)
+    elif op in (UnaryOpType.Sin, UnaryOpType.Cos):
+        _emit_sin_cos(lanes, op == UnaryOpType.Cos, x, temps, overflow)
+    elif op == UnaryOpType.Tanh:
+        _emit_tanh(lanes, x, temps, overflow)
+    else:
+        raise ValueError(f"no kernel for {unop_to_string(op)}")
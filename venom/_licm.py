@@ -0,0 +1,219 @@
+from typing import Dict, List, Optional, Set, Tuple
+
+from ._ir import *
+from ._op import *
+from ._type import *
+from ._ssa import DominatorTree
+from ._dce import has_effects
+
+# Statements computing a value from their operands only, compares are moved along with their selection
+_movable_statements = (IRMoveOp, IRCastOp, IRUnaryOp, IRBinaryOp, IrMemLoadOp, IRCMovOp)
+
+def _natural_loops(function: IRFunction, tree: DominatorTree) -> Dict[str, Set[str]]:
+    """
+    Blocks of the natural loops of function, indexed by the name of their header. A back edge jumps to a block
+    dominating its source, the loop holds the blocks reaching the source without going through the header
+    """
+    predecessors = function.predecessors()
+    loops: Dict[str, Set[str]] = dict()
+
+    for block in function.blocks:
+        for successor in function.successors(block):
+            if not tree.dominates(successor.name, block.name):
+                continue
+
+            body = loops.setdefault(successor.name, { successor.name })
+            worklist = [block.name]
+
+            while len(worklist) > 0:
+                name = worklist.pop()
+
+                if name in body:
+                    continue
+
+                body.add(name)
+                worklist.extend(p.name for p in predecessors[name])
+
+    return loops
+
+def _can_insert_preheader(function: IRFunction, entry: IRBlock, header: IRBlock) -> bool:
+    index = function.blocks.index(header)
+
+    return function.blocks[index - 1] is entry and \
+           not (isinstance(entry.terminator, IRJump) and entry.terminator.block is header)
+
+def _insert_preheader(function: IRFunction, entry: IRBlock, header: IRBlock) -> IRBlock:
+    """
+    Inserts a block on the edge from entry falling through the header, only run when the loop is entered
+    """
+    index = function.blocks.index(header)
+    name = f"pre{header.name}"
+
+    while any(other.name == name for other in function.blocks):
+        name = f"{name}_{len(function.blocks)}"
+
+    preheader = IRBlock(name)
+    function.blocks.insert(index, preheader)
+
+    if entry.name in header.arguments:
+        header.arguments[preheader.name] = header.arguments.pop(entry.name)
+
+    return preheader
+
+def _hoist_loop(ir: IR, function: IRFunction, header_name: str) -> int:
+    tree = DominatorTree(function)
+    body = _natural_loops(function, tree).get(header_name)
+
+    if body is None:
+        return 0
+
+    header = next(block for block in function.blocks if block.name == header_name)
+    loop_blocks = [block for block in function.blocks if block.name in body]
+
+    entries = [p for p in function.predecessors()[header_name] if p.name not in body]
+
+    if len(entries) != 1:
+        return 0
+
+    entry = entries[0]
+
+    definitions: Dict[int, IRStatement] = dict()
+    loop_defined: Set[int] = set()
+
+    for block in function.blocks:
+        for stmt in block.statements:
+            for version in stmt.defines():
+                definitions[version] = stmt
+
+    for block in loop_blocks:
+        loop_defined.update(block.parameters)
+
+        for stmt in block.statements:
+            loop_defined.update(stmt.defines())
+
+    # Statements with effects are only moved if the first iteration runs them anyway
+    exits = [block for block in loop_blocks
+             if len(function.successors(block)) == 0 or
+                any(successor.name not in body for successor in function.successors(block))]
+
+    def always_runs(block: IRBlock) -> bool:
+        return all(tree.dominates(block.name, exit_block.name) for exit_block in exits)
+
+    single_entry = len(function.successors(entry)) == 1
+    has_preheader = single_entry or _can_insert_preheader(function, entry, header)
+
+    # Hoisted statements, and whether they need the preheader as they depend on a statement with effects
+    hoisted: List[Tuple[List[IRStatement], bool]] = list()
+    placement: Dict[int, bool] = dict()
+    moved: Set[int] = set()
+
+    def invariant(version: int) -> bool:
+        return version not in loop_defined or version in placement or isinstance(definitions.get(version), IRLiteral)
+
+    changed = True
+
+    while changed:
+        changed = False
+
+        for block in loop_blocks:
+            for i, stmt in enumerate(block.statements):
+                if id(stmt) in moved or not isinstance(stmt, _movable_statements):
+                    continue
+
+                statements = [stmt]
+
+                if isinstance(stmt, IRCMovOp):
+                    if i == 0 or not isinstance(block.statements[i - 1], IRCompareOp):
+                        continue
+
+                    statements.insert(0, block.statements[i - 1])
+
+                operands = [version for s in statements for version in s.uses()]
+
+                if not all(invariant(version) for version in operands):
+                    continue
+
+                effects = has_effects(stmt, definitions)
+                needs_preheader = effects or any(placement.get(version, False) for version in operands)
+
+                if (effects and not always_runs(block)) or (needs_preheader and not has_preheader):
+                    continue
+
+                # Literals of the loop are materialized again next to the statement
+                literals = list()
+                mapping = dict()
+
+                for version in operands:
+                    literal = definitions.get(version)
+
+                    if isinstance(literal, IRLiteral) and version in loop_defined and version not in mapping:
+                        mapping[version] = ir.new_version("_const", literal.type)
+                        literals.append(IRLiteral(mapping[version], literal.name, literal.type, literal.value))
+
+                for s in statements:
+                    s.replace_uses(mapping)
+
+                hoisted.append((literals + statements, needs_preheader))
+                placement[stmt.version] = needs_preheader
+                moved.update(id(s) for s in statements)
+                changed = True
+
+    if len(hoisted) == 0:
+        return 0
+
+    preheader = None
+
+    if single_entry:
+        preheader = entry
+    elif any(needs_preheader for _, needs_preheader in hoisted):
+        preheader = _insert_preheader(function, entry, header)
+
+    guard_statements = list()
+    preheader_statements = list()
+
+    for statements, needs_preheader in hoisted:
+        if needs_preheader or single_entry:
+            preheader_statements.extend(statements)
+        else:
+            guard_statements.extend(statements)
+
+    for block in loop_blocks:
+        block.statements = [stmt for stmt in block.statements if id(stmt) not in moved]
+
+    # The compare of the entry block has to stay right before its jump
+    position = len(entry.statements)
+
+    if position > 0 and isinstance(entry.statements[-1], IRCompareOp) and preheader is not entry:
+        position -= 1
+
+    entry.statements[position:position] = guard_statements
+
+    if preheader is not None:
+        position = len(preheader.statements)
+
+        if preheader is entry and position > 0 and isinstance(entry.statements[-1], IRCompareOp):
+            position -= 1
+
+        preheader.statements[position:position] = preheader_statements
+
+    return len(moved)
+
+def hoist_loop_invariants(ir: IR, function: IRFunction) -> int:
+    """
+    Moves the statements of the loops of the SSA form of function whose operands do not change in the loop
+    ahead of it, inner loops first so their invariants can leave the enclosing loops as well. Pure statements
+    are placed before the compare of the block entering the loop, statements which may raise in the preheader
+    only run when the loop is entered, provided the first iteration runs them anyway
+
+    Returns:
+        int: number of statements hoisted
+    """
+    tree = DominatorTree(function)
+    loops = _natural_loops(function, tree)
+
+    count = 0
+
+    for header in sorted(loops, key=lambda name: len(loops[name])):
+        count += _hoist_loop(ir, function, header)
+
+    return count
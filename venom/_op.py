@@ -8,6 +8,19 @@ class UnaryOpType(enum.IntEnum):
     Sub = 1    # -x
     Not = 2    # not x
     Invert = 3 # ~x
+    Sqrt = 4   # math.sqrt(x)
+    Floor = 5  # math.floor(x) on floats, before the conversion to int
+    Ceil = 6   # math.ceil(x) on floats, before the conversion to int
+    Abs = 7    # abs(x), math.fabs(x)
+    Exp = 8    # math.exp(x)
+    Log = 9    # math.log(x)
+    Sin = 10   # math.sin(x)
+    Cos = 11   # math.cos(x)
+    Tanh = 12  # math.tanh(x)
+
+# Functions of the math module calling the libm, or computed inline by the kernels of _kernels.py when the
+# function is compiled with fastmath
+TRANSCENDENTAL_OPS = (UnaryOpType.Exp, UnaryOpType.Log, UnaryOpType.Sin, UnaryOpType.Cos, UnaryOpType.Tanh)
 
 _ast_unop_to_unop = {
     ast.UAdd: UnaryOpType.Add,
@@ -21,6 +34,25 @@ def ast_unop_to_unop(op: ast.UnaryOp) -> Optional[UnaryOpType]:
 
     return _ast_unop_to_unop.get(op_type)
 
+_unop_to_string = {
+    UnaryOpType.Add: "pos",
+    UnaryOpType.Sub: "neg",
+    UnaryOpType.Not: "not",
+    UnaryOpType.Invert: "inv",
+    UnaryOpType.Sqrt: "sqrt",
+    UnaryOpType.Floor: "floor",
+    UnaryOpType.Ceil: "ceil",
+    UnaryOpType.Abs: "abs",
+    UnaryOpType.Exp: "exp",
+    UnaryOpType.Log: "log",
+    UnaryOpType.Sin: "sin",
+    UnaryOpType.Cos: "cos",
+    UnaryOpType.Tanh: "tanh",
+}
+
+def unop_to_string(op: UnaryOpType) -> str:
+    return _unop_to_string.get(op, "?")
+
 class BinaryOpType(enum.IntEnum):
     Add = 0      # a + b
     Sub = 1      # a - b
@@ -34,6 +66,9 @@ class BinaryOpType(enum.IntEnum):
     BitXor = 9   # a ^ b 
     RShift = 10  # a >> b
     LShift = 11  # a << b
+    Min = 12     # min(a, b)
+    Max = 13     # max(a, b)
+    CopySign = 14 # math.copysign(a, b)
 
 _ast_binop_to_binop = {
     ast.Add: BinaryOpType.Add,
@@ -68,6 +103,9 @@ _binop_to_string = {
     BinaryOpType.BitXor: "bxor",
     BinaryOpType.RShift: "rsh",
     BinaryOpType.LShift: "lsh",
+    BinaryOpType.Min: "min",
+    BinaryOpType.Max: "max",
+    BinaryOpType.CopySign: "copysign",
 }
 
 def binop_to_string(op: BinaryOpType) -> str:
@@ -0,0 +1,356 @@
+from dataclasses import dataclass, field
+from typing import Dict, List, Optional, Set, Tuple, Union
+
+from ._ir import *
+from ._op import *
+from ._type import *
+from ._x86 import *
+
+class CodegenError(Exception):
+    pass
+
+# System V registers
+
+ARG_GPRS = [RDI, RSI, RDX, RCX, R8, R9]
+ARG_XMMS = [XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7]
+
+CALLEE_SAVED_GPRS = [RBX, R12, R13, R14, R15]
+
+# rax, rcx, rdx and r11 are never allocated: rax and rdx are used by idiv, rcx holds shift counts and r11 is
+# the temporary of memory to memory moves. Same goes for xmm14 (working register) and xmm15 (temporary)
+ALLOCATABLE_GPRS = [RSI, RDI, R8, R9, R10, RBX, R12, R13, R14, R15]
+ALLOCATABLE_XMMS = [XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7,
+                    XMM8, XMM9, XMM10, XMM11, XMM12, XMM13]
+
+@dataclass(frozen=True)
+class StackSlot():
+    """
+    8 bytes slot in the spill area of the stack frame
+    """
+
+    index: int
+
+    def __str__(self) -> str:
+        return f"slot{self.index}"
+
+Location = Union[GPR, XMM, StackSlot]
+
+@dataclass
+class Allocation():
+    """
+    Location of every version of a function, and the registers to preserve around each call or vector loop
+    """
+
+    locations: Dict[int, Location] = field(default_factory=dict)
+    num_slots: int = 0
+    # Indexed by id() of the statements clobbering registers
+    call_saves: Dict[int, List[Union[GPR, XMM]]] = field(default_factory=dict)
+
+    def callee_saved(self) -> List[GPR]:
+        used = set(self.locations.values())
+
+        return [reg for reg in CALLEE_SAVED_GPRS if reg in used]
+
+    def live_across_call(self, stmt: IRStatement) -> List[Union[GPR, XMM]]:
+        """
+        Live registers that need to be preserved around the call or vector loop of stmt
+        """
+        return self.call_saves.get(id(stmt), [])
+
+    def num_call_saves(self) -> int:
+        return max((len(saves) for saves in self.call_saves.values()), default=0)
+
+    def print(self) -> None:
+        for version, location in sorted(self.locations.items()):
+            print(f"    %{version} -> {location}")
+
+# Helpers
+
+def is_float_type(t: Type) -> bool:
+    return isinstance(t, PrimitiveType) and t.type in (Primitive.Float64, Primitive.Float32)
+
+def needs_call(stmt: IRStatement) -> bool:
+    """
+    Returns True if stmt is lowered to a call, clobbering the caller-saved registers
+    """
+    if isinstance(stmt, IRBinaryOp):
+        if stmt.op == BinaryOpType.Pow and is_float_type(stmt.type):
+            return True
+
+        if stmt.op in (BinaryOpType.FloorDiv, BinaryOpType.Mod) and is_float_type(stmt.type):
+            return True
+
+    # Calls to the libm, the inline kernels use the xmm registers as well
+    if isinstance(stmt, IRUnaryOp):
+        return stmt.op in TRANSCENDENTAL_OPS
+
+    # Calls to other jitted functions
+    if isinstance(stmt, IRFuncOp):
+        return stmt.symbol is not None
+
+    return False
+
+def clobbered_registers(stmt: IRStatement) -> List[Union[GPR, XMM]]:
+    """
+    Allocatable registers whose value is destroyed by stmt, the live ones are saved around it
+    """
+    if needs_call(stmt):
+        return [reg for reg in ALLOCATABLE_GPRS if reg not in CALLEE_SAVED_GPRS] + ALLOCATABLE_XMMS
+
+    # Vector loops use the xmm registers not holding their operands for lanes and accumulators
+    if isinstance(stmt, IRVectorLoop):
+        return list(ALLOCATABLE_XMMS)
+
+    return []
+
+def abi_arguments(function: IRFunction) -> List[Tuple[int, Union[GPR, XMM]]]:
+    """
+    Registers holding the versions of the function parameters on entry, arrays are passed as a pointer
+    followed by their length
+    """
+    arguments = list()
+
+    gprs = list(ARG_GPRS)
+    xmms = list(ARG_XMMS)
+
+    for name, type in function.parameters.items():
+        version = function.parameter_versions[name]
+
+        versions = [(version, False)]
+
+        if isinstance(type, ArrayType):
+            versions.append((function.array_lengths[version], False))
+        elif is_float_type(type):
+            versions = [(version, True)]
+
+        for version, is_float in versions:
+            pool = xmms if is_float else gprs
+
+            if len(pool) == 0:
+                raise CodegenError("too many parameters, stack arguments are not supported")
+
+            arguments.append((version, pool.pop(0)))
+
+    return arguments
+
+# Liveness
+
+def compute_liveness(function: IRFunction) -> Tuple[Dict[str, Set[int]], Dict[str, Set[int]]]:
+    """
+    Computes the versions live on entry and on exit of every block of function
+
+    Returns:
+        Tuple[Dict[str, Set[int]], Dict[str, Set[int]]]: live-in and live-out sets, indexed by block name
+    """
+    gen: Dict[str, Set[int]] = dict()
+    kill: Dict[str, Set[int]] = dict()
+
+    for block in function.blocks:
+        block_gen = set()
+        block_kill = set()
+
+        for stmt in block.statements:
+            block_gen.update(v for v in stmt.uses() if v not in block_kill)
+            block_kill.update(stmt.defines())
+
+        if block.terminator is not None:
+            block_gen.update(v for v in block.terminator.uses() if v not in block_kill)
+
+        gen[block.name] = block_gen
+        kill[block.name] = block_kill
+
+    live_in = { block.name: set() for block in function.blocks }
+    live_out = { block.name: set() for block in function.blocks }
+
+    changed = True
+
+    while changed:
+        changed = False
+
+        for block in reversed(function.blocks):
+            out = set()
+
+            for successor in function.successors(block):
+                out |= live_in[successor.name]
+
+            new_in = gen[block.name] | (out - kill[block.name])
+
+            if out != live_out[block.name] or new_in != live_in[block.name]:
+                live_out[block.name] = out
+                live_in[block.name] = new_in
+                changed = True
+
+    return live_in, live_out
+
+# Linear scan
+
+@dataclass
+class LiveInterval():
+    """
+    Range of positions where a version is live. Statement n reads its operands at 2n + 2 and writes its
+    results at 2n + 3, parameters are written at 0. Lifetime holes are ignored
+    """
+
+    version: int
+    start: int
+    end: int
+    is_float: bool
+    crosses_call: bool = False
+    hint: Optional[Union[GPR, XMM]] = None
+    # Version whose register is worth reusing when it dies where this interval starts
+    hint_version: Optional[int] = None
+
+def build_intervals(ir: IR, function: IRFunction) -> Tuple[List[LiveInterval], List[Tuple[IRStatement, int]]]:
+    """
+    Computes the live intervals of the versions of function, sorted by start position, and the statements
+    clobbering registers along with their position
+    """
+    live_in, live_out = compute_liveness(function)
+
+    intervals: Dict[int, LiveInterval] = dict()
+
+    def extend(version: int, position: int) -> None:
+        interval = intervals.get(version)
+
+        if interval is None:
+            intervals[version] = LiveInterval(version,
+                                              position,
+                                              position,
+                                              is_float_type(ir.get_version_type(version)))
+        else:
+            interval.start = min(interval.start, position)
+            interval.end = max(interval.end, position)
+
+    for version, reg in abi_arguments(function):
+        extend(version, 0)
+        intervals[version].hint = reg
+
+    clobbers = list()
+    hint_versions = dict()
+
+    n = 0
+
+    for block in function.blocks:
+        block_start = 2 * n + 2
+
+        for version in live_in[block.name]:
+            extend(version, block_start)
+
+        for stmt in block.statements:
+            for version in stmt.uses():
+                extend(version, 2 * n + 2)
+
+            for version in stmt.defines():
+                extend(version, 2 * n + 3)
+
+            uses = stmt.uses()
+
+            if len(stmt.defines()) == 1 and len(uses) > 0 and not isinstance(stmt, IRCompareOp):
+                hint_versions.setdefault(stmt.defines()[0], uses[0])
+
+            if len(clobbered_registers(stmt)) > 0:
+                clobbers.append((stmt, 2 * n + 2))
+
+            n += 1
+
+        if block.terminator is not None:
+            for version in block.terminator.uses():
+                extend(version, 2 * n + 2)
+
+            if isinstance(block.terminator, IRReturn) and block.terminator.value is not None:
+                interval = intervals[block.terminator.value]
+
+                if interval.is_float and interval.hint is None:
+                    interval.hint = XMM0
+
+        n += 1
+
+        for version in live_out[block.name]:
+            extend(version, 2 * n + 1)
+
+    for interval in intervals.values():
+        interval.hint_version = hint_versions.get(interval.version)
+        interval.crosses_call = any(interval.start < position and interval.end > position + 1
+                                    for stmt, position in clobbers if needs_call(stmt))
+
+    return sorted(intervals.values(), key=lambda i: (i.start, i.version)), clobbers
+
+def linear_scan(ir: IR, function: IRFunction) -> Allocation:
+    """
+    Assigns registers to versions with the linear scan algorithm (Poletto & Sarkar). Intervals living across
+    calls prefer callee-saved registers, the others caller-saved ones so that leaf functions need no
+    pushes. When registers run out, the interval ending last is spilled to the stack
+    """
+    allocation = Allocation()
+
+    intervals, clobbers = build_intervals(ir, function)
+
+    free: Dict[bool, List[Union[GPR, XMM]]] = { False: list(ALLOCATABLE_GPRS), True: list(ALLOCATABLE_XMMS) }
+    active: List[LiveInterval] = list()
+
+    def take(interval: LiveInterval) -> Optional[Union[GPR, XMM]]:
+        pool = free[interval.is_float]
+
+        if len(pool) == 0:
+            return None
+
+        callee_saved = [reg for reg in pool if reg in CALLEE_SAVED_GPRS]
+        caller_saved = [reg for reg in pool if reg not in CALLEE_SAVED_GPRS]
+
+        # A callee-saved register is pushed once, a caller-saved one is stored and reloaded around every call
+        if interval.crosses_call and len(callee_saved) > 0:
+            pool = callee_saved
+
+        hints = [interval.hint, allocation.locations.get(interval.hint_version)]
+
+        for reg in hints:
+            if reg is not None and reg in pool:
+                return reg
+
+        preferred = callee_saved + caller_saved if interval.crosses_call else caller_saved + callee_saved
+
+        return preferred[0]
+
+    def spill(interval: LiveInterval) -> None:
+        allocation.locations[interval.version] = StackSlot(allocation.num_slots)
+        allocation.num_slots += 1
+
+    for interval in intervals:
+        for expired in [other for other in active if other.end < interval.start]:
+            active.remove(expired)
+            free[expired.is_float].append(allocation.locations[expired.version])
+
+        reg = take(interval)
+
+        if reg is None:
+            candidates = [other for other in active if other.is_float == interval.is_float]
+            victim = max(candidates, key=lambda other: other.end)
+
+            if victim.end <= interval.end:
+                spill(interval)
+                continue
+
+            reg = allocation.locations[victim.version]
+            spill(victim)
+            active.remove(victim)
+        else:
+            free[interval.is_float].remove(reg)
+
+        allocation.locations[interval.version] = reg
+        active.append(interval)
+
+    for stmt, position in clobbers:
+        clobbered = clobbered_registers(stmt)
+        saves = list()
+
+        for interval in intervals:
+            # Versions written by the statement do not need their previous value
+            if interval.start < position and interval.end > position + 1 and interval.version not in stmt.defines():
+                location = allocation.locations[interval.version]
+
+                if location in clobbered and location not in saves:
+                    saves.append(location)
+
+        allocation.call_saves[id(stmt)] = saves
+
+    return allocation
@@ -0,0 +1,82 @@
+import ctypes
+import ctypes.util
+import struct
+
+from typing import Dict, List, Optional
+
+from ._x86 import Relocation, fits_imm32
+
+# Set by jitted code when it hits something only the interpreter can handle (index errors, integer overflows,
+# division by zero...). As the supported functions have no side effects, they are simply run again by CPython.
+# Checked and cleared by the caller after every call
+bailout_flag = ctypes.c_int64(0)
+
+# Depth of the recursive calls of jitted functions, which bail out before running out of stack
+recursion_depth = ctypes.c_int64(0)
+
+_libm = None
+
+_symbols: Dict[str, int] = dict()
+
+def _get_libm() -> ctypes.CDLL:
+    global _libm
+
+    if _libm is None:
+        # The interpreter is already linked against the libm on most systems
+        _libm = ctypes.CDLL(None)
+
+        if not hasattr(_libm, "pow"):
+            _libm = ctypes.CDLL(ctypes.util.find_library("m"))
+
+    return _libm
+
+def resolve_symbol(name: str) -> int:
+    """
+    Returns the address of a symbol referenced by jitted code
+    """
+    address = _symbols.get(name)
+
+    if address is not None:
+        return address
+
+    if name == "venom_bailout":
+        address = ctypes.addressof(bailout_flag)
+    elif name == "venom_recursion_depth":
+        address = ctypes.addressof(recursion_depth)
+    else:
+        address = ctypes.cast(getattr(_get_libm(), name), ctypes.c_void_p).value
+
+    _symbols[name] = address
+
+    return address
+
+def link(code: bytes,
+         relocations: List[Relocation],
+         address: int = 0,
+         symbols: Optional[Dict[str, int]] = None) -> Optional[bytes]:
+    """
+    Patches the addresses referenced by the code, once copied at address. symbols holds the addresses of the
+    other jitted functions it calls
+
+    Returns:
+        Optional[bytes]: the linked code, None if a call target is out of reach of a rel32 displacement
+    """
+    if len(relocations) == 0:
+        return code
+
+    linked = bytearray(code)
+
+    for relocation in relocations:
+        target = symbols[relocation.symbol] if symbols and relocation.symbol in symbols else resolve_symbol(relocation.symbol)
+
+        if relocation.relative:
+            displacement = target - (address + relocation.offset + 4)
+
+            if not fits_imm32(displacement):
+                return None
+
+            struct.pack_into("<i", linked, relocation.offset, displacement)
+        else:
+            struct.pack_into("<Q", linked, relocation.offset, target)
+
+    return bytes(linked)
@@ -0,0 +1,419 @@
+import math
+import operator
+import struct
+
+from typing import Any, Dict, List, Optional, Set, Tuple
+
+from ._ir import *
+from ._op import *
+from ._type import *
+from ._regalloc import is_float_type
+
+# Lattice of the values of the versions: missing means not known yet, _VARYING not constant
+_VARYING = object()
+
+_INT64_MIN = -2 ** 63
+_INT64_MAX = 2 ** 63 - 1
+
+_compare_ops = {
+    CompareOpType.Eq: operator.eq,
+    CompareOpType.NotEq: operator.ne,
+    CompareOpType.Lt: operator.lt,
+    CompareOpType.LtEq: operator.le,
+    CompareOpType.Gt: operator.gt,
+    CompareOpType.GtEq: operator.ge,
+}
+
+_binary_ops = {
+    BinaryOpType.Add: operator.add,
+    BinaryOpType.Sub: operator.sub,
+    BinaryOpType.Mul: operator.mul,
+    BinaryOpType.Div: operator.truediv,
+    BinaryOpType.FloorDiv: operator.floordiv,
+    BinaryOpType.Mod: operator.mod,
+    BinaryOpType.Pow: operator.pow,
+    BinaryOpType.BitAnd: operator.and_,
+    BinaryOpType.BitOr: operator.or_,
+    BinaryOpType.BitXor: operator.xor,
+    BinaryOpType.RShift: operator.rshift,
+    BinaryOpType.LShift: operator.lshift,
+    BinaryOpType.Min: min,
+    BinaryOpType.Max: max,
+    BinaryOpType.CopySign: math.copysign,
+}
+
+_math_functions = {
+    UnaryOpType.Exp: math.exp,
+    UnaryOpType.Log: math.log,
+    UnaryOpType.Sin: math.sin,
+    UnaryOpType.Cos: math.cos,
+    UnaryOpType.Tanh: math.tanh,
+}
+
+def _same(a: Any, b: Any) -> bool:
+    # -0.0 and 0.0 differ, NaN matches itself
+    if isinstance(a, float) and isinstance(b, float):
+        return struct.pack("<d", a) == struct.pack("<d", b)
+
+    return type(a) is type(b) and a == b
+
+def _meet(a: Any, b: Any) -> Any:
+    if a is None:
+        return b
+
+    if b is None or _same(a, b):
+        return a
+
+    return _VARYING
+
+def _fits_int64(value: int) -> bool:
+    return _INT64_MIN <= value <= _INT64_MAX
+
+def _fits(value: int, type: Type) -> bool:
+    return fits_int32(value) if type == TypeInt32 else _fits_int64(value)
+
+def _round(value: float, type: Type) -> float:
+    # Float32 operations are computed on doubles then rounded, as the generated code does
+    return to_float32(value) if type == TypeFloat32 else value
+
+def fold_cast(value: Any, type_from: Type, type_to: Type) -> Optional[Any]:
+    """
+    Value of a cast of the constant value, None if it is left to the runtime
+    """
+    if is_float_type(type_to):
+        # Integers past 2 ** 53 would be rounded twice on their way to single precision
+        if type_to == TypeFloat32 and not isinstance(value, float) and abs(value) > 2 ** 53:
+            return None
+
+        return _round(float(value), type_to)
+
+    if type_to == TypeBool:
+        return bool(value)
+
+    if isinstance(value, float):
+        # Out of range values bail out at runtime
+        if not math.isfinite(value) or not _INT64_MIN < math.trunc(value) <= _INT64_MAX:
+            return None
+
+        value = math.trunc(value)
+
+    return int(value) if _fits(int(value), type_to) else None
+
+def fold_unary(op: UnaryOpType, value: Any, type: Type) -> Optional[Any]:
+    """
+    Value of a unary op on the constant value, None if it is left to the runtime
+    """
+    if op == UnaryOpType.Add:
+        return value
+
+    # Computed by the libm the interpreter calls, the errors and non finite results bail out at runtime
+    if op in _math_functions:
+        try:
+            result = _math_functions[op](value)
+        except (ValueError, OverflowError):
+            return None
+
+        return _round(result, type) if math.isfinite(result) else None
+
+    if op == UnaryOpType.Sub:
+        result = -value
+    elif op == UnaryOpType.Invert and type in (TypeInt64, TypeInt32):
+        result = ~value
+    elif op == UnaryOpType.Sqrt and value >= 0.0:
+        result = _round(math.sqrt(value), type)
+    elif op == UnaryOpType.Abs:
+        result = abs(value)
+    elif op in (UnaryOpType.Floor, UnaryOpType.Ceil) and math.isfinite(value):
+        result = float(math.floor(value) if op == UnaryOpType.Floor else math.ceil(value))
+    else:
+        return None
+
+    return result if isinstance(result, float) or _fits(result, type) else None
+
+def fold_binary(op: BinaryOpType, left: Any, right: Any, type: Type) -> Optional[Any]:
+    """
+    Value of a binary op on the constant operands following Python semantics, None if it is left to the
+    runtime as it raises, overflows or would take too long to compute
+    """
+    if type in (TypeInt64, TypeInt32):
+        if op in (BinaryOpType.LShift, BinaryOpType.RShift, BinaryOpType.Pow) and right < 0:
+            return None
+
+        if op == BinaryOpType.LShift and right > 63 and left != 0:
+            return None
+
+        if op == BinaryOpType.Pow and right > 63 and abs(left) > 1:
+            return None
+    elif not is_float_type(type):
+        return None
+
+    try:
+        result = _binary_ops[op](left, right)
+    except (ArithmeticError, KeyError):
+        return None
+
+    if is_float_type(type):
+        return _round(result, type) if isinstance(result, float) else None
+
+    return result if isinstance(result, int) and _fits(result, type) else None
+
+def fold_compare(op: CompareOpType, left: Any, right: Any) -> bool:
+    return _compare_ops[op](left, right)
+
+def _literal_value(stmt: IRLiteral) -> Any:
+    if is_float_type(stmt.type):
+        return float(stmt.value)
+
+    if stmt.type == TypeBool:
+        return bool(stmt.value)
+
+    return int(stmt.value) if stmt.type in (TypeInt64, TypeInt32) else _VARYING
+
+class _Propagation():
+    """
+    Sparse conditional constant propagation over the SSA form of a function: values and executable edges are
+    discovered together, versions only written on edges never taken do not pollute the merges
+    """
+
+    def __init__(self, function: IRFunction) -> None:
+        self.function = function
+        self.values: Dict[int, Any] = dict()
+        self.executable: Set[str] = { function.blocks[0].name }
+        self.edges: Set[Tuple[str, str]] = set()
+
+        written = set()
+
+        for block in function.blocks:
+            written.update(block.parameters)
+
+            for stmt in block.statements:
+                written.update(stmt.defines())
+
+        # Parameters and versions read before any write are unknown at compile time
+        for block in function.blocks:
+            for stmt in block.statements:
+                for version in stmt.uses():
+                    if version not in written:
+                        self.values[version] = _VARYING
+
+            if block.terminator is not None:
+                for version in block.terminator.uses():
+                    if version not in written:
+                        self.values[version] = _VARYING
+
+            for arguments in block.arguments.values():
+                for version in arguments:
+                    if version not in written:
+                        self.values[version] = _VARYING
+
+    def value(self, version: int) -> Any:
+        return self.values.get(version)
+
+    def _set(self, version: int, value: Any) -> bool:
+        old = self.values.get(version)
+
+        if value is None or old is _VARYING or (old is not None and _same(old, value)):
+            return False
+
+        # Values only go down the lattice
+        self.values[version] = value if old is None else _VARYING
+
+        return True
+
+    def compare(self, stmt: Optional[IRCompareOp], op: CompareOpType) -> Any:
+        """
+        Outcome of the compare for op, None if not known yet and _VARYING if not constant
+        """
+        if stmt is None:
+            return _VARYING
+
+        left, right = self.value(stmt.left), self.value(stmt.right)
+
+        if left is _VARYING or right is _VARYING:
+            return _VARYING
+
+        if left is None or right is None:
+            return None
+
+        return fold_compare(op, left, right)
+
+    def evaluate(self, stmt: IRStatement, compare: Optional[IRCompareOp]) -> Any:
+        if isinstance(stmt, IRLiteral):
+            return _literal_value(stmt)
+
+        if isinstance(stmt, IRCMovOp):
+            outcome = self.compare(compare, stmt.op)
+
+            if outcome is None:
+                return None
+
+            if outcome is _VARYING:
+                return _meet(self.value(stmt.true_val), self.value(stmt.false_val))
+
+            return self.value(stmt.true_val if outcome else stmt.false_val)
+
+        if not isinstance(stmt, (IRMoveOp, IRCastOp, IRUnaryOp, IRBinaryOp, IRIncOp, IRDecOp)):
+            return _VARYING
+
+        operands = [self.value(version) for version in stmt.uses()]
+
+        if any(operand is _VARYING for operand in operands):
+            return _VARYING
+
+        if any(operand is None for operand in operands):
+            return None
+
+        if isinstance(stmt, IRMoveOp):
+            result = operands[0]
+        elif isinstance(stmt, IRCastOp):
+            result = fold_cast(operands[0], stmt.type_from, stmt.type_to)
+        elif isinstance(stmt, IRUnaryOp):
+            result = fold_unary(stmt.op, operands[0], stmt.type)
+        elif isinstance(stmt, IRBinaryOp):
+            result = fold_binary(stmt.op, operands[0], operands[1], stmt.type)
+        else:
+            step = 1 if isinstance(stmt, IRIncOp) else -1
+            result = fold_binary(BinaryOpType.Add, operands[0], step, stmt.type)
+
+        return _VARYING if result is None else result
+
+    def taken(self, block: IRBlock, compare: Optional[IRCompareOp]) -> List[IRBlock]:
+        """
+        Successors of block reachable with the values known so far
+        """
+        terminator = block.terminator
+        successors = self.function.successors(block)
+
+        if not isinstance(terminator, IRJump) or terminator.comp is None or len(successors) < 2:
+            return successors
+
+        outcome = self.compare(compare, terminator.comp)
+
+        if outcome is None:
+            return []
+
+        if outcome is _VARYING:
+            return successors
+
+        return [successors[0]] if outcome else [successors[1]]
+
+    def run(self) -> None:
+        changed = True
+
+        while changed:
+            changed = False
+
+            for block in self.function.blocks:
+                if block.name not in self.executable:
+                    continue
+
+                for i, parameter in enumerate(block.parameters):
+                    value = None
+
+                    for name, arguments in block.arguments.items():
+                        if (name, block.name) in self.edges:
+                            value = _meet(value, self.value(arguments[i]))
+
+                    changed |= self._set(parameter, value)
+
+                compare = None
+
+                for stmt in block.statements:
+                    if isinstance(stmt, IRCompareOp):
+                        compare = stmt
+                        continue
+
+                    for version in stmt.defines():
+                        changed |= self._set(version, self.evaluate(stmt, compare))
+
+                for successor in self.taken(block, compare):
+                    if (block.name, successor.name) not in self.edges:
+                        self.edges.add((block.name, successor.name))
+                        self.executable.add(successor.name)
+                        changed = True
+
+def _constant(ir: IR, version: int, value: Any) -> IRLiteral:
+    return IRLiteral(version, str(value), ir.get_version_type(version), value)
+
+def propagate_constants(ir: IR, function: IRFunction) -> int:
+    """
+    Sparse conditional constant propagation on the SSA form of function. Statements and block parameters
+    of constant value become literals, compares of constant outcome are removed along with the jumps and
+    selections depending on them, and the blocks which can never run are pruned
+
+    Returns:
+        int: number of statements and parameters folded
+    """
+    propagation = _Propagation(function)
+    propagation.run()
+
+    def constant(version: int) -> bool:
+        value = propagation.value(version)
+
+        return value is not None and value is not _VARYING
+
+    count = 0
+
+    for block in function.blocks:
+        if block.name not in propagation.executable:
+            continue
+
+        # Constant parameters are materialized on entry of the block
+        literals = list()
+
+        for i in reversed(range(len(block.parameters))):
+            parameter = block.parameters[i]
+
+            if constant(parameter):
+                literals.insert(0, _constant(ir, parameter, propagation.value(parameter)))
+                block.parameters.pop(i)
+
+                for arguments in block.arguments.values():
+                    arguments.pop(i)
+
+        for name in list(block.arguments):
+            if (name, block.name) not in propagation.edges or len(block.parameters) == 0:
+                del block.arguments[name]
+
+        statements = list()
+        compare = None
+
+        for stmt in block.statements:
+            if isinstance(stmt, IRCompareOp):
+                compare = stmt
+                statements.append(stmt)
+                continue
+
+            if isinstance(stmt, IRCMovOp):
+                outcome = propagation.compare(compare, stmt.op)
+
+                if outcome is not None and outcome is not _VARYING:
+                    # The selection does not need the flags anymore
+                    statements.pop()
+                    stmt = IRMoveOp(stmt.version, stmt.true_val if outcome else stmt.false_val, stmt.type)
+                    count += 1
+
+            if not isinstance(stmt, IRLiteral) and len(stmt.defines()) == 1 and constant(stmt.version):
+                stmt = _constant(ir, stmt.version, propagation.value(stmt.version))
+                count += 1
+
+            statements.append(stmt)
+
+        block.statements = literals + statements
+        count += len(literals)
+
+        terminator = block.terminator
+
+        if isinstance(terminator, IRJump) and terminator.comp is not None:
+            successors = function.successors(block)
+            taken = [successor for successor in successors if (block.name, successor.name) in propagation.edges]
+
+            if len(successors) == 2 and len(taken) == 1 and isinstance(block.statements[-1], IRCompareOp):
+                # The compare only sets the flags of the jump
+                block.statements.pop()
+                block.terminator = IRJump(terminator.block, None) if taken[0] is successors[0] else None
+                count += 1
+
+    function.blocks = [block for block in function.blocks if block.name in propagation.executable]
+
+    return count
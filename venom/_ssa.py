@@ -0,0 +1,453 @@
+from typing import Dict, List, Optional, Set, Tuple
+
+from ._ir import *
+from ._type import *
+from ._regalloc import compute_liveness
+
+class DominatorTree():
+    """
+    Immediate dominators and dominance frontiers of the blocks of a function, indexed by block name, computed
+    with the iterative algorithm of Cooper, Harvey and Kennedy over the reverse postorder
+    """
+
+    def __init__(self, function: IRFunction) -> None:
+        self.order = self._reverse_postorder(function)
+        self.idom: Dict[str, Optional[str]] = { name: None for name in self.order }
+        self.children: Dict[str, List[str]] = { name: list() for name in self.order }
+        self.frontiers: Dict[str, Set[str]] = { name: set() for name in self.order }
+
+        predecessors = function.predecessors()
+        position = { name: i for i, name in enumerate(self.order) }
+
+        entry = self.order[0]
+        self.idom[entry] = entry
+
+        def intersect(a: str, b: str) -> str:
+            while a != b:
+                while position[a] > position[b]:
+                    a = self.idom[a]
+
+                while position[b] > position[a]:
+                    b = self.idom[b]
+
+            return a
+
+        changed = True
+
+        while changed:
+            changed = False
+
+            for name in self.order[1:]:
+                processed = [p.name for p in predecessors[name] if p.name in position and self.idom[p.name] is not None]
+                new_idom = processed[0]
+
+                for other in processed[1:]:
+                    new_idom = intersect(other, new_idom)
+
+                if self.idom[name] != new_idom:
+                    self.idom[name] = new_idom
+                    changed = True
+
+        self.idom[entry] = None
+
+        for name in self.order[1:]:
+            self.children[self.idom[name]].append(name)
+
+        # A join is in the frontier of every block dominating one of its predecessors but not itself
+        for name in self.order:
+            joins = [p.name for p in predecessors[name] if p.name in position]
+
+            if len(joins) < 2:
+                continue
+
+            for runner in joins:
+                while runner != self.idom[name]:
+                    self.frontiers[runner].add(name)
+                    runner = self.idom[runner]
+
+    @staticmethod
+    def _reverse_postorder(function: IRFunction) -> List[str]:
+        order = list()
+        visited = set()
+        stack = [(function.blocks[0], iter(function.successors(function.blocks[0])))]
+        visited.add(function.blocks[0].name)
+
+        while len(stack) > 0:
+            block, successors = stack[-1]
+            successor = next(successors, None)
+
+            if successor is None:
+                order.append(block.name)
+                stack.pop()
+            elif successor.name not in visited:
+                visited.add(successor.name)
+                stack.append((successor, iter(function.successors(successor))))
+
+        return order[::-1]
+
+    def dominates(self, a: str, b: str) -> bool:
+        while b is not None:
+            if a == b:
+                return True
+
+            b = self.idom[b]
+
+        return False
+
+    def iterated_frontier(self, names: Set[str]) -> Set[str]:
+        frontier = set()
+        worklist = list(names)
+
+        while len(worklist) > 0:
+            for join in self.frontiers[worklist.pop()]:
+                if join not in frontier:
+                    frontier.add(join)
+                    worklist.append(join)
+
+        return frontier
+
+def _unique_successors(function: IRFunction, block: IRBlock) -> List[IRBlock]:
+    successors = list()
+
+    for successor in function.successors(block):
+        if successor not in successors:
+            successors.append(successor)
+
+    return successors
+
+def construct_ssa(ir: IR, function: IRFunction) -> int:
+    """
+    Rewrites function in SSA form: every version written more than once, or reaching a join with different
+    values, is split into one version per write and block parameters are placed at the joins where it is
+    live, on the iterated dominance frontier of its writes. Reads before any write keep the original version,
+    holding the value of the parameter on entry
+
+    Returns:
+        int: number of block parameters
+    """
+    tree = DominatorTree(function)
+    live_in, _ = compute_liveness(function)
+    blocks = { block.name: block for block in function.blocks }
+
+    writes: Dict[int, Set[str]] = dict()
+    count: Dict[int, int] = dict()
+
+    for block in function.blocks:
+        for stmt in block.statements:
+            for version in stmt.defines():
+                writes.setdefault(version, set()).add(block.name)
+                count[version] = count.get(version, 0) + 1
+
+    origin: Dict[int, int] = dict()
+    renamed = set()
+
+    # Parameters are written on entry, their value before any write in the body is the original version
+    entry_values = set(function.parameter_versions.values()) | set(function.array_lengths.values())
+
+    for version, names in writes.items():
+        for name in sorted(tree.iterated_frontier(names), key=tree.order.index):
+            # Pruned form, values dead on entry of the join are not merged
+            if version not in live_in[name]:
+                continue
+
+            parameter = ir.new_version("_ssa", ir.get_version_type(version))
+            blocks[name].parameters.append(parameter)
+            origin[parameter] = version
+            renamed.add(version)
+
+        if count[version] > 1 or version in entry_values:
+            renamed.add(version)
+
+    stacks = { version: [version] for version in renamed }
+
+    def rename(block: IRBlock) -> None:
+        pushed = list()
+
+        for parameter in block.parameters:
+            stacks[origin[parameter]].append(parameter)
+            pushed.append(origin[parameter])
+
+        for stmt in block.statements:
+            stmt.replace_uses({ version: stacks[version][-1] for version in stmt.uses() if version in stacks })
+
+            for version in stmt.defines():
+                if version in stacks:
+                    new_version = ir.new_version("_ssa", ir.get_version_type(version))
+                    stmt.version = new_version
+                    stacks[version].append(new_version)
+                    pushed.append(version)
+
+        if block.terminator is not None:
+            block.terminator.replace_uses({ version: stacks[version][-1] for version in block.terminator.uses() if version in stacks })
+
+        for successor in _unique_successors(function, block):
+            if len(successor.parameters) > 0:
+                successor.arguments[block.name] = [stacks[origin[parameter]][-1] for parameter in successor.parameters]
+
+        for child in tree.children[block.name]:
+            rename(blocks[child])
+
+        for version in pushed:
+            stacks[version].pop()
+
+    rename(function.blocks[0])
+
+    return sum(len(block.parameters) for block in function.blocks)
+
+# Out of SSA
+
+def _compute_ssa_liveness(function: IRFunction) -> Tuple[Dict[str, Set[int]], Dict[str, Set[int]]]:
+    """
+    Liveness where parameters are written on entry of their block and arguments read on exit of the
+    predecessor passing them
+    """
+    gen: Dict[str, Set[int]] = dict()
+    kill: Dict[str, Set[int]] = dict()
+
+    for block in function.blocks:
+        block_gen = set()
+        block_kill = set(block.parameters)
+
+        for stmt in block.statements:
+            block_gen.update(v for v in stmt.uses() if v not in block_kill)
+            block_kill.update(stmt.defines())
+
+        if block.terminator is not None:
+            block_gen.update(v for v in block.terminator.uses() if v not in block_kill)
+
+        gen[block.name] = block_gen
+        kill[block.name] = block_kill
+
+    live_in = { block.name: set() for block in function.blocks }
+    live_out = { block.name: set() for block in function.blocks }
+
+    changed = True
+
+    while changed:
+        changed = False
+
+        for block in reversed(function.blocks):
+            out = set()
+
+            for successor in _unique_successors(function, block):
+                out |= live_in[successor.name]
+                out.update(successor.arguments.get(block.name, []))
+
+            new_in = gen[block.name] | (out - kill[block.name])
+
+            if out != live_out[block.name] or new_in != live_in[block.name]:
+                live_out[block.name] = out
+                live_in[block.name] = new_in
+                changed = True
+
+    return live_in, live_out
+
+def _interferences(function: IRFunction, versions: Set[int]) -> Set[Tuple[int, int]]:
+    """
+    Pairs of versions among versions live at the same time, with a different value
+    """
+    _, live_out = _compute_ssa_liveness(function)
+    pairs = set()
+
+    def interfere(written: int, live: Set[int]) -> None:
+        if written not in versions:
+            return
+
+        for other in live:
+            if other != written and other in versions:
+                pairs.add((written, other))
+                pairs.add((other, written))
+
+    for block in function.blocks:
+        live = set(live_out[block.name])
+
+        if block.terminator is not None:
+            live.update(block.terminator.uses())
+
+        for stmt in reversed(block.statements):
+            for version in stmt.defines():
+                interfere(version, live)
+
+            live.difference_update(stmt.defines())
+            live.update(stmt.uses())
+
+        for parameter in block.parameters:
+            interfere(parameter, live)
+
+    return pairs
+
+def _sequentialize(ir: IR, copies: List[Tuple[int, int]]) -> List[IRMoveOp]:
+    """
+    Orders the copies happening at the same time, breaking cycles with a temporary version
+    """
+    pending = [(dst, src) for dst, src in copies if dst != src]
+    moves = list()
+
+    while len(pending) > 0:
+        for i, (dst, src) in enumerate(pending):
+            if not any(other_src == dst for j, (_, other_src) in enumerate(pending) if j != i):
+                moves.append(IRMoveOp(dst, src, ir.get_version_type(dst)))
+                pending.pop(i)
+                break
+        else:
+            dst, _ = pending[0]
+            temp = ir.new_version("_swap", ir.get_version_type(dst))
+            moves.append(IRMoveOp(temp, dst, ir.get_version_type(dst)))
+            pending = [(other_dst, temp if other_src == dst else other_src) for other_dst, other_src in pending]
+
+    return moves
+
+def _split_edge(function: IRFunction, block: IRBlock, successor: IRBlock) -> IRBlock:
+    """
+    Inserts an empty block on the edge from block to successor
+    """
+    name = f"{block.name}_{successor.name}"
+
+    while any(other.name == name for other in function.blocks):
+        name = f"{name}_{len(function.blocks)}"
+
+    edge = IRBlock(name)
+    index = function.blocks.index(block)
+
+    if index + 1 < len(function.blocks) and function.blocks[index + 1] is successor and \
+       not (isinstance(block.terminator, IRJump) and block.terminator.block is successor):
+        # Fall through edge, the new block falls through the successor as well
+        function.blocks.insert(index + 1, edge)
+        return edge
+
+    # Jump edge, the new block jumps to the successor from the end of the function
+    last = function.blocks[-1]
+
+    if last.terminator is None or (isinstance(last.terminator, IRJump) and last.terminator.comp is not None):
+        end = IRBlock(f"{name}_end")
+        last.terminator = IRJump(end, None) if last.terminator is None else last.terminator
+        function.blocks.extend([edge, end])
+    else:
+        function.blocks.append(edge)
+
+    edge.terminator = IRJump(successor, None)
+    block.terminator.block = edge
+
+    return edge
+
+def destruct_ssa(ir: IR, function: IRFunction) -> int:
+    """
+    Lowers the block parameters of function back to moves. Parameters are first merged with their arguments
+    when their values are never live at the same time, so most of them vanish, and the remaining arguments
+    are copied on exit of the predecessors. Copies are placed ahead of the final compare of a block with
+    two successors unless they would overwrite a value still needed, the edge is split then
+
+    Returns:
+        int: number of copies inserted
+    """
+    written = set(function.parameter_versions.values()) | set(function.array_lengths.values())
+
+    for block in function.blocks:
+        written.update(block.parameters)
+
+        for stmt in block.statements:
+            written.update(stmt.defines())
+
+    related = set()
+
+    for block in function.blocks:
+        related.update(block.parameters)
+
+        for arguments in block.arguments.values():
+            related.update(argument for argument in arguments if argument in written)
+
+    interferences = _interferences(function, related)
+
+    # Union find over the related versions, members of a group never interfere
+    groups: Dict[int, Set[int]] = { version: { version } for version in related }
+
+    for block in function.blocks:
+        for i, parameter in enumerate(block.parameters):
+            for arguments in block.arguments.values():
+                argument = arguments[i]
+
+                if argument not in written or groups[argument] is groups[parameter]:
+                    continue
+
+                merged = groups[parameter] | groups[argument]
+
+                if any((a, b) in interferences for a in groups[parameter] for b in groups[argument]):
+                    continue
+
+                for version in merged:
+                    groups[version] = merged
+
+    mapping = { version: min(group) for version, group in groups.items() }
+
+    for block in function.blocks:
+        for stmt in block.statements:
+            stmt.replace_uses(mapping)
+
+            if len(stmt.defines()) > 0 and stmt.version in mapping:
+                stmt.version = mapping[stmt.version]
+
+        if block.terminator is not None:
+            block.terminator.replace_uses(mapping)
+
+    # Copies of the arguments, by predecessor, dropping the ones of versions never written
+    copies: Dict[str, List[Tuple[IRBlock, int, int]]] = dict()
+
+    for block in function.blocks:
+        for name, arguments in block.arguments.items():
+            for parameter, argument in zip(block.parameters, arguments):
+                if argument in written and mapping.get(parameter, parameter) != mapping.get(argument, argument):
+                    copies.setdefault(name, list()).append((block, mapping[parameter], mapping.get(argument, argument)))
+
+        block.parameters = list()
+        block.arguments = dict()
+
+    live_in, _ = compute_liveness(function)
+    count = 0
+
+    for block in list(function.blocks):
+        block_copies = copies.get(block.name, [])
+
+        if len(block_copies) == 0:
+            continue
+
+        statements = block.statements
+        compare = statements[-1] if len(statements) > 0 and isinstance(statements[-1], IRCompareOp) else None
+        position = len(statements) - (1 if compare is not None else 0)
+
+        successors = _unique_successors(function, block)
+        targets = [successor for successor in successors if any(target is successor for target, _, _ in block_copies)]
+
+        # Copies ahead of the compare run on every edge, they must agree on their values and not overwrite
+        # the compare operands or a value live on an edge which does not expect it
+        sources: Dict[int, Set[int]] = dict()
+
+        for _, dst, src in block_copies:
+            sources.setdefault(dst, set()).add(src)
+
+        shared = all(len(srcs) == 1 for srcs in sources.values()) and \
+                 (compare is None or not any(dst in sources for dst in compare.uses()))
+
+        for successor in successors:
+            expected = set(dst for target, dst, _ in block_copies if target is successor)
+
+            if any(dst in live_in[successor.name] and dst not in expected for dst in sources):
+                shared = False
+
+        if shared:
+            moves = _sequentialize(ir, [(dst, srcs.pop()) for dst, srcs in sources.items()])
+            block.statements[position:position] = moves
+            count += len(moves)
+
+            # The compare reads the copies, loops keep comparing their own variable
+            if compare is not None:
+                compare.replace_uses({ move.operand: move.version for move in moves if move.operand in compare.uses() })
+
+            continue
+
+        for successor in targets:
+            edge = _split_edge(function, block, successor)
+            moves = _sequentialize(ir, [(dst, src) for target, dst, src in block_copies if target is successor])
+            edge.statements.extend(moves)
+            count += len(moves)
+
+    return count
@@ -0,0 +1,170 @@
+import math
+
+from typing import Dict, List, Optional, Tuple
+
+from ._ir import *
+from ._op import *
+from ._type import *
+from ._regalloc import is_float_type
+
+# Float powers are rounded at each multiplication, a few ulps away from pow at most up to this exponent
+_MAX_FLOAT_EXPONENT = 8
+
+# Integer powers are exact, any larger exponent overflows unless the base is 0 or +-1
+_MAX_INT_EXPONENT = 63
+
+def _integer_exponent(literal: IRLiteral) -> Optional[int]:
+    value = literal.value
+
+    if isinstance(value, float):
+        return int(value) if value.is_integer() else None
+
+    return value if isinstance(value, int) else None
+
+def _multiply_chain(ir: IR, base: int, exponent: int, type: Type) -> Tuple[List[IRStatement], int]:
+    """
+    Statements computing base ** exponent for exponent > 0 by squaring, from the lowest bit up so that the
+    squares of the base are shared between the powers of the same base once values are numbered
+    """
+    statements = list()
+    result = None
+    square = base
+
+    while True:
+        if exponent & 1:
+            if result is None:
+                result = square
+            else:
+                product = ir.new_version("_pow", type)
+                statements.append(IRBinaryOp(product, BinaryOpType.Mul, result, square, type))
+                result = product
+
+        exponent >>= 1
+
+        if exponent == 0:
+            return statements, result
+
+        squared = ir.new_version("_pow", type)
+        statements.append(IRBinaryOp(squared, BinaryOpType.Mul, square, square, type))
+        square = squared
+
+def _reduce_pow(ir: IR, stmt: IRBinaryOp, exponent: IRLiteral) -> Optional[List[IRStatement]]:
+    """
+    Statements replacing stmt, computing the same value as the last one defined, None if it stays a call
+    """
+    is_float = is_float_type(stmt.type)
+
+    if is_float and exponent.value == 0.5:
+        # sqrt(-0.0) is -0.0 while (-0.0) ** 0.5 is 0.0, negative bases bail out
+        root = ir.new_version("_pow", stmt.type)
+        zero = ir.new_version("_const", stmt.type)
+
+        return [IRUnaryOp(root, UnaryOpType.Sqrt, stmt.left, stmt.type),
+                IRLiteral(zero, "0.0", stmt.type, 0.0),
+                IRBinaryOp(stmt.version, BinaryOpType.Add, root, zero, stmt.type)]
+
+    n = _integer_exponent(exponent)
+
+    if n is None or abs(n) > (_MAX_FLOAT_EXPONENT if is_float else _MAX_INT_EXPONENT):
+        return None
+
+    # Negative integer exponents produce floats
+    if not is_float and n < 0:
+        return None
+
+    if n == 0:
+        # x ** 0 is 1 for any x, NaN included
+        value = 1.0 if is_float else 1
+
+        return [IRLiteral(stmt.version, str(value), stmt.type, value)]
+
+    statements, power = _multiply_chain(ir, stmt.left, abs(n), stmt.type)
+
+    if n < 0:
+        # The division bails out on zero, on which pow raises ZeroDivisionError or OverflowError, and subnormal
+        # chains overflow to inf
+        one = ir.new_version("_const", stmt.type)
+        statements.append(IRLiteral(one, "1.0", stmt.type, 1.0))
+        statements.append(IRBinaryOp(stmt.version, BinaryOpType.Div, one, power, stmt.type))
+        statements.append(IROverflowCheck(None, stmt.version, stmt.left))
+
+        return statements
+
+    statements.append(IRMoveOp(stmt.version, power, stmt.type))
+
+    # Integer multiplications already bail out on overflow
+    if is_float and n > 1:
+        statements.append(IROverflowCheck(None, stmt.version, stmt.left))
+
+    return statements
+
+def _reduce_div(ir: IR, stmt: IRBinaryOp, divisor: IRLiteral, fastmath: bool) -> Optional[List[IRStatement]]:
+    """
+    Statements multiplying by the reciprocal of the divisor, None if it stays a division. Without fastmath,
+    only exact reciprocals (powers of 2) are used, giving the same results as the division
+    """
+    if not is_float_type(stmt.type) or not isinstance(divisor.value, (int, float)):
+        return None
+
+    value = float(divisor.value)
+
+    if value == 0.0 or not math.isfinite(value):
+        return None
+
+    reciprocal = 1.0 / value
+
+    if stmt.type == TypeFloat32:
+        reciprocal = to_float32(reciprocal)
+
+    if not math.isfinite(reciprocal) or reciprocal == 0.0:
+        return None
+
+    if not fastmath and (abs(math.frexp(value)[0]) != 0.5 or reciprocal * value != 1.0):
+        return None
+
+    constant = ir.new_version("_const", stmt.type)
+
+    return [IRLiteral(constant, str(reciprocal), stmt.type, reciprocal),
+            IRBinaryOp(stmt.version, BinaryOpType.Mul, stmt.left, constant, stmt.type)]
+
+def reduce_strength(ir: IR, function: IRFunction, fastmath: bool = False) -> int:
+    """
+    Replaces the powers of the SSA form of function by cheaper statements when the exponent is a literal:
+    small integer exponents become multiplications by squaring, 0.5 a square root. Float divisions by a
+    literal become multiplications by its reciprocal, when it is exact or with fastmath. Runs before value
+    numbering so that the squares are shared between the powers of a same base
+
+    Returns:
+        int: number of powers and divisions replaced
+    """
+    definitions: Dict[int, IRStatement] = dict()
+
+    for block in function.blocks:
+        for stmt in block.statements:
+            for version in stmt.defines():
+                definitions[version] = stmt
+
+    count = 0
+
+    for block in function.blocks:
+        statements = list()
+
+        for stmt in block.statements:
+            reduced = None
+
+            if isinstance(stmt, IRBinaryOp) and stmt.op == BinaryOpType.Pow and \
+               isinstance(definitions.get(stmt.right), IRLiteral):
+                reduced = _reduce_pow(ir, stmt, definitions[stmt.right])
+            elif isinstance(stmt, IRBinaryOp) and stmt.op == BinaryOpType.Div and \
+                 isinstance(definitions.get(stmt.right), IRLiteral):
+                reduced = _reduce_div(ir, stmt, definitions[stmt.right], fastmath)
+
+            if reduced is None:
+                statements.append(stmt)
+            else:
+                statements.extend(reduced)
+                count += 1
+
+        block.statements = statements
+
+    return count
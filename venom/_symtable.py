@@ -4,12 +4,12 @@ import ast
 import enum
 
 from dataclasses import dataclass, field
-from typing import Optional, List, Set, Dict
+from typing import Any, Callable, Optional, List, Set, Dict
 from collections import defaultdict
 
 from ._type import *
 from ._symbols import *
-from ._builtin import get_builtin_functions, get_builtin_function_specialization
+from ._builtin import get_builtin_functions, get_builtin_function_specialization, is_intrinsic, intrinsic_binding, get_intrinsic_return_type
 from ._log import print_ast_error, print_ast_info
 
 class SymbolTable:
@@ -17,12 +17,15 @@ class SymbolTable:
 
 class SymbolTableVisitor(ast.NodeVisitor):
 
-    def __init__(self, symbol_table: SymbolTable, source_code: str = None) -> None:
+    def __init__(self, symbol_table: SymbolTable, source_code: str = None, quiet: bool = False) -> None:
         self._symbol_table = symbol_table
         self._return_types = list()
         self._source_code = source_code
         self._has_error = False
 
+        # Errors are only recorded, when the analysis is tried with different assumptions
+        self._quiet = quiet
+
     # Error and logging
 
     def has_error(self) -> bool:
@@ -31,10 +34,12 @@ class SymbolTableVisitor(ast.NodeVisitor):
     def _error(self, node: ast.expr, message: str) -> None:
         self._has_error = True
 
-        print_ast_error(node, message, self._source_code)
+        if not self._quiet:
+            print_ast_error(node, message, self._source_code)
 
     def _info(self, node: ast.expr, message: str) -> None:
-        print_ast_info(node, message, self._source_code)
+        if not self._quiet:
+            print_ast_info(node, message, self._source_code)
 
     def get_return_types(self) -> List[Type]:
         return self._return_types
@@ -44,15 +49,13 @@ class SymbolTableVisitor(ast.NodeVisitor):
             return TypeVoid
 
         if isinstance(node, ast.Constant):
-            if isinstance(node.value, int): 
-                return TypeInt64
-
-            if isinstance(node.value, float):
-                return TypeFloat64
-
+            # bool is a subclass of int
             if isinstance(node.value, bool):
                 return TypeBool
 
+            if isinstance(node.value, (int, float)):
+                return self._symbol_table.precision().literal_type(node.value)
+
             if isinstance(node.value, str):
                 return TypeString
 
@@ -83,45 +86,24 @@ class SymbolTableVisitor(ast.NodeVisitor):
             # Arithmetic operations
             op_type = type(node.op)
 
-            if op_type in (ast.Add, ast.Sub, ast.Mult):
-                if left_type == TypeFloat64 or right_type == TypeFloat64: 
-                    return TypeFloat64
+            numeric_type = promote_types(left_type, right_type)
 
-                if left_type == TypeInt64 and right_type == TypeInt64:
-                    return TypeInt64
+            if op_type in (ast.Add, ast.Sub, ast.Mult, ast.FloorDiv, ast.Mod, ast.Pow):
+                if numeric_type is not None:
+                    return numeric_type
 
             # True division /
             elif op_type is ast.Div:
-                if left_type in (TypeInt64, TypeFloat64) and right_type in (TypeInt64, TypeFloat64):
-                    return TypeFloat64
-
-            # Floor division //
-            elif op_type is ast.FloorDiv: 
-                if (left_type == TypeInt64 and right_type == TypeInt64) or \
-                   (left_type == TypeFloat64 and right_type == TypeFloat64) or \
-                   (left_type == TypeFloat64 and right_type == TypeInt64) or \
-                   (left_type == TypeInt64 and right_type == TypeFloat64): 
-                       return TypeFloat64 if TypeFloat64 in (left_type, right_type) else TypeInt64
-
-            # % and ** (simplified)
-            elif op_type in (ast.Mod, ast.Pow):
-                if left_type == TypeFloat64 or right_type == TypeFloat64:
-                    return TypeFloat64
-
-                if left_type == TypeInt64 and right_type == TypeInt64:
-                    return TypeInt64
+                if numeric_type is not None:
+                    return numeric_type if type_rank(numeric_type) == 3 else self._symbol_table.precision().float_type
             
             # Comparisons
             elif op_type in (ast.Eq, ast.NotEq, ast.Lt, ast.LtE, ast.Gt, ast.GtE):
                 return TypeBool
 
-            # Bitwise (&, |, ^)
-            elif op_type in (ast.BitAnd, ast.BitOr, ast.BitXor):
-                return TypeInt64
-
-            # Bitshifts (>>, <<)
-            elif op_type in (ast.RShift, ast.LShift):
-                return TypeInt64
+            # Bitwise (&, |, ^) and bitshifts (>>, <<)
+            elif op_type in (ast.BitAnd, ast.BitOr, ast.BitXor, ast.RShift, ast.LShift):
+                return numeric_type if type_rank(numeric_type) == 2 else TypeInt64
 
             self._error(node, f"unsupported Binary Op type: {op_type}")
 
@@ -146,15 +128,12 @@ class SymbolTableVisitor(ast.NodeVisitor):
                 return operand_type # +x
 
             if op_type is ast.USub: # -x
-                if operand_type == TypeInt64:
-                    return TypeInt64
-
-                if operand_type == TypeFloat64:
-                    return TypeFloat64
+                if type_rank(operand_type) in (2, 3):
+                    return operand_type
 
             if op_type is ast.Invert: # ~x (bitwise not)
-                 if operand_type == TypeInt64:
-                     return TypeInt64
+                 if type_rank(operand_type) == 2:
+                     return operand_type
 
             self._error = True
 
@@ -174,7 +153,7 @@ class SymbolTableVisitor(ast.NodeVisitor):
                     self._error(node, f"invalid subscript op on {sym_type} (symbol must be an array)")
                     return TypeInvalid
 
-                return sym_type.element_type
+                return array_value_type(sym_type.element_type, self._symbol_table.precision())
         elif isinstance(node, ast.List):
             # [1, 2, 3]
             if not node.elts: 
@@ -195,13 +174,28 @@ class SymbolTableVisitor(ast.NodeVisitor):
 
             return TypeInvalid 
         elif isinstance(node, ast.Call):
-            if isinstance(node.func, ast.Name):
+            intrinsic = self._symbol_table.resolve_intrinsic(node.func)
+
+            if intrinsic is not None:
+                arg_types = [self._deduce_expr_type(arg) for arg in node.args]
+
+                if any(arg_type == TypeInvalid for arg_type in arg_types):
+                    return TypeInvalid
+
+                return_type = get_intrinsic_return_type(intrinsic, arg_types, self._symbol_table.precision())
+
+                if return_type is None or len(node.keywords) > 0:
+                    self._error(node, f"unsupported call: {intrinsic}({', '.join(str(arg) for arg in arg_types)})")
+                    return TypeInvalid
+
+                return return_type
+            elif isinstance(node.func, ast.Name):
                 # TODO: adapt to compile all functions, for now only builtins are supported
                 func_name = node.func.id
 
                 symbol = self._symbol_table.resolve_symbol(func_name)
 
-                if not isinstance(symbol, FunctionBuiltin):
+                if not isinstance(symbol, (FunctionBuiltin, FunctionDef)):
                     self._error(node, f"unsupported function in call: {func_name}")
                     return TypeInvalid
 
@@ -210,7 +204,21 @@ class SymbolTableVisitor(ast.NodeVisitor):
                 if any(arg_type == TypeInvalid for arg_type in arg_types):
                     return TypeInvalid
 
-                func_type = get_builtin_function_specialization(func_name, arg_types)
+                # Other jitted functions are compiled for the types of the arguments
+                if isinstance(symbol, FunctionDef):
+                    if len(arg_types) != len(symbol.parameters) or len(node.keywords) > 0:
+                        self._error(node, f"calls to \"{func_name}\" must pass its {len(symbol.parameters)} parameters by position")
+                        return TypeInvalid
+
+                    func_type = self._symbol_table.specialize_function(symbol, arg_types)
+
+                    if func_type is None:
+                        self._error(node, f"cannot compile \"{func_name}\" for ({', '.join(str(arg) for arg in arg_types)})")
+                        return TypeInvalid
+
+                    return func_type.return_type
+
+                func_type = get_builtin_function_specialization(func_name, arg_types, self._symbol_table.precision())
 
                 if func_type.mangled_name() in symbol.specializations:
                     return func_type.return_type
@@ -226,7 +234,7 @@ class SymbolTableVisitor(ast.NodeVisitor):
 
                     func_name = func.id
 
-                    self._error(node, f"unsupported function: {func_name}")
+                    self._error(node, f"unsupported function: {func_name}.{node.func.attr}")
 
                     return TypeInvalid
                 else:
@@ -267,7 +275,7 @@ class SymbolTableVisitor(ast.NodeVisitor):
         if isinstance(node.target, ast.Name):
             var_name = node.target.id
             
-            annotated_type = pytype_to_type(node.annotation)
+            annotated_type = self._symbol_table.precision().scalar_type(pytype_to_type(node.annotation))
             inferred_type = TypeInvalid
 
             if node.value is not None:
@@ -308,7 +316,8 @@ class SymbolTableVisitor(ast.NodeVisitor):
         target_symbol = self._symbol_table.resolve_symbol(node.target.id)
         target_type = target_symbol.type
 
-        value_type = self._deduce_expr_type(node.value)
+        # x op= y has the type of x op y
+        value_type = self._deduce_expr_type(ast.copy_location(ast.BinOp(node.target, node.op, node.value), node))
 
         if target_type != value_type:
             target_symbol.type = value_type
@@ -383,15 +392,22 @@ class ScopeFrame():
 
 class SymbolTable():
     
-    def __init__(self, name: str = None) -> None:
+    def __init__(self, name: str = None, precision: Precision = DEFAULT_PRECISION) -> None:
         self._root = ScopeFrame(name if name is not None else "__module__", ScopeType.Module)
         self._current_scope = self._root
+        self._precision = precision
 
         self._builtins = dict()
 
         for name, func in get_builtin_functions().items():
             self._builtins[name] = func
 
+        self._function_specializer = None
+        self._name_resolver = None
+
+    def precision(self) -> Precision:
+        return self._precision
+
     def push_scope(self, name: str, scope_type: ScopeType) -> None:
         new_scope = ScopeFrame(name, scope_type, parent=self._current_scope)
         self._current_scope.children.append(new_scope)
@@ -425,6 +441,60 @@ class SymbolTable():
 
         return None
 
+    def set_name_resolver(self, resolver: Callable[[str], Any]) -> None:
+        """
+        Sets the callback returning the Python object a global name of the analyzed code is bound to
+        """
+        self._name_resolver = resolver
+
+    def resolve_intrinsic(self, func: ast.expr) -> Optional[str]:
+        """
+        Name of the intrinsic called through func: abs, min and max unless another symbol shadows them, and the
+        functions of the math module called as math.<name>. With a name resolver, the global name has to be bound
+        to the builtin or the math module
+
+        Returns:
+            Optional[str]: the name of the intrinsic, None if func is not one
+        """
+        if isinstance(func, ast.Name):
+            name = func.id
+            base = name
+        elif isinstance(func, ast.Attribute) and isinstance(func.value, ast.Name) and func.value.id == "math":
+            name = f"math.{func.attr}"
+            base = "math"
+
+            if self.resolve_symbol("math") is not None:
+                return None
+        else:
+            return None
+
+        if not is_intrinsic(name) or self.resolve_symbol(name) is not None:
+            return None
+
+        if self._name_resolver is not None and self._name_resolver(base) is not intrinsic_binding(name):
+            return None
+
+        return name
+
+    def set_function_specializer(self, specializer: Callable[[FunctionDef, List[Type]], Optional[FunctionType]]) -> None:
+        """
+        Sets the callback compiling the functions called by the analyzed code, it returns the type of the
+        specialization for the given argument types or None if it cannot be compiled
+        """
+        self._function_specializer = specializer
+
+    def specialize_function(self, symbol: FunctionDef, arg_types: List[Type]) -> Optional[FunctionType]:
+        for func_type in symbol.specializations.values():
+            if list(func_type.args.values()) == list(arg_types):
+                return func_type
+
+        func_type = self._function_specializer(symbol, arg_types) if self._function_specializer is not None else None
+
+        if func_type is not None:
+            symbol.specializations[func_type.mangled_name()] = func_type
+
+        return func_type
+
     def get_builtin_specializations(self) -> Dict[str, List[FunctionType]]:
         specializations = defaultdict(list)
 
@@ -445,12 +515,15 @@ class SymbolTable():
         for _, specialization in self.get_builtin_specializations().items():
             print("BUILTIN SPECIALIZATION:", specialization)
 
-    def collect_from_function(self, function_node: ast.FunctionDef, function_source_code: str = None) -> Optional[Type]:
+    def collect_from_function(self,
+                              function_node: ast.FunctionDef,
+                              function_source_code: str = None,
+                              quiet: bool = False) -> Optional[Type]:
         if not isinstance(function_node, ast.FunctionDef):
             print_ast_error(function_node, f"expected function definition, got: {type(function_node)}", function_source_code)
             return None
 
-        visitor = SymbolTableVisitor(self, function_source_code)
+        visitor = SymbolTableVisitor(self, function_source_code, quiet)
         
         for stmt in function_node.body:
             visitor.visit(stmt)
@@ -462,7 +535,7 @@ class SymbolTable():
 
         # If "-> hint" is present
         if function_node.returns is not None:
-            candidate_hint_type = pystrtype_to_type(function_node.returns.id)
+            candidate_hint_type = self._precision.scalar_type(pystrtype_to_type(function_node.returns.id))
 
             if candidate_hint_type != TypeInvalid:
                 hinted_return_type = candidate_hint_type
@@ -493,7 +566,8 @@ class SymbolTable():
             # Multiple distinct return types so we return Invalid because we expect a single return type
             sorted_types_str = sorted([t for t in valid_unique_types])
 
-            print(f"Error: Function \"{function_node.name}\" has different return types: {', '.join(sorted_types_str)}")
+            if not quiet:
+                print(f"Error: Function \"{function_node.name}\" has different return types: {', '.join(sorted_types_str)}")
 
             return TypeInvalid
 
@@ -0,0 +1,150 @@
+from typing import Dict, List, Optional
+
+from ._ir import *
+from ._op import *
+from ._type import *
+
+def _successor(function: IRFunction, block: IRBlock) -> Optional[IRBlock]:
+    """
+    Block unconditionally run after block, None if it returns or branches
+    """
+    terminator = block.terminator
+
+    if isinstance(terminator, IRJump) and terminator.comp is None:
+        return terminator.block
+
+    index = function.blocks.index(block)
+
+    if terminator is None and index + 1 < len(function.blocks):
+        return function.blocks[index + 1]
+
+    return None
+
+def _forwarded(statements: List[IRStatement], version: int) -> Optional[int]:
+    """
+    Version holding the value of version after statements only copying it around, None if they do anything else
+    """
+    for stmt in statements:
+        if not isinstance(stmt, IRMoveOp) or stmt.operand != version:
+            return None
+
+        version = stmt.version
+
+    return version
+
+def _returns(function: IRFunction, block: IRBlock, version: int) -> bool:
+    """
+    Returns True if the value of version at the end of block is returned right away, through the copies of the
+    results of nested conditional expressions
+    """
+    visited = set()
+
+    while not isinstance(block.terminator, IRReturn):
+        block = _successor(function, block)
+
+        if block is None or block.name in visited:
+            return False
+
+        visited.add(block.name)
+        version = _forwarded(block.statements, version)
+
+        if version is None:
+            return False
+
+    return block.terminator.value == version
+
+def _tail_call(function: IRFunction, block: IRBlock) -> Optional[int]:
+    """
+    Index of the call of function to itself whose value block returns, None if there is none
+    """
+    for index in reversed(range(len(block.statements))):
+        call = block.statements[index]
+
+        if isinstance(call, IRFuncOp):
+            if call.symbol != function.name:
+                return None
+
+            version = _forwarded(block.statements[index + 1:], call.version)
+
+            return index if version is not None and _returns(function, block, version) else None
+
+    return None
+
+def _insert_loop_header(function: IRFunction) -> IRBlock:
+    """
+    Moves the statements of the entry block after the declarations of the parameters to a block tail calls
+    jump to, so that the entry block stays without predecessors
+    """
+    entry = function.blocks[0]
+    declarations = 0
+
+    while declarations < len(entry.statements) and isinstance(entry.statements[declarations], IRVariable):
+        declarations += 1
+
+    name = f"recurse{entry.name}"
+
+    while any(block.name == name for block in function.blocks):
+        name = f"{name}_{len(function.blocks)}"
+
+    header = IRBlock(name, statements=entry.statements[declarations:], terminator=entry.terminator)
+
+    entry.statements = entry.statements[:declarations]
+    entry.terminator = None
+
+    function.blocks.insert(1, header)
+
+    return header
+
+def eliminate_tail_calls(ir: IR, function: IRFunction) -> int:
+    """
+    Turns the calls of function to itself whose value it returns right away into jumps back to its start, after
+    assigning the arguments to the parameters. Runs before SSA construction, arrays have to be passed as the
+    same parameter as they cannot be assigned
+
+    Returns:
+        int: number of calls replaced
+    """
+    if not any(_tail_call(function, block) is not None for block in function.blocks):
+        return 0
+
+    header = _insert_loop_header(function)
+    count = 0
+
+    for block in list(function.blocks):
+        index = _tail_call(function, block)
+
+        if index is None:
+            continue
+
+        call = block.statements[index]
+        args = iter(call.args)
+        moves = list()
+
+        for name, type in function.parameters.items():
+            parameter = function.parameter_versions[name]
+            arg = next(args)
+
+            if isinstance(type, ArrayType):
+                if arg != parameter or next(args) != function.array_lengths[parameter]:
+                    moves = None
+                    break
+            elif arg != parameter:
+                moves.append((parameter, arg, type))
+
+        if moves is None:
+            continue
+
+        # The arguments may read parameters assigned before them, they are all copied first
+        copies = [(parameter, ir.new_version("_arg", type), arg, type) for parameter, arg, type in moves]
+
+        block.statements = block.statements[:index] + \
+                           [IRMoveOp(copy, arg, type) for _, copy, arg, type in copies] + \
+                           [IRMoveOp(parameter, copy, type) for parameter, copy, _, type in copies]
+        block.terminator = IRJump(header, None)
+
+        count += 1
+
+    # The joins of conditional expressions whose branches all became jumps are left without predecessors
+    function.prune_unreachable_blocks()
+
+    return count
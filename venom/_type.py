@@ -1,7 +1,9 @@
 import enum
 import ctypes
 import hashlib
+import math
 import re
+import struct
 
 from dataclasses import dataclass, field
 from typing import Any, Tuple, Union, Optional, Dict, List, get_args, get_origin
@@ -18,6 +20,10 @@ class Primitive(enum.IntEnum):
     Int8 = 5
     Float64 = 6
     Float32 = 7
+    # Only found as elements of buffers, loaded values are widened to Int64
+    UInt8 = 8
+    UInt16 = 9
+    UInt32 = 10
 
 _primitive_to_ir_string = {
     Primitive.Void: "void",
@@ -28,6 +34,9 @@ _primitive_to_ir_string = {
     Primitive.Int8: "i8",
     Primitive.Float64: "f64",
     Primitive.Float32: "f32",
+    Primitive.UInt8: "u8",
+    Primitive.UInt16: "u16",
+    Primitive.UInt32: "u32",
 }
 
 _primitive_to_letter = {
@@ -39,8 +48,13 @@ _primitive_to_letter = {
     Primitive.Int8: "c",
     Primitive.Float64: "d",
     Primitive.Float32: "f",
+    Primitive.UInt8: "h",
+    Primitive.UInt16: "t",
+    Primitive.UInt32: "j",
 }
 
+_letter_to_primitive = { letter: primitive for primitive, letter in _primitive_to_letter.items() }
+
 _primitive_to_ctypes = {
     Primitive.Void: None,
     Primitive.Bool: ctypes.c_int32,
@@ -50,6 +64,9 @@ _primitive_to_ctypes = {
     Primitive.Int8: ctypes.c_int8,
     Primitive.Float64: ctypes.c_double,
     Primitive.Float32: ctypes.c_float,
+    Primitive.UInt8: ctypes.c_uint8,
+    Primitive.UInt16: ctypes.c_uint16,
+    Primitive.UInt32: ctypes.c_uint32,
 }
 
 @dataclass
@@ -191,24 +208,273 @@ TypeInt16 = PrimitiveType(Primitive.Int16)
 TypeInt8 = PrimitiveType(Primitive.Int8)
 TypeFloat64 = PrimitiveType(Primitive.Float64)
 TypeFloat32 = PrimitiveType(Primitive.Float32)
+TypeUInt8 = PrimitiveType(Primitive.UInt8)
+TypeUInt16 = PrimitiveType(Primitive.UInt16)
+TypeUInt32 = PrimitiveType(Primitive.UInt32)
 
 TypeString = ArrayType(Primitive.Int16)
 TypeBytes = ArrayType(Primitive.Int8)
 
 # Utils
 
-def types_from_function_signature(args: Tuple[Any, ...]) -> Optional[List[Type]]:
+# Element types of buffers, indexed by struct format kind and item size
+_buffer_element_types = {
+    ("b", 1): TypeInt8,
+    ("b", 2): TypeInt16,
+    ("b", 4): TypeInt32,
+    ("b", 8): TypeInt64,
+    ("B", 1): TypeUInt8,
+    ("B", 2): TypeUInt16,
+    ("B", 4): TypeUInt32,
+    ("f", 4): TypeFloat32,
+    ("f", 8): TypeFloat64,
+}
+
+_format_kinds = { **{ code: "b" for code in "bhilqn" }, **{ code: "B" for code in "BHILQN" }, "f": "f", "d": "f" }
+
+def type_from_buffer_format(format: str, itemsize: int) -> Optional[Type]:
+    """
+    Returns the element type of a buffer from its struct format code, None if unsupported
+    """
+    # Native and little endian byte orders are the same on supported platforms
+    if len(format) == 2 and format[0] in "@=<":
+        format = format[1:]
+
+    kind = _format_kinds.get(format) if len(format) == 1 else None
+
+    return _buffer_element_types.get((kind, itemsize))
+
+def buffer_element_type(arg: Any) -> Optional[Type]:
+    """
+    Returns the element type of an object exposing a one dimensional contiguous buffer, None if arg does not
+    expose one or if its format is unsupported
+    """
+    try:
+        view = memoryview(arg)
+    except TypeError:
+        return None
+
+    if view.ndim != 1 or not view.c_contiguous:
+        return None
+
+    return type_from_buffer_format(view.format, view.itemsize)
+
+def to_float32(value: float) -> float:
+    """
+    Rounds value to the closest single precision float, which a double holds exactly
+    """
+    try:
+        return struct.unpack("<f", struct.pack("<f", value))[0]
+    except OverflowError:
+        return math.copysign(math.inf, value)
+
+def fits_int32(value: int) -> bool:
+    return -2 ** 31 <= value < 2 ** 31
+
+def type_order(t: Type) -> Tuple[int, int]:
+    """
+    Orders the types of values for promotions: by rank, then 32 bits types below 64 bits ones
+    """
+    return type_rank(t), 4 if t in (TypeInt32, TypeFloat32) else 8
+
+def promote_types(left: Type, right: Type) -> Optional[Type]:
+    """
+    Type of both operands of an arithmetic operation on ints and floats, None if one of them is neither
+    """
+    if type_rank(left) not in (2, 3) or type_rank(right) not in (2, 3):
+        return None
+
+    return max(left, right, key=type_order)
+
+@dataclass(frozen=True)
+class Precision():
+    """
+    Types of the values Python sees as int and float in a specialization: literals, scalar arguments,
+    conversions and values loaded from arrays. Lengths and loop indices stay 64 bits wide. Int32 values bail
+    out when they leave the range of 32 bits integers, Float32 ones are rounded after each operation
+
+    With fastmath, float operations may be reassociated, fused or use reciprocals, changing their rounding, and
+    transcendental functions use the inline kernels of _kernels.py
+    """
+
+    int_type: Type = TypeInt64
+    float_type: Type = TypeFloat64
+    fastmath: bool = False
+
+    def key(self) -> str:
+        key = f"{self.int_type.ir_repr()}_{self.float_type.ir_repr()}"
+
+        return f"{key}_fast" if self.fastmath else key
+
+    def scalar_type(self, t: Optional[Type]) -> Optional[Type]:
+        """
+        Type given to the values of type t, int or float, the other types are kept
+        """
+        if t == TypeInt64:
+            return self.int_type
+        elif t == TypeFloat64:
+            return self.float_type
+
+        return t
+
+    def literal_type(self, value: Any) -> Optional[Type]:
+        if type(value) is int and not fits_int32(value):
+            return TypeInt64
+
+        return self.scalar_type(pytype_to_type(type(value)))
+
+DEFAULT_PRECISION = Precision()
+
+_precision_types = { "i64": TypeInt64, "i32": TypeInt32, "f64": TypeFloat64, "f32": TypeFloat32 }
+
+def parse_precision(int_type: str, float_type: str, fastmath: bool = False) -> Optional[Precision]:
+    """
+    Precision from the names of its types, "i64" or "i32" and "f64" or "f32"
+    """
+    types = list()
+
+    for name, rank in ((int_type, 2), (float_type, 3)):
+        t = _precision_types.get(name)
+
+        if t is None or type_rank(t) != rank:
+            print_generic_error(f"invalid {'int' if rank == 2 else 'float'} type: \"{name}\", expected "
+                                f"\"{'i64' if rank == 2 else 'f64'}\" or \"{'i32' if rank == 2 else 'f32'}\"")
+            return None
+
+        types.append(t)
+
+    return Precision(*types, fastmath)
+
+def array_value_type(element_type: Type, precision: Precision = DEFAULT_PRECISION) -> Type:
+    """
+    Type of the values loaded from an array: as in Python, integers are widened to int and floats to float.
+    Elements fitting 32 bits stay on 32 bits when the precision asks for it
+    """
+    if type_rank(element_type) == 2:
+        if precision.int_type == TypeInt32 and element_type not in (TypeInt64, TypeUInt32):
+            return TypeInt32
+
+        return TypeInt64
+    elif type_rank(element_type) == 3:
+        return precision.float_type
+
+    return element_type
+
+def is_unsigned_type(t: Type) -> bool:
+    return isinstance(t, PrimitiveType) and t.type in (Primitive.UInt8, Primitive.UInt16, Primitive.UInt32)
+
+def types_from_function_signature(args: Tuple[Any, ...], precision: Precision = DEFAULT_PRECISION) -> Optional[List[Type]]:
     types = list()
 
     for arg in args:
+        if type(arg) not in (int, float, bool, list):
+            element_type = buffer_element_type(arg)
+
+            if element_type is not None:
+                types.append(ArrayType(element_type))
+                continue
+
         if isinstance(arg, list):
+            if len(arg) == 0:
+                print_generic_error("cannot deduce the element type of an empty list")
+                return None
+
             elem_type = pytype_to_type(type(arg[0]))
+
+            if elem_type is None or any(type(elem) is not type(arg[0]) for elem in arg):
+                print_generic_error("lists must contain elements of the same supported type")
+                return None
+
             types.append(ArrayType(elem_type))
         else:
-            types.append(pytype_to_type(type(arg)))
+            arg_type = pytype_to_type(type(arg))
+
+            if arg_type is None:
+                return None
+
+            types.append(precision.scalar_type(arg_type))
 
     return types
 
+def type_from_letter(letter: str) -> Optional[Type]:
+    """
+    Inverse of Type.to_letter, returns None if letter does not describe a type
+    """
+    if letter.startswith("l"):
+        element_type = type_from_letter(letter[1:])
+        return ArrayType(element_type) if element_type is not None else None
+    elif letter.startswith("p"):
+        pointee_type = type_from_letter(letter[1:])
+        return PointerType(pointee_type) if pointee_type is not None else None
+
+    primitive = _letter_to_primitive.get(letter)
+
+    return PrimitiveType(primitive) if primitive is not None else None
+
+_signature_types = {
+    "f8": TypeFloat64, "float64": TypeFloat64, "float": TypeFloat64, "double": TypeFloat64,
+    "f4": TypeFloat32, "float32": TypeFloat32,
+    "i8": TypeInt64, "int64": TypeInt64, "int": TypeInt64,
+    "i4": TypeInt32, "int32": TypeInt32,
+    "i2": TypeInt16, "int16": TypeInt16,
+    "i1": TypeInt8, "int8": TypeInt8,
+    "u4": TypeUInt32, "uint32": TypeUInt32,
+    "u2": TypeUInt16, "uint16": TypeUInt16,
+    "u1": TypeUInt8, "uint8": TypeUInt8,
+    "b1": TypeBool, "bool": TypeBool,
+    "void": TypeVoid, "none": TypeVoid,
+}
+
+def _type_from_signature_token(token: str) -> Optional[Type]:
+    token = token.strip().lower()
+
+    # "f8[:]" is a one dimensional array of f8
+    if token.endswith("[:]"):
+        element_type = _signature_types.get(token[:-3].strip())
+
+        if element_type is None or element_type == TypeVoid:
+            return None
+
+        return ArrayType(element_type)
+
+    return _signature_types.get(token)
+
+def parse_signature(signature: str) -> Optional[Tuple[Optional[Type], List[Type]]]:
+    """
+    Parses a signature like "f8(f8, i8[:])", the return type being optional ("(f8, i8[:])")
+
+    Returns:
+        Optional[Tuple[Optional[Type], List[Type]]]: the return type (None if not given) and the argument types,
+        None if the signature is invalid
+    """
+    match = re.match(r"^\s*([\w\[\]: ]*?)\s*\((.*)\)\s*$", signature)
+
+    if match is None:
+        print_generic_error(f"invalid signature: \"{signature}\"")
+        return None
+
+    return_type = None
+
+    if match.group(1):
+        return_type = _type_from_signature_token(match.group(1))
+
+        if return_type is None:
+            print_generic_error(f"invalid return type in signature \"{signature}\"")
+            return None
+
+    arg_types = list()
+
+    for token in match.group(2).split(",") if match.group(2).strip() else []:
+        arg_type = _type_from_signature_token(token)
+
+        if arg_type is None or arg_type == TypeVoid:
+            print_generic_error(f"invalid argument type \"{token.strip()}\" in signature \"{signature}\"")
+            return None
+
+        arg_types.append(arg_type)
+
+    return return_type, arg_types
+
 def types_from_function_args(args: Tuple[Any, ...]) -> Optional[List[Type]]:
     types = list()
 
@@ -226,7 +492,8 @@ def type_rank(t: Type) -> int:
     if isinstance(t, PrimitiveType):
         if t.type in (Primitive.Float64, Primitive.Float32):
             return 3
-        elif t.type in (Primitive.Int64, Primitive.Int32, Primitive.Int16, Primitive.Int8):
+        elif t.type in (Primitive.Int64, Primitive.Int32, Primitive.Int16, Primitive.Int8,
+                        Primitive.UInt8, Primitive.UInt16, Primitive.UInt32):
             return 2
         elif t.type == Primitive.Bool:
             return 1
@@ -254,6 +521,18 @@ def type_to_ctypes_type(t: Type) -> Any:
 
     return None
 
+def abi_ctypes_type(t: Type) -> Any:
+    """
+    ctypes type of a scalar argument or return value of a jitted function. 32 bits ints and floats are passed
+    in whole registers like the 64 bits ones, jitted functions check or round their arguments on entry
+    """
+    if t == TypeInt32:
+        return ctypes.c_int64
+    elif t == TypeFloat32:
+        return ctypes.c_double
+
+    return type_to_ctypes_type(t)
+
 def pytype_to_type(py_type: Any) -> Optional[Type]:
     """
     """
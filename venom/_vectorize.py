@@ -0,0 +1,234 @@
+import copy
+
+from typing import Dict, Optional, Set
+
+from ._ir import *
+from ._op import *
+from ._type import *
+from ._regalloc import ALLOCATABLE_XMMS, compute_liveness, is_float_type
+
+# Operations with a packed SSE2 form, by type of the lanes
+_lane_ops = {
+    TypeFloat64: (BinaryOpType.Add, BinaryOpType.Sub, BinaryOpType.Mul, BinaryOpType.Min, BinaryOpType.Max, BinaryOpType.CopySign),
+    TypeFloat32: (BinaryOpType.Add, BinaryOpType.Sub, BinaryOpType.Mul, BinaryOpType.Min, BinaryOpType.Max, BinaryOpType.CopySign),
+    TypeInt64: (BinaryOpType.Add, BinaryOpType.Sub, BinaryOpType.BitAnd, BinaryOpType.BitOr, BinaryOpType.BitXor),
+    TypeInt32: (BinaryOpType.Add, BinaryOpType.Sub, BinaryOpType.BitAnd, BinaryOpType.BitOr, BinaryOpType.BitXor),
+}
+
+# Types of the elements loaded in lanes by type of the loaded values: 64 bits values are loaded two at a time in
+# a 128 bits register, 32 bits ones four at a time
+_lane_loads = {
+    TypeFloat64: (TypeFloat64, TypeFloat32),
+    TypeFloat32: (TypeFloat32,),
+    TypeInt64: (TypeInt64,),
+    TypeInt32: (TypeInt32,),
+}
+
+# Square roots flag the lanes of negative values, as the scalar code bails out on them. The math kernels of
+# fastmath functions flag the arguments they do not compute
+_lane_unary_ops = {
+    TypeFloat64: (UnaryOpType.Sqrt, UnaryOpType.Abs) + TRANSCENDENTAL_OPS,
+    TypeFloat32: (UnaryOpType.Sqrt, UnaryOpType.Abs) + TRANSCENDENTAL_OPS,
+}
+
+def _lane_width(t: Type) -> int:
+    return 4 if t in (TypeFloat32, TypeInt32) else 2
+
+# Base pointers living on the stack are loaded in rdx and r11 during the loop
+_MAX_ARRAYS = 2
+
+def _is_lane_op(stmt: IRStatement) -> bool:
+    if isinstance(stmt, IRUnaryOp):
+        # The libm has no packed forms
+        if stmt.op in TRANSCENDENTAL_OPS and not stmt.fastmath:
+            return False
+
+        return stmt.op in _lane_unary_ops.get(stmt.type, ())
+
+    return isinstance(stmt, IRBinaryOp) and stmt.op in _lane_ops.get(stmt.type, ())
+
+def _match_reduction_loop(ir: IR,
+                          function: IRFunction,
+                          index: int,
+                          live_in: Dict[str, Set[int]],
+                          fastmath: bool) -> Optional[IRVectorLoop]:
+    """
+    Matches the loops built by IRBuilder.visit_For over range() with a step of 1, whose body only loads the
+    elements at the loop variable and folds them into accumulators:
+
+        guard:  cmp %i, %stop; jump exit gteq
+        loop:   <element statements>; %acc = op %acc %value; %i = inc %i; cmp %i, %stop; jump loop lt
+        exit:   ...
+    """
+    blocks = function.blocks
+    block = blocks[index]
+
+    if index == 0 or index + 1 >= len(blocks):
+        return None
+
+    guard = function.loop_guard(block)
+    exit_block = blocks[index + 1]
+
+    terminator = block.terminator
+
+    if not isinstance(terminator, IRJump) or terminator.block is not block or terminator.comp != CompareOpType.Lt:
+        return None
+
+    if not isinstance(guard.terminator, IRJump) or \
+       guard.terminator.block is not exit_block or \
+       guard.terminator.comp != CompareOpType.GtEq:
+        return None
+
+    statements = block.statements
+
+    if len(statements) < 3 or len(guard.statements) == 0:
+        return None
+
+    inc, compare, guard_compare = statements[-2], statements[-1], guard.statements[-1]
+
+    if not isinstance(inc, IRIncOp) or inc.type != TypeInt64 or inc.version != inc.operand:
+        return None
+
+    loop_index = inc.operand
+
+    if not isinstance(compare, IRCompareOp) or not isinstance(guard_compare, IRCompareOp):
+        return None
+
+    stop = compare.right
+
+    if compare.left != loop_index or guard_compare.left != loop_index or guard_compare.right != stop:
+        return None
+
+    block_defines = [version for stmt in statements for version in stmt.defines()]
+
+    if stop in block_defines:
+        return None
+
+    body = list()
+    reductions = list()
+    local = set()
+    arrays = set()
+
+    def lane_operand(version: int) -> bool:
+        # Values computed later in the body are carried from the previous iteration
+        if version in local:
+            return True
+
+        return version != loop_index and version not in block_defines
+
+    for stmt in statements[:-2]:
+        if isinstance(stmt, IRBinaryOp) and stmt.version == stmt.left and stmt.version not in local:
+            # Accumulators are only written by their reduction and read by nothing else in the loop
+            if not _is_lane_op(stmt) or block_defines.count(stmt.version) != 1 or not lane_operand(stmt.right):
+                return None
+
+            # Only the last element would give its sign
+            if stmt.op == BinaryOpType.CopySign:
+                return None
+
+            reductions.append(stmt)
+            continue
+
+        if isinstance(stmt, IRLiteral):
+            if stmt.type not in _lane_ops:
+                return None
+        elif isinstance(stmt, IrMemLoadOp):
+            if stmt.offset != loop_index or stmt.type not in _lane_loads.get(ir.get_version_type(stmt.version), ()):
+                return None
+
+            if stmt.base_ptr in block_defines:
+                return None
+
+            arrays.add(stmt.base_ptr)
+        elif isinstance(stmt, IRMoveOp):
+            if stmt.type not in _lane_ops or not lane_operand(stmt.operand):
+                return None
+        elif _is_lane_op(stmt):
+            if not all(lane_operand(version) for version in stmt.uses()):
+                return None
+        else:
+            return None
+
+        body.append(stmt)
+        local.add(stmt.version)
+
+    if len(reductions) == 0 or len(arrays) == 0 or len(arrays) > _MAX_ARRAYS:
+        return None
+
+    # Every value of the loop takes the same number of lanes, operands of other types would need conversions
+    lane_types = set()
+
+    for stmt in body + reductions:
+        operands = [] if isinstance(stmt, IrMemLoadOp) else stmt.uses()
+        lane_types.update(ir.get_version_type(version) for version in [stmt.version] + operands)
+
+    if len(set(_lane_width(t) for t in lane_types)) != 1:
+        return None
+
+    accumulators = set(reduction.version for reduction in reductions)
+
+    for stmt in body:
+        if any(version in accumulators for version in stmt.uses()):
+            return None
+
+    # Element values only exist in lanes, they cannot be read after the loop
+    if any(version in live_in[exit_block.name] for version in local):
+        return None
+
+    # The scalar loop keeps its own statements
+    vector_loop = IRVectorLoop(None,
+                               loop_index,
+                               stop,
+                               [copy.copy(stmt) for stmt in body],
+                               [copy.copy(stmt) for stmt in reductions],
+                               fastmath)
+
+    # Float operands may already take a register each
+    float_inputs = sum(1 for version in vector_loop.uses() if is_float_type(ir.get_version_type(version)))
+
+    if vector_loop.num_vector_registers(1) > len(ALLOCATABLE_XMMS) - float_inputs:
+        return None
+
+    return vector_loop
+
+def vectorize_loops(ir: IR, function: IRFunction, fastmath: bool = False) -> int:
+    """
+    Adds a vector loop ahead of the reduction loops of function over arrays. It runs as many iterations as
+    possible with packed SSE2 instructions, 4 at a time on 32 bits values and 2 on 64 bits ones, the scalar loop
+    runs the remaining ones. Float reductions are still
+    accumulated in the order of the iterations as reassociating them would change the rounding, unless
+    fastmath allows it
+
+    Returns:
+        int: number of vectorized loops
+    """
+    live_in, _ = compute_liveness(function)
+
+    count = 0
+
+    for block in list(function.blocks):
+        index = function.blocks.index(block)
+        vector_loop = _match_reduction_loop(ir, function, index, live_in, fastmath)
+
+        if vector_loop is None:
+            continue
+
+        name = f"vec{block.name}"
+
+        while any(other.name == name for other in function.blocks):
+            name = f"{name}_{len(function.blocks)}"
+
+        # Falls through the scalar loop, which runs the remainder
+        vector_block = IRBlock(name, [])
+        vector_block.statements.append(vector_loop)
+        vector_block.statements.append(IRCompareOp(ir.new_version("_tmp", TypeBool),
+                                                   vector_loop.index,
+                                                   vector_loop.stop,
+                                                   TypeInt64))
+        vector_block.terminator = IRJump(function.blocks[index + 1], CompareOpType.GtEq)
+
+        function.blocks.insert(index, vector_block)
+
+        count += 1
+
+    return count
@@ -0,0 +1,1019 @@
+import enum
+import struct
+
+from dataclasses import dataclass
+from typing import Dict, List, Optional, Tuple, Union
+
+# Operands
+
+@dataclass(frozen=True)
+class GPR():
+    """
+    64 bits general purpose register
+    """
+
+    index: int
+
+    def __str__(self) -> str:
+        return _gpr_names[self.index]
+
+    def __repr__(self) -> str:
+        return self.__str__()
+
+    def name8(self) -> str:
+        return _gpr8_names[self.index]
+
+    def name32(self) -> str:
+        return _gpr32_names[self.index]
+
+@dataclass(frozen=True)
+class XMM():
+    """
+    128 bits SSE register
+    """
+
+    index: int
+
+    def __str__(self) -> str:
+        return f"xmm{self.index}"
+
+    def __repr__(self) -> str:
+        return self.__str__()
+
+_gpr_names = ["rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+              "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"]
+
+_gpr32_names = ["eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+                "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"]
+
+_gpr8_names = ["al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+               "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"]
+
+RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 = (GPR(i) for i in range(16))
+
+(XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7,
+ XMM8, XMM9, XMM10, XMM11, XMM12, XMM13, XMM14, XMM15) = (XMM(i) for i in range(16))
+
+@dataclass(frozen=True)
+class Mem():
+    """
+    Memory operand: [base + index * scale + disp]
+    """
+
+    base: Optional[GPR]
+    index: Optional[GPR] = None
+    scale: int = 1
+    disp: int = 0
+
+    def __str__(self) -> str:
+        parts = list()
+
+        if self.base is not None:
+            parts.append(str(self.base))
+
+        if self.index is not None:
+            parts.append(f"{self.index}*{self.scale}" if self.scale != 1 else str(self.index))
+
+        s = " + ".join(parts)
+
+        if self.disp > 0:
+            s += f" + {self.disp}" if s else str(self.disp)
+        elif self.disp < 0:
+            s += f" - {-self.disp}"
+
+        return f"[{s}]"
+
+@dataclass(frozen=True)
+class Label():
+    """
+    Position in the code, bound with Assembler.bind
+    """
+
+    name: str
+
+    def __str__(self) -> str:
+        return self.name
+
+@dataclass(frozen=True)
+class RipRel():
+    """
+    RIP-relative memory operand pointing to a label: [rip + label]
+    """
+
+    label: Label
+
+    def __str__(self) -> str:
+        return f"[rip + {self.label.name}]"
+
+Operand = Union[GPR, XMM, Mem, RipRel]
+
+class Cond(enum.IntEnum):
+    """
+    Condition codes, as encoded in jcc/setcc/cmovcc
+    """
+
+    O = 0x0
+    NO = 0x1
+    B = 0x2   # unsigned <, CF=1
+    AE = 0x3  # unsigned >=, CF=0
+    E = 0x4
+    NE = 0x5
+    BE = 0x6  # unsigned <=
+    A = 0x7   # unsigned >
+    S = 0x8
+    NS = 0x9
+    P = 0xA
+    NP = 0xB
+    L = 0xC
+    GE = 0xD
+    LE = 0xE
+    G = 0xF
+
+    def negate(self) -> "Cond":
+        return Cond(self ^ 1)
+
+@dataclass
+class Relocation():
+    """
+    64 bits absolute address to patch at load time, or 32 bits displacement from the end of the field for
+    relative ones
+    """
+
+    offset: int
+    symbol: str
+    relative: bool = False
+
+def _vex_name(operand: Operand, wide: bool) -> str:
+    return f"ymm{operand.index}" if wide and isinstance(operand, XMM) else str(operand)
+
+def fits_imm8(value: int) -> bool:
+    return -0x80 <= value <= 0x7F
+
+def fits_imm32(value: int) -> bool:
+    return -0x80000000 <= value <= 0x7FFFFFFF
+
+# Assembler
+
+class Assembler():
+    """
+    Minimal x86-64 assembler producing machine code along with a textual listing (intel syntax)
+    """
+
+    def __init__(self) -> None:
+        self._code = bytearray()
+        self._labels: Dict[Label, int] = dict()
+        self._label_counter = 0
+
+        # (position of the rel32 field, label, position of the end of the instruction)
+        self._fixups: List[Tuple[int, Label, int]] = list()
+
+        self._relocations: List[Relocation] = list()
+        self._constants: Dict[Tuple[bytes, int], Label] = dict()
+        self._listing: List[str] = list()
+
+    # Labels and constants
+
+    def new_label(self, hint: str = "L") -> Label:
+        self._label_counter += 1
+        return Label(f".{hint}{self._label_counter}")
+
+    def bind(self, label: Label) -> None:
+        if label in self._labels:
+            raise ValueError(f"label {label} already bound")
+
+        self._labels[label] = len(self._code)
+        self._listing.append(f"{label.name}:")
+
+    def is_bound(self, label: Label) -> bool:
+        return label in self._labels
+
+    def is_referenced(self, label: Label) -> bool:
+        return any(fixup_label == label for _, fixup_label, _ in self._fixups)
+
+    def constant(self, data: bytes, align: int = 16) -> RipRel:
+        """
+        Adds data to the constant pool emitted after the code, and returns a RIP-relative operand to it
+        """
+        key = (bytes(data), align)
+
+        if key not in self._constants:
+            self._label_counter += 1
+            self._constants[key] = Label(f".C{self._label_counter}")
+
+        return RipRel(self._constants[key])
+
+    # Broadcast constants, filling an xmm register or a ymm one when size is 32
+
+    def constant_f64(self, value: float, size: int = 16) -> RipRel:
+        return self.constant(struct.pack("<d", value) * (size // 8), size)
+
+    def constant_i64(self, value: int, size: int = 16) -> RipRel:
+        return self.constant(struct.pack("<q", value) * (size // 8), size)
+
+    def constant_f32(self, value: float, size: int = 16) -> RipRel:
+        return self.constant(struct.pack("<f", value) * (size // 4), size)
+
+    def constant_i32(self, value: int, size: int = 16) -> RipRel:
+        return self.constant(struct.pack("<i", value) * (size // 4), size)
+
+    def position(self) -> int:
+        return len(self._code)
+
+    def listing(self) -> List[str]:
+        return self._listing
+
+    def finalize(self) -> Tuple[bytes, List[Relocation]]:
+        """
+        Emits the constant pool, resolves label references and returns the code and its relocations
+        """
+        for (data, align), label in self._constants.items():
+            while len(self._code) % align != 0:
+                self._code.append(0xCC)
+
+            self._labels[label] = len(self._code)
+            self._code += data
+
+        for position, label, end in self._fixups:
+            if label not in self._labels:
+                raise ValueError(f"unbound label: {label}")
+
+            self._code[position:position + 4] = struct.pack("<i", self._labels[label] - end)
+
+        return bytes(self._code), list(self._relocations)
+
+    # Encoding
+
+    def _emit(self, text: str, opcode: bytes, reg: int, rm: Operand, *,
+              prefix: bytes = b"", w: bool = False, imm: bytes = b"", byte_reg: bool = False,
+              vex: Optional[Tuple[int, int, int]] = None) -> None:
+        """
+        Encodes [prefix] [REX] opcode ModRM [SIB] [disp] [imm], where reg is the ModRM.reg field (register or
+        opcode extension) and rm the ModRM.rm operand. With vex = (map, pp, vvvv, l), the prefix, REX and escape
+        bytes are replaced by a 3 bytes VEX prefix, l selecting the 256 bits form
+        """
+        rex = 0x08 if w else 0x00
+
+        if reg & 8:
+            rex |= 0x04
+
+        body = bytearray()
+        rip_label = None
+
+        if isinstance(rm, (GPR, XMM)):
+            if rm.index & 8:
+                rex |= 0x01
+
+            # spl, bpl, sil and dil are only reachable with a REX prefix
+            if byte_reg and isinstance(rm, GPR) and 4 <= rm.index <= 7:
+                rex |= 0x40
+
+            body.append(0xC0 | ((reg & 7) << 3) | (rm.index & 7))
+        elif isinstance(rm, Mem):
+            base = rm.base
+            index = rm.index
+
+            if index is not None:
+                if index.index == 4:
+                    raise ValueError("rsp cannot be used as an index register")
+
+                if index.index & 8:
+                    rex |= 0x02
+
+            if base is not None and base.index & 8:
+                rex |= 0x01
+
+            if base is None:
+                mod = 0
+            elif rm.disp == 0 and (base.index & 7) != 5:
+                mod = 0
+            elif fits_imm8(rm.disp):
+                mod = 1
+            else:
+                mod = 2
+
+            if index is not None or base is None or (base.index & 7) == 4:
+                scale_bits = { 1: 0, 2: 1, 4: 2, 8: 3 }[rm.scale]
+                index_bits = (index.index & 7) if index is not None else 4
+                base_bits = (base.index & 7) if base is not None else 5
+
+                body.append((mod << 6) | ((reg & 7) << 3) | 4)
+                body.append((scale_bits << 6) | (index_bits << 3) | base_bits)
+            else:
+                body.append((mod << 6) | ((reg & 7) << 3) | (base.index & 7))
+
+            if base is None:
+                body += struct.pack("<i", rm.disp)
+            elif mod == 1:
+                body += struct.pack("<b", rm.disp)
+            elif mod == 2:
+                body += struct.pack("<i", rm.disp)
+        elif isinstance(rm, RipRel):
+            body.append(0x05 | ((reg & 7) << 3))
+            rip_label = rm.label
+            body += b"\x00\x00\x00\x00"
+        else:
+            raise ValueError(f"invalid operand: {rm}")
+
+        start = len(self._code)
+
+        if vex is not None:
+            map_select, pp, vvvv, l = vex
+
+            # R, X and B are stored inverted, as is the extra source register
+            self._code.append(0xC4)
+            self._code.append((~(rex << 5) & 0xE0) | map_select)
+            self._code.append((0x80 if w else 0x00) | ((~vvvv & 0xF) << 3) | (0x04 if l else 0x00) | pp)
+        else:
+            self._code += prefix
+
+            if rex != 0:
+                self._code.append(0x40 | rex)
+
+        self._code += opcode
+
+        modrm_position = len(self._code)
+
+        self._code += body
+        self._code += imm
+
+        if rip_label is not None:
+            self._fixups.append((modrm_position + 1, rip_label, len(self._code)))
+
+        self._listing.append(text)
+
+    def _emit_raw(self, text: str, data: bytes) -> None:
+        self._code += data
+        self._listing.append(text)
+
+    def _rex_opcode_reg(self, text: str, opcode: int, reg: GPR, w: bool, imm: bytes = b"") -> None:
+        """
+        Encodes instructions with the register in the low bits of the opcode (push, pop, mov r, imm)
+        """
+        rex = (0x08 if w else 0x00) | (0x01 if reg.index & 8 else 0x00)
+        data = bytearray()
+
+        if rex != 0:
+            data.append(0x40 | rex)
+
+        data.append(opcode | (reg.index & 7))
+        data += imm
+
+        self._emit_raw(text, bytes(data))
+
+    # General purpose instructions
+
+    def mov(self, dst: Union[GPR, Mem], src: Union[GPR, Mem, int]) -> None:
+        if isinstance(src, int):
+            if isinstance(dst, Mem):
+                if not fits_imm32(src):
+                    raise ValueError("immediate too large for a memory destination")
+
+                self._emit(f"mov qword {dst}, {src}", b"\xC7", 0, dst, w=True, imm=struct.pack("<i", src))
+            elif 0 <= src <= 0xFFFFFFFF:
+                self._rex_opcode_reg(f"mov {dst.name32()}, {src}", 0xB8, dst, False, struct.pack("<I", src))
+            elif fits_imm32(src):
+                self._emit(f"mov {dst}, {src}", b"\xC7", 0, dst, w=True, imm=struct.pack("<i", src))
+            else:
+                self._rex_opcode_reg(f"movabs {dst}, {src}", 0xB8, dst, True, struct.pack("<q", src))
+        elif isinstance(dst, GPR) and isinstance(src, GPR):
+            if dst != src:
+                self._emit(f"mov {dst}, {src}", b"\x89", src.index, dst, w=True)
+        elif isinstance(dst, GPR):
+            self._emit(f"mov {dst}, {src}", b"\x8B", dst.index, src, w=True)
+        elif isinstance(src, GPR):
+            self._emit(f"mov {dst}, {src}", b"\x89", src.index, dst, w=True)
+        else:
+            raise ValueError(f"invalid mov operands: {dst}, {src}")
+
+    def mov_reloc(self, dst: GPR, symbol: str) -> None:
+        """
+        movabs dst, imm64 where imm64 is the address of symbol, patched at load time
+        """
+        self._rex_opcode_reg(f"movabs {dst}, {symbol}", 0xB8, dst, True, b"\x00" * 8)
+        self._relocations.append(Relocation(len(self._code) - 8, symbol))
+
+    def load(self, dst: GPR, src: Mem, size: int, signed: bool = True) -> None:
+        """
+        Loads size bytes from memory, sign or zero extending the value to 64 bits
+        """
+        if size == 8:
+            self.mov(dst, src)
+        elif size == 4:
+            if signed:
+                self._emit(f"movsxd {dst}, dword {src}", b"\x63", dst.index, src, w=True)
+            else:
+                self._emit(f"mov {dst.name32()}, dword {src}", b"\x8B", dst.index, src)
+        elif size == 2:
+            self._emit(f"{'movsx' if signed else 'movzx'} {dst}, word {src}",
+                       b"\x0F\xBF" if signed else b"\x0F\xB7", dst.index, src, w=True)
+        elif size == 1:
+            self._emit(f"{'movsx' if signed else 'movzx'} {dst}, byte {src}",
+                       b"\x0F\xBE" if signed else b"\x0F\xB6", dst.index, src, w=True)
+        else:
+            raise ValueError(f"invalid load size: {size}")
+
+    def movsxd(self, dst: GPR, src: GPR) -> None:
+        """
+        Sign extends the low 32 bits of src
+        """
+        self._emit(f"movsxd {dst}, {src.name32()}", b"\x63", dst.index, src, w=True)
+
+    def lea(self, dst: GPR, src: Union[Mem, RipRel]) -> None:
+        self._emit(f"lea {dst}, {src}", b"\x8D", dst.index, src, w=True)
+
+    def _alu(self, name: str, ext: int, dst: Union[GPR, Mem], src: Union[GPR, Mem, int]) -> None:
+        if isinstance(src, int):
+            if fits_imm8(src):
+                self._emit(f"{name} {dst}, {src}", b"\x83", ext, dst, w=True, imm=struct.pack("<b", src))
+            elif fits_imm32(src):
+                self._emit(f"{name} {dst}, {src}", b"\x81", ext, dst, w=True, imm=struct.pack("<i", src))
+            else:
+                raise ValueError("immediate too large for an alu operation")
+        elif isinstance(src, GPR):
+            self._emit(f"{name} {dst}, {src}", bytes([(ext << 3) | 0x01]), src.index, dst, w=True)
+        elif isinstance(dst, GPR):
+            self._emit(f"{name} {dst}, {src}", bytes([(ext << 3) | 0x03]), dst.index, src, w=True)
+        else:
+            raise ValueError(f"invalid {name} operands: {dst}, {src}")
+
+    def add(self, dst: Union[GPR, Mem], src: Union[GPR, Mem, int]) -> None:
+        self._alu("add", 0, dst, src)
+
+    def or_(self, dst: Union[GPR, Mem], src: Union[GPR, Mem, int]) -> None:
+        self._alu("or", 1, dst, src)
+
+    def and_(self, dst: Union[GPR, Mem], src: Union[GPR, Mem, int]) -> None:
+        self._alu("and", 4, dst, src)
+
+    def sub(self, dst: Union[GPR, Mem], src: Union[GPR, Mem, int]) -> None:
+        self._alu("sub", 5, dst, src)
+
+    def xor(self, dst: Union[GPR, Mem], src: Union[GPR, Mem, int]) -> None:
+        self._alu("xor", 6, dst, src)
+
+    def cmp(self, dst: Union[GPR, Mem], src: Union[GPR, Mem, int]) -> None:
+        self._alu("cmp", 7, dst, src)
+
+    def xor32(self, dst: GPR, src: GPR) -> None:
+        """
+        32 bits xor, used to zero a register (clobbers flags)
+        """
+        self._emit(f"xor {dst.name32()}, {src.name32()}", b"\x31", src.index, dst)
+
+    def test(self, dst: Union[GPR, Mem], src: GPR) -> None:
+        self._emit(f"test {dst}, {src}", b"\x85", src.index, dst, w=True)
+
+    def imul(self, dst: GPR, src: Union[GPR, Mem, int]) -> None:
+        if isinstance(src, int):
+            if fits_imm8(src):
+                self._emit(f"imul {dst}, {dst}, {src}", b"\x6B", dst.index, dst, w=True, imm=struct.pack("<b", src))
+            else:
+                self._emit(f"imul {dst}, {dst}, {src}", b"\x69", dst.index, dst, w=True, imm=struct.pack("<i", src))
+        else:
+            self._emit(f"imul {dst}, {src}", b"\x0F\xAF", dst.index, src, w=True)
+
+    def neg(self, dst: Union[GPR, Mem]) -> None:
+        self._emit(f"neg {dst}", b"\xF7", 3, dst, w=True)
+
+    def not_(self, dst: Union[GPR, Mem]) -> None:
+        self._emit(f"not {dst}", b"\xF7", 2, dst, w=True)
+
+    def mul(self, src: Union[GPR, Mem]) -> None:
+        """
+        rdx:rax = rax * src, unsigned
+        """
+        self._emit(f"mul {src}", b"\xF7", 4, src, w=True)
+
+    def idiv(self, src: Union[GPR, Mem]) -> None:
+        self._emit(f"idiv {src}", b"\xF7", 7, src, w=True)
+
+    def cqo(self) -> None:
+        self._emit_raw("cqo", b"\x48\x99")
+
+    def _shift(self, name: str, ext: int, dst: Union[GPR, Mem], count: Optional[int]) -> None:
+        if count is None:
+            self._emit(f"{name} {dst}, cl", b"\xD3", ext, dst, w=True)
+        else:
+            self._emit(f"{name} {dst}, {count}", b"\xC1", ext, dst, w=True, imm=struct.pack("<B", count & 63))
+
+    def shl(self, dst: Union[GPR, Mem], count: Optional[int] = None) -> None:
+        """
+        Shift left by count, or by cl if count is None
+        """
+        self._shift("shl", 4, dst, count)
+
+    def shr(self, dst: Union[GPR, Mem], count: Optional[int] = None) -> None:
+        self._shift("shr", 5, dst, count)
+
+    def sar(self, dst: Union[GPR, Mem], count: Optional[int] = None) -> None:
+        self._shift("sar", 7, dst, count)
+
+    def setcc(self, cond: Cond, dst: GPR) -> None:
+        self._emit(f"set{cond.name.lower()} {dst.name8()}", bytes([0x0F, 0x90 | cond]), 0, dst, byte_reg=True)
+
+    def movzx8(self, dst: GPR, src: GPR) -> None:
+        self._emit(f"movzx {dst.name32()}, {src.name8()}", b"\x0F\xB6", dst.index, src, byte_reg=True)
+
+    def cmov(self, cond: Cond, dst: GPR, src: Union[GPR, Mem]) -> None:
+        self._emit(f"cmov{cond.name.lower()} {dst}, {src}", bytes([0x0F, 0x40 | cond]), dst.index, src, w=True)
+
+    def push(self, reg: GPR) -> None:
+        self._rex_opcode_reg(f"push {reg}", 0x50, reg, False)
+
+    def pop(self, reg: GPR) -> None:
+        self._rex_opcode_reg(f"pop {reg}", 0x58, reg, False)
+
+    # Control flow
+
+    def _branch(self, text: str, opcode: bytes, label: Label) -> None:
+        self._code += opcode
+        position = len(self._code)
+        self._code += b"\x00\x00\x00\x00"
+        self._fixups.append((position, label, len(self._code)))
+        self._listing.append(text)
+
+    def jmp(self, label: Label) -> None:
+        self._branch(f"jmp {label}", b"\xE9", label)
+
+    def jcc(self, cond: Cond, label: Label) -> None:
+        self._branch(f"j{cond.name.lower()} {label}", bytes([0x0F, 0x80 | cond]), label)
+
+    def call(self, target: Union[GPR, Label]) -> None:
+        if isinstance(target, Label):
+            self._branch(f"call {target}", b"\xE8", target)
+        else:
+            self._emit(f"call {target}", b"\xFF", 2, target)
+
+    def call_symbol(self, symbol: str) -> None:
+        """
+        call rel32 to the address of symbol, patched at load time
+        """
+        self._emit_raw(f"call {symbol}", b"\xE8\x00\x00\x00\x00")
+        self._relocations.append(Relocation(len(self._code) - 4, symbol, True))
+
+    def ret(self) -> None:
+        self._emit_raw("ret", b"\xC3")
+
+    # SSE2 scalar double instructions
+
+    def _sse(self, name: str, prefix: bytes, opcode: bytes, dst: Union[XMM, GPR], src: Operand,
+             w: bool = False, imm: Optional[int] = None) -> None:
+        text = f"{name} {dst}, {src}" if imm is None else f"{name} {dst}, {src}, {imm}"
+        self._emit(text, b"\x0F" + opcode, dst.index, src, prefix=prefix, w=w,
+                   imm=b"" if imm is None else struct.pack("<B", imm))
+
+    def movsd(self, dst: Union[XMM, Mem], src: Union[XMM, Mem, RipRel]) -> None:
+        if isinstance(dst, XMM) and isinstance(src, XMM):
+            if dst != src:
+                # movapd copies the whole register, avoiding a dependency on the previous value of dst
+                self._sse("movapd", b"\x66", b"\x28", dst, src)
+        elif isinstance(dst, XMM):
+            self._sse("movsd", b"\xF2", b"\x10", dst, src)
+        elif isinstance(src, XMM):
+            self._emit(f"movsd {dst}, {src}", b"\x0F\x11", src.index, dst, prefix=b"\xF2")
+        else:
+            raise ValueError(f"invalid movsd operands: {dst}, {src}")
+
+    def movq_to_xmm(self, dst: XMM, src: GPR) -> None:
+        self._sse("movq", b"\x66", b"\x6E", dst, src, w=True)
+
+    def movq_from_xmm(self, dst: GPR, src: XMM) -> None:
+        self._emit(f"movq {dst}, {src}", b"\x0F\x7E", src.index, dst, prefix=b"\x66", w=True)
+
+    def addsd(self, dst: XMM, src: Operand) -> None:
+        self._sse("addsd", b"\xF2", b"\x58", dst, src)
+
+    def mulsd(self, dst: XMM, src: Operand) -> None:
+        self._sse("mulsd", b"\xF2", b"\x59", dst, src)
+
+    def subsd(self, dst: XMM, src: Operand) -> None:
+        self._sse("subsd", b"\xF2", b"\x5C", dst, src)
+
+    def divsd(self, dst: XMM, src: Operand) -> None:
+        self._sse("divsd", b"\xF2", b"\x5E", dst, src)
+
+    def sqrtsd(self, dst: XMM, src: Operand) -> None:
+        self._sse("sqrtsd", b"\xF2", b"\x51", dst, src)
+
+    def minsd(self, dst: XMM, src: Operand) -> None:
+        """
+        dst = dst < src ? dst : src, src when either is NaN
+        """
+        self._sse("minsd", b"\xF2", b"\x5D", dst, src)
+
+    def maxsd(self, dst: XMM, src: Operand) -> None:
+        """
+        dst = dst > src ? dst : src, src when either is NaN
+        """
+        self._sse("maxsd", b"\xF2", b"\x5F", dst, src)
+
+    def roundsd(self, dst: XMM, src: Operand, mode: int) -> None:
+        """
+        SSE4.1, rounds src to an integral value, towards -inf with mode 9 and +inf with mode 10
+        """
+        self._sse("roundsd", b"\x66", b"\x3A\x0B", dst, src, imm=mode)
+
+    def ucomisd(self, dst: XMM, src: Operand) -> None:
+        self._sse("ucomisd", b"\x66", b"\x2E", dst, src)
+
+    def cvtsi2sd(self, dst: XMM, src: Union[GPR, Mem]) -> None:
+        self._sse("cvtsi2sd", b"\xF2", b"\x2A", dst, src, w=True)
+
+    def cvttsd2si(self, dst: GPR, src: Union[XMM, Mem]) -> None:
+        self._sse("cvttsd2si", b"\xF2", b"\x2C", dst, src, w=True)
+
+    def cvtss2sd(self, dst: XMM, src: Union[XMM, Mem]) -> None:
+        self._sse("cvtss2sd", b"\xF3", b"\x5A", dst, src)
+
+    def cvtsd2ss(self, dst: XMM, src: Union[XMM, Mem]) -> None:
+        self._sse("cvtsd2ss", b"\xF2", b"\x5A", dst, src)
+
+    def cvtsi2ss(self, dst: XMM, src: Union[GPR, Mem]) -> None:
+        self._sse("cvtsi2ss", b"\xF3", b"\x2A", dst, src, w=True)
+
+    def addss(self, dst: XMM, src: Operand) -> None:
+        self._sse("addss", b"\xF3", b"\x58", dst, src)
+
+    def mulss(self, dst: XMM, src: Operand) -> None:
+        self._sse("mulss", b"\xF3", b"\x59", dst, src)
+
+    def minss(self, dst: XMM, src: Operand) -> None:
+        self._sse("minss", b"\xF3", b"\x5D", dst, src)
+
+    def maxss(self, dst: XMM, src: Operand) -> None:
+        self._sse("maxss", b"\xF3", b"\x5F", dst, src)
+
+    def subss(self, dst: XMM, src: Operand) -> None:
+        self._sse("subss", b"\xF3", b"\x5C", dst, src)
+
+    def xorpd(self, dst: XMM, src: Operand) -> None:
+        self._sse("xorpd", b"\x66", b"\x57", dst, src)
+
+    def andpd(self, dst: XMM, src: Operand) -> None:
+        self._sse("andpd", b"\x66", b"\x54", dst, src)
+
+    def andnpd(self, dst: XMM, src: Operand) -> None:
+        """
+        dst = ~dst & src
+        """
+        self._sse("andnpd", b"\x66", b"\x55", dst, src)
+
+    def orpd(self, dst: XMM, src: Operand) -> None:
+        self._sse("orpd", b"\x66", b"\x56", dst, src)
+
+    def cmpsd(self, dst: XMM, src: Union[XMM, Mem], predicate: int) -> None:
+        """
+        Sets the low lane of dst to all ones if dst predicate src holds, zeros otherwise
+        """
+        self._sse("cmpsd", b"\xF2", b"\xC2", dst, src, imm=predicate)
+
+    # SSE2 packed instructions, memory operands of the arithmetic ones must be 16 bytes aligned
+
+    def movupd(self, dst: Union[XMM, Mem], src: Union[XMM, Mem]) -> None:
+        if isinstance(dst, XMM):
+            self._sse("movupd", b"\x66", b"\x10", dst, src)
+        else:
+            self._emit(f"movupd {dst}, {src}", b"\x0F\x11", src.index, dst, prefix=b"\x66")
+
+    def movapd(self, dst: XMM, src: Operand) -> None:
+        if dst != src:
+            self._sse("movapd", b"\x66", b"\x28", dst, src)
+
+    def movdqu(self, dst: XMM, src: Mem) -> None:
+        self._sse("movdqu", b"\xF3", b"\x6F", dst, src)
+
+    def cvtps2pd(self, dst: XMM, src: Union[XMM, Mem]) -> None:
+        self._sse("cvtps2pd", b"", b"\x5A", dst, src)
+
+    def cvtpd2ps(self, dst: XMM, src: Union[XMM, Mem]) -> None:
+        self._sse("cvtpd2ps", b"\x66", b"\x5A", dst, src)
+
+    def movhlps(self, dst: XMM, src: XMM) -> None:
+        """
+        Copies the high 64 bits of src to the low ones of dst
+        """
+        self._sse("movhlps", b"", b"\x12", dst, src)
+
+    def movlhps(self, dst: XMM, src: XMM) -> None:
+        """
+        Copies the low 64 bits of src to the high ones of dst
+        """
+        self._sse("movlhps", b"", b"\x16", dst, src)
+
+    def movups(self, dst: XMM, src: Mem) -> None:
+        self._sse("movups", b"", b"\x10", dst, src)
+
+    def addps(self, dst: XMM, src: Operand) -> None:
+        self._sse("addps", b"", b"\x58", dst, src)
+
+    def subps(self, dst: XMM, src: Operand) -> None:
+        self._sse("subps", b"", b"\x5C", dst, src)
+
+    def mulps(self, dst: XMM, src: Operand) -> None:
+        self._sse("mulps", b"", b"\x59", dst, src)
+
+    def minps(self, dst: XMM, src: Operand) -> None:
+        self._sse("minps", b"", b"\x5D", dst, src)
+
+    def maxps(self, dst: XMM, src: Operand) -> None:
+        self._sse("maxps", b"", b"\x5F", dst, src)
+
+    def sqrtps(self, dst: XMM, src: Operand) -> None:
+        self._sse("sqrtps", b"", b"\x51", dst, src)
+
+    def cmpps(self, dst: XMM, src: Operand, predicate: int) -> None:
+        self._sse("cmpps", b"", b"\xC2", dst, src, imm=predicate)
+
+    def shufps(self, dst: XMM, src: Operand, order: int) -> None:
+        self._sse("shufps", b"", b"\xC6", dst, src, imm=order)
+
+    def addpd(self, dst: XMM, src: Operand) -> None:
+        self._sse("addpd", b"\x66", b"\x58", dst, src)
+
+    def subpd(self, dst: XMM, src: Operand) -> None:
+        self._sse("subpd", b"\x66", b"\x5C", dst, src)
+
+    def mulpd(self, dst: XMM, src: Operand) -> None:
+        self._sse("mulpd", b"\x66", b"\x59", dst, src)
+
+    def divpd(self, dst: XMM, src: Operand) -> None:
+        self._sse("divpd", b"\x66", b"\x5E", dst, src)
+
+    def minpd(self, dst: XMM, src: Operand) -> None:
+        self._sse("minpd", b"\x66", b"\x5D", dst, src)
+
+    def maxpd(self, dst: XMM, src: Operand) -> None:
+        self._sse("maxpd", b"\x66", b"\x5F", dst, src)
+
+    def sqrtpd(self, dst: XMM, src: Operand) -> None:
+        self._sse("sqrtpd", b"\x66", b"\x51", dst, src)
+
+    def cmppd(self, dst: XMM, src: Operand, predicate: int) -> None:
+        """
+        Sets each lane of dst to all ones if dst predicate src holds for it, zeros otherwise
+        """
+        self._sse("cmppd", b"\x66", b"\xC2", dst, src, imm=predicate)
+
+    def unpcklpd(self, dst: XMM, src: Operand) -> None:
+        self._sse("unpcklpd", b"\x66", b"\x14", dst, src)
+
+    def unpckhpd(self, dst: XMM, src: Operand) -> None:
+        self._sse("unpckhpd", b"\x66", b"\x15", dst, src)
+
+    def movmskpd(self, dst: GPR, src: XMM) -> None:
+        self._emit(f"movmskpd {dst.name32()}, {src}", b"\x0F\x50", dst.index, src, prefix=b"\x66")
+
+    def movmskps(self, dst: GPR, src: XMM) -> None:
+        self._emit(f"movmskps {dst.name32()}, {src}", b"\x0F\x50", dst.index, src)
+
+    def paddd(self, dst: XMM, src: Operand) -> None:
+        self._sse("paddd", b"\x66", b"\xFE", dst, src)
+
+    def psubd(self, dst: XMM, src: Operand) -> None:
+        self._sse("psubd", b"\x66", b"\xFA", dst, src)
+
+    def paddq(self, dst: XMM, src: Operand) -> None:
+        self._sse("paddq", b"\x66", b"\xD4", dst, src)
+
+    def psubq(self, dst: XMM, src: Operand) -> None:
+        self._sse("psubq", b"\x66", b"\xFB", dst, src)
+
+    def pand(self, dst: XMM, src: Operand) -> None:
+        self._sse("pand", b"\x66", b"\xDB", dst, src)
+
+    def pandn(self, dst: XMM, src: Operand) -> None:
+        """
+        dst = ~dst & src
+        """
+        self._sse("pandn", b"\x66", b"\xDF", dst, src)
+
+    def por(self, dst: XMM, src: Operand) -> None:
+        self._sse("por", b"\x66", b"\xEB", dst, src)
+
+    def pxor(self, dst: XMM, src: Operand) -> None:
+        self._sse("pxor", b"\x66", b"\xEF", dst, src)
+
+    def pcmpeqd(self, dst: XMM, src: Operand) -> None:
+        self._sse("pcmpeqd", b"\x66", b"\x76", dst, src)
+
+    def pshufd(self, dst: XMM, src: Union[XMM, Mem], order: int) -> None:
+        self._sse("pshufd", b"\x66", b"\x70", dst, src, imm=order)
+
+    def _shift_imm(self, name: str, opcode: bytes, ext: int, dst: XMM, count: int) -> None:
+        self._emit(f"{name} {dst}, {count}", b"\x0F" + opcode, ext, dst, prefix=b"\x66", imm=struct.pack("<B", count))
+
+    def psllq(self, dst: XMM, count: int) -> None:
+        self._shift_imm("psllq", b"\x73", 6, dst, count)
+
+    def psrlq(self, dst: XMM, count: int) -> None:
+        self._shift_imm("psrlq", b"\x73", 2, dst, count)
+
+    def psrad(self, dst: XMM, count: int) -> None:
+        self._shift_imm("psrad", b"\x72", 4, dst, count)
+
+    # AVX instructions, VEX encoded. Packed ones work on the ymm register sharing the index of each xmm one
+    # when wide is set
+
+    def _vex(self, name: str, map_select: int, pp: int, opcode: int, dst: Union[XMM, GPR], src1: Optional[XMM],
+             src2: Operand, w: bool = False, wide: bool = False, imm: Optional[int] = None) -> None:
+        operands = [_vex_name(op, wide) for op in (dst, src1, src2) if op is not None]
+        text = f"{name} {', '.join(operands)}" if imm is None else f"{name} {', '.join(operands)}, {imm}"
+
+        self._emit(text, bytes([opcode]), dst.index, src2, w=w, imm=b"" if imm is None else struct.pack("<B", imm),
+                   vex=(map_select, pp, src1.index if src1 is not None else 0, wide))
+
+    def vzeroupper(self) -> None:
+        # Clears the upper halves of the ymm registers, avoiding the penalties of the SSE code that follows
+        self._emit_raw("vzeroupper", b"\xC5\xF8\x77")
+
+    def vmovupd(self, dst: XMM, src: Operand, wide: bool = False) -> None:
+        self._vex("vmovupd", 0x01, 0x01, 0x10, dst, None, src, wide=wide)
+
+    def vmovups(self, dst: XMM, src: Operand, wide: bool = False) -> None:
+        self._vex("vmovups", 0x01, 0x00, 0x10, dst, None, src, wide=wide)
+
+    def vmovdqu(self, dst: XMM, src: Operand, wide: bool = False) -> None:
+        self._vex("vmovdqu", 0x01, 0x02, 0x6F, dst, None, src, wide=wide)
+
+    def vmovapd(self, dst: XMM, src: XMM, wide: bool = False) -> None:
+        if dst != src:
+            self._vex("vmovapd", 0x01, 0x01, 0x28, dst, None, src, wide=wide)
+
+    def vcvtps2pd(self, dst: XMM, src: Union[XMM, Mem]) -> None:
+        """
+        Widens the 4 floats of the xmm register or 16 bytes at src into the 4 doubles of the ymm register dst
+        """
+        self._emit(f"vcvtps2pd {_vex_name(dst, True)}, {src}", b"\x5A", dst.index, src, vex=(0x01, 0x00, 0, True))
+
+    def vcvtpd2ps(self, dst: XMM, src: XMM) -> None:
+        """
+        Narrows the 4 doubles of the ymm register src into the 4 floats of the xmm register dst
+        """
+        self._emit(f"vcvtpd2ps {dst}, {_vex_name(src, True)}", b"\x5A", dst.index, src, vex=(0x01, 0x01, 0, True))
+
+    def vaddpd(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vaddpd", 0x01, 0x01, 0x58, dst, src1, src2, wide=wide)
+
+    def vaddps(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vaddps", 0x01, 0x00, 0x58, dst, src1, src2, wide=wide)
+
+    def vsubpd(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vsubpd", 0x01, 0x01, 0x5C, dst, src1, src2, wide=wide)
+
+    def vsubps(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vsubps", 0x01, 0x00, 0x5C, dst, src1, src2, wide=wide)
+
+    def vmulpd(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vmulpd", 0x01, 0x01, 0x59, dst, src1, src2, wide=wide)
+
+    def vmulps(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vmulps", 0x01, 0x00, 0x59, dst, src1, src2, wide=wide)
+
+    def vdivpd(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vdivpd", 0x01, 0x01, 0x5E, dst, src1, src2, wide=wide)
+
+    def vminpd(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vminpd", 0x01, 0x01, 0x5D, dst, src1, src2, wide=wide)
+
+    def vminps(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vminps", 0x01, 0x00, 0x5D, dst, src1, src2, wide=wide)
+
+    def vmaxpd(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vmaxpd", 0x01, 0x01, 0x5F, dst, src1, src2, wide=wide)
+
+    def vmaxps(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vmaxps", 0x01, 0x00, 0x5F, dst, src1, src2, wide=wide)
+
+    def vsqrtpd(self, dst: XMM, src: Operand, wide: bool = False) -> None:
+        self._vex("vsqrtpd", 0x01, 0x01, 0x51, dst, None, src, wide=wide)
+
+    def vsqrtps(self, dst: XMM, src: Operand, wide: bool = False) -> None:
+        self._vex("vsqrtps", 0x01, 0x00, 0x51, dst, None, src, wide=wide)
+
+    def vcmppd(self, dst: XMM, src1: XMM, src2: Operand, predicate: int, wide: bool = False) -> None:
+        self._vex("vcmppd", 0x01, 0x01, 0xC2, dst, src1, src2, wide=wide, imm=predicate)
+
+    def vcmpps(self, dst: XMM, src1: XMM, src2: Operand, predicate: int, wide: bool = False) -> None:
+        self._vex("vcmpps", 0x01, 0x00, 0xC2, dst, src1, src2, wide=wide, imm=predicate)
+
+    def vpaddq(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vpaddq", 0x01, 0x01, 0xD4, dst, src1, src2, wide=wide)
+
+    def vpaddd(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vpaddd", 0x01, 0x01, 0xFE, dst, src1, src2, wide=wide)
+
+    def vpsubq(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vpsubq", 0x01, 0x01, 0xFB, dst, src1, src2, wide=wide)
+
+    def vpsubd(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vpsubd", 0x01, 0x01, 0xFA, dst, src1, src2, wide=wide)
+
+    def vpand(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vpand", 0x01, 0x01, 0xDB, dst, src1, src2, wide=wide)
+
+    def vpandn(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        """
+        dst = ~src1 & src2
+        """
+        self._vex("vpandn", 0x01, 0x01, 0xDF, dst, src1, src2, wide=wide)
+
+    def vpor(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vpor", 0x01, 0x01, 0xEB, dst, src1, src2, wide=wide)
+
+    def vpxor(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vpxor", 0x01, 0x01, 0xEF, dst, src1, src2, wide=wide)
+
+    def vpcmpeqd(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._vex("vpcmpeqd", 0x01, 0x01, 0x76, dst, src1, src2, wide=wide)
+
+    def vpshufd(self, dst: XMM, src: Operand, order: int, wide: bool = False) -> None:
+        self._vex("vpshufd", 0x01, 0x01, 0x70, dst, None, src, wide=wide, imm=order)
+
+    def _vex_shift_imm(self, name: str, opcode: int, ext: int, dst: XMM, src: XMM, count: int, wide: bool) -> None:
+        # VEX.66.0F, dst is encoded in vvvv and the opcode extension in ModRM.reg
+        self._emit(f"{name} {_vex_name(dst, wide)}, {_vex_name(src, wide)}, {count}", bytes([opcode]), ext, src,
+                   imm=struct.pack("<B", count), vex=(0x01, 0x01, dst.index, wide))
+
+    def vpsllq(self, dst: XMM, src: XMM, count: int, wide: bool = False) -> None:
+        self._vex_shift_imm("vpsllq", 0x73, 6, dst, src, count, wide)
+
+    def vpsrlq(self, dst: XMM, src: XMM, count: int, wide: bool = False) -> None:
+        self._vex_shift_imm("vpsrlq", 0x73, 2, dst, src, count, wide)
+
+    def vpsrad(self, dst: XMM, src: XMM, count: int, wide: bool = False) -> None:
+        self._vex_shift_imm("vpsrad", 0x72, 4, dst, src, count, wide)
+
+    def vmovmskpd(self, dst: GPR, src: XMM, wide: bool = False) -> None:
+        self._emit(f"vmovmskpd {dst.name32()}, {_vex_name(src, wide)}", b"\x50", dst.index, src, vex=(0x01, 0x01, 0, wide))
+
+    def vmovmskps(self, dst: GPR, src: XMM, wide: bool = False) -> None:
+        self._emit(f"vmovmskps {dst.name32()}, {_vex_name(src, wide)}", b"\x50", dst.index, src, vex=(0x01, 0x00, 0, wide))
+
+    def _broadcast(self, name: str, opcode: int, dst: XMM, src: XMM) -> None:
+        # AVX2 register forms, the low element of the xmm register src is copied to every lane of the ymm one
+        self._emit(f"{name} {_vex_name(dst, True)}, {src}", bytes([opcode]), dst.index, src, vex=(0x02, 0x01, 0, True))
+
+    def vbroadcastss(self, dst: XMM, src: XMM) -> None:
+        self._broadcast("vbroadcastss", 0x18, dst, src)
+
+    def vbroadcastsd(self, dst: XMM, src: XMM) -> None:
+        self._broadcast("vbroadcastsd", 0x19, dst, src)
+
+    def vpbroadcastd(self, dst: XMM, src: XMM) -> None:
+        self._broadcast("vpbroadcastd", 0x58, dst, src)
+
+    def vpbroadcastq(self, dst: XMM, src: XMM) -> None:
+        self._broadcast("vpbroadcastq", 0x59, dst, src)
+
+    def vextractf128(self, dst: XMM, src: XMM, half: int) -> None:
+        """
+        Copies the low (half = 0) or high (half = 1) 128 bits of the ymm register src to dst
+        """
+        self._emit(f"vextractf128 {dst}, {_vex_name(src, True)}, {half}", b"\x19", src.index, dst,
+                   imm=struct.pack("<B", half), vex=(0x03, 0x01, 0, True))
+
+    def vinsertf128(self, dst: XMM, src1: XMM, src2: XMM, half: int) -> None:
+        """
+        Copies the ymm register src1 to dst, replacing its low (half = 0) or high (half = 1) 128 bits by src2
+        """
+        self._emit(f"vinsertf128 {_vex_name(dst, True)}, {_vex_name(src1, True)}, {src2}, {half}", b"\x18", dst.index, src2,
+                   imm=struct.pack("<B", half), vex=(0x03, 0x01, src1.index, True))
+
+    def _fma(self, name: str, opcode: int, dst: XMM, src1: XMM, src2: Operand, w: bool, wide: bool = False) -> None:
+        # VEX.66.0F38, dst = src1 * src2 + dst for the 231 forms
+        self._vex(name, 0x02, 0x01, opcode, dst, src1, src2, w=w, wide=wide)
+
+    def vfmadd231sd(self, dst: XMM, src1: XMM, src2: Operand) -> None:
+        self._fma("vfmadd231sd", 0xB9, dst, src1, src2, True)
+
+    def vfmsub231sd(self, dst: XMM, src1: XMM, src2: Operand) -> None:
+        self._fma("vfmsub231sd", 0xBB, dst, src1, src2, True)
+
+    def vfnmadd231sd(self, dst: XMM, src1: XMM, src2: Operand) -> None:
+        self._fma("vfnmadd231sd", 0xBD, dst, src1, src2, True)
+
+    def vfnmsub231sd(self, dst: XMM, src1: XMM, src2: Operand) -> None:
+        self._fma("vfnmsub231sd", 0xBF, dst, src1, src2, True)
+
+    def vfmadd231pd(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._fma("vfmadd231pd", 0xB8, dst, src1, src2, True, wide)
+
+    def vfmadd231ps(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._fma("vfmadd231ps", 0xB8, dst, src1, src2, False, wide)
+
+    def vfnmadd231pd(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._fma("vfnmadd231pd", 0xBC, dst, src1, src2, True, wide)
+
+    def vfnmadd231ps(self, dst: XMM, src1: XMM, src2: Operand, wide: bool = False) -> None:
+        self._fma("vfnmadd231ps", 0xBC, dst, src1, src2, False, wide)
+
+    # BMI2 shifts, by the count held in any register and without touching the flags
+
+    def _shiftx(self, name: str, pp: int, dst: GPR, src: Union[GPR, Mem], count: GPR) -> None:
+        self._emit(f"{name} {dst}, {src}, {count}", b"\xF7", dst.index, src, w=True, vex=(0x02, pp, count.index, False))
+
+    def shlx(self, dst: GPR, src: Union[GPR, Mem], count: GPR) -> None:
+        self._shiftx("shlx", 0x01, dst, src, count)
+
+    def sarx(self, dst: GPR, src: Union[GPR, Mem], count: GPR) -> None:
+        self._shiftx("sarx", 0x02, dst, src, count)